@@ -0,0 +1,87 @@
+#include "includes.h"
+
+// Bump allocator for stage temporaries.
+// Memory comes from a chain of large blocks; a stage takes a mark, allocates
+// what it needs and releases back to the mark when done, which frees any
+// block opened after the mark. Allocations are ARENA_ALIGN aligned and are
+// only valid until the enclosing mark is released.
+
+struct ArenaBlock {
+    struct ArenaBlock *prev;
+    size_t size;
+    size_t used;
+    char *data;
+};
+
+static size_t arena_round(size_t bytes) {
+    return (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+static ArenaBlock *arena_block_new(size_t size, ArenaBlock *prev) {
+    ArenaBlock *block = (ArenaBlock*)malloc(sizeof(ArenaBlock));
+    if (!block)
+        return NULL;
+
+    block->data = (char*)aligned_alloc(ARENA_ALIGN, size);
+    if (!block->data) {
+        free(block);
+        return NULL;
+    }
+    block->prev = prev;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void *arena_alloc(Arena *arena, size_t bytes) {
+    bytes = arena_round(bytes ? bytes : 1);
+
+    ArenaBlock *head = arena->head;
+    if (!head || head->size - head->used < bytes) {
+        size_t size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+        head = arena_block_new(size, arena->head);
+        if (!head) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            return NULL;
+        }
+        arena->head = head;
+    }
+
+    void *p = head->data + head->used;
+    head->used += bytes;
+    return p;
+}
+
+ArenaMark arena_mark(const Arena *arena) {
+    ArenaMark mark = { arena->head, arena->head ? arena->head->used : 0 };
+    return mark;
+}
+
+// Drop everything allocated after the mark
+void arena_release(Arena *arena, ArenaMark mark) {
+    while (arena->head && arena->head != mark.block) {
+        ArenaBlock *prev = arena->head->prev;
+        free(arena->head->data);
+        free(arena->head);
+        arena->head = prev;
+    }
+    if (arena->head)
+        arena->head->used = mark.used;
+}
+
+void arena_free(Arena *arena) {
+    ArenaMark empty = { NULL, 0 };
+    arena_release(arena, empty);
+}
+
+// Per-thread arena used by the processing stages for their temporaries
+Arena *scratch_arena(void) {
+    static _Thread_local Arena scratch = { NULL };
+    return &scratch;
+}
+
+// Drop the calling thread's scratch arena. Threads that use it must call
+// this before they exit; the blocks are not freed with the thread.
+void arena_thread_free(void) {
+    arena_free(scratch_arena());
+}
@@ -0,0 +1,381 @@
+#include "includes.h"
+
+// baseband_check: the carrier-to-baseband stages against tones of known
+// amplitude and phase.
+// The DDC, set up as main uses it, takes a tone inside the band on both
+// channels: past the chain's start-up every output must be the tone's
+// phasor at the time it stands for, delay included, and the two channels'
+// ratio must come through unchanged. A tone outside the band must be
+// rejected, and the same input pushed in odd-sized blocks must give the
+// same output as in one go. The resampler must match the zero-stuff,
+// filter and keep definition it implements at several ratios, give the
+// same output whatever the block sizes, and take a designed tone through
+// capture_resample at unit gain and on time while rejecting one that
+// would alias. The lock-in, set up as main uses it, must read the ratio,
+// phase and bearing of known channel pairs once settled, and give the same
+// readings in blocks as in one go. Exits non-zero if any case fails.
+
+#define CHECK_FS 64000.0
+#define CHECK_CARRIER_HZ 25200.0
+#define CHECK_SAMPLES 64000
+
+#define DDC_CHECK_PHASOR_TOL 0.07       // relative, inside 0.5 dB of ripple
+#define DDC_CHECK_RATIO_TOL 1e-4        // both share the chain; only the image residue differs
+#define DDC_CHECK_REJECT_DB -55.0
+#define DDC_CHECK_BLOCK_TOL 1e-12
+
+static const int ddc_blocks[] = { 1, 333, 4097 };
+
+#define RESAMPLE_CHECK_TOL 1e-12
+#define RESAMPLE_CHECK_GAIN_TOL 0.07    // inside 0.5 dB of ripple
+#define RESAMPLE_CHECK_REJECT_DB -55.0
+
+static const int resample_ratios[][2] = { { 2, 1 }, { 1, 3 }, { 3, 2 }, { 2, 5 }, { 7, 4 }, { 160, 147 } };
+
+// Tone of amplitude a and phase ph (rad) at f
+static void check_tone(double *x, int n, double f, double a, double ph) {
+    for (int i = 0; i < n; i++)
+        x[i] = a * cos(2.0 * M_PI * f * i / CHECK_FS + ph);
+}
+
+static int report(const char *what, double value, const char *unit, int ok) {
+    printf("%-38s %10.4g %-4s %s\n", what, value, unit, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+// Whole signal through a fresh chain in blocks of block samples (0 for one
+// go); returns the number of outputs
+static int ddc_run(const DDCConfig *cfg, double *const *x, int n, int block, double complex *const *out) {
+    DDC ddc;
+    if (ddc_init(&ddc, cfg, 2) != 0)
+        return -1;
+    int n_out = 0;
+    if (block <= 0)
+        block = n;
+    for (int i0 = 0; i0 < n; i0 += block) {
+        int len = n - i0 < block ? n - i0 : block;
+        const double *in[2] = { x[0] + i0, x[1] + i0 };
+        double complex *o[2] = { out[0] + n_out, out[1] + n_out };
+        int got = ddc_process(&ddc, in, len, o);
+        if (got < 0) {
+            n_out = -1;
+            break;
+        }
+        n_out += got;
+    }
+    ddc_free(&ddc);
+    return n_out;
+}
+
+static int check_ddc(void) {
+    DDCConfig cfg = { CHECK_FS, CHECK_CARRIER_HZ, 640.0, 400.0, 0.5, 60.0 };
+    DDC ddc;
+    if (ddc_init(&ddc, &cfg, 2) != 0)
+        return 1;
+    int decimation = ddc.decimation;
+    double delay = ddc.delay;
+    ddc_free(&ddc);
+
+    int n = CHECK_SAMPLES, capacity = n / decimation + 1;
+    double *x[2] = { (double*)malloc(n * sizeof(double)), (double*)malloc(n * sizeof(double)) };
+    double complex *y[2], *z[2];
+    for (int c = 0; c < 2; c++) {
+        y[c] = (double complex*)malloc(capacity * sizeof(double complex));
+        z[c] = (double complex*)malloc(capacity * sizeof(double complex));
+    }
+    int failed = 0;
+    if (!x[0] || !x[1] || !y[0] || !y[1] || !z[0] || !z[1]) {
+        failed = 1;
+        goto cleanup;
+    }
+
+    // In the band: 60 Hz above the carrier, ch1 at 0.4 and 50 degrees on
+    double df = 60.0, a0 = 1e-3, ratio = 0.4, phase = 50.0 * M_PI / 180.0;
+    check_tone(x[0], n, CHECK_CARRIER_HZ + df, a0, 0.0);
+    check_tone(x[1], n, CHECK_CARRIER_HZ + df, a0 * ratio, phase);
+    int n_out = ddc_run(&cfg, x, n, 0, y);
+    failed += report("DDC outputs", n_out, "", n_out == n / decimation || n_out == n / decimation + 1);
+
+    // Outputs before twice the delay still hold the filters' start-up
+    int skip = (int)ceil(2.0 * delay / decimation);
+    double phasor_err = 0.0, ratio_err = 0.0;
+    double complex want_ratio = ratio * cexp(I * phase);
+    for (int m = skip; m < n_out; m++) {
+        double t = (m * (double)decimation - delay) / CHECK_FS;
+        double complex want = a0 * cexp(I * 2.0 * M_PI * df * t);
+        phasor_err = fmax(phasor_err, cabs(y[0][m] - want) / a0);
+        ratio_err = fmax(ratio_err, cabs(y[1][m] / y[0][m] - want_ratio) / ratio);
+    }
+    failed += report("DDC in-band phasor error", phasor_err, "", n_out > skip && phasor_err < DDC_CHECK_PHASOR_TOL);
+    failed += report("DDC channel ratio error", ratio_err, "", n_out > skip && ratio_err < DDC_CHECK_RATIO_TOL);
+
+    // Same input in odd blocks
+    for (int b = 0; b < (int)(sizeof(ddc_blocks) / sizeof(ddc_blocks[0])); b++) {
+        int n_blk = ddc_run(&cfg, x, n, ddc_blocks[b], z);
+        double err = 0.0;
+        for (int c = 0; c < 2; c++)
+            for (int m = 0; m < n_out && m < n_blk; m++)
+                err = fmax(err, cabs(z[c][m] - y[c][m]) / a0);
+        char what[64];
+        snprintf(what, sizeof(what), "DDC in blocks of %d", ddc_blocks[b]);
+        failed += report(what, err, "", n_blk == n_out && err < DDC_CHECK_BLOCK_TOL);
+    }
+
+    // Out of the band: 1 kHz off the carrier
+    check_tone(x[0], n, CHECK_CARRIER_HZ + 1000.0, a0, 0.0);
+    check_tone(x[1], n, CHECK_CARRIER_HZ - 1000.0, a0, 0.0);
+    n_out = ddc_run(&cfg, x, n, 0, y);
+    double peak = 0.0;
+    for (int c = 0; c < 2; c++)
+        for (int m = skip; m < n_out; m++)
+            peak = fmax(peak, cabs(y[c][m]) / a0);
+    double reject_db = peak > 0.0 ? 20.0 * log10(peak) : DB_FLOOR;
+    failed += report("DDC out-of-band tone", reject_db, "dB", n_out > skip && reject_db < DDC_CHECK_REJECT_DB);
+
+cleanup:
+    for (int c = 0; c < 2; c++) {
+        free(x[c]);
+        free(y[c]);
+        free(z[c]);
+    }
+    return failed;
+}
+
+// Output m is up * sum_k h[k] u[m down - k], u the input with up - 1 zeros
+// after every sample
+static void resample_direct(const FIRFilter *h, int up, int down, const double *x, int n, double *y, int n_out) {
+    for (int m = 0; m < n_out; m++) {
+        long long t = (long long)m * down;
+        double sum = 0.0;
+        for (int k = 0; k < h->num_taps && k <= t; k++)
+            if ((t - k) % up == 0 && (t - k) / up < n)
+                sum += h->taps[k] * x[(t - k) / up];
+        y[m] = up * sum;
+    }
+}
+
+// Random prototype against the definition, then in blocks
+static int check_resample_ratio(int up, int down) {
+    static FIRFilter proto;
+    proto.num_taps = 8 * (up > down ? up : down) + 1;
+    srand(up * 1000 + down);
+    for (int k = 0; k < proto.num_taps; k++)
+        proto.taps[k] = rand() / (double)RAND_MAX - 0.5;
+
+    int n = 9001;                       // more than one internal block
+    Resampler r;
+    if (resampler_init(&r, up, down, &proto) != 0)
+        return 1;
+    int capacity = resampler_max_output(&r, n);
+    double *x = (double*)malloc(n * sizeof(double));
+    double *y = (double*)malloc(capacity * sizeof(double));
+    double *ref = (double*)malloc(capacity * sizeof(double));
+    double *blk = (double*)malloc(capacity * sizeof(double));
+    int failed = 0;
+    if (!x || !y || !ref || !blk) {
+        failed = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < n; i++)
+        x[i] = rand() / (double)RAND_MAX - 0.5;
+
+    int n_out = resampler_process(&r, x, n, y);
+    resample_direct(&proto, up, down, x, n, ref, capacity);
+    double err = 0.0, peak = 0.0;
+    for (int m = 0; m < n_out; m++) {
+        err = fmax(err, fabs(y[m] - ref[m]));
+        peak = fmax(peak, fabs(ref[m]));
+    }
+    err = peak > 0.0 ? err / peak : err;
+    char what[64];
+    snprintf(what, sizeof(what), "resample %d/%d against definition", up, down);
+    failed += report(what, err, "", n_out == capacity && err < RESAMPLE_CHECK_TOL);
+
+    // Blocks of 1, 2, 3, ... samples must not change a single bit
+    resampler_reset(&r);
+    int n_blk = 0, len = 1;
+    for (int i0 = 0; i0 < n && n_blk >= 0; i0 += len, len++) {
+        if (len > n - i0)
+            len = n - i0;
+        int got = resampler_process(&r, x + i0, len, blk + n_blk);
+        n_blk = got < 0 ? -1 : n_blk + got;
+    }
+    int same = n_blk == n_out && memcmp(blk, y, n_out * sizeof(double)) == 0;
+    snprintf(what, sizeof(what), "resample %d/%d in growing blocks", up, down);
+    failed += report(what, n_blk, "out", same);
+
+cleanup:
+    resampler_free(&r);
+    free(x);
+    free(y);
+    free(ref);
+    free(blk);
+    return failed;
+}
+
+// Designed prototype through capture_resample: a 3 kHz tone must come out
+// at unit gain on the output time axis, a tone above the new Nyquist rate
+// must not come out at all
+static int check_resample_tone(int up, int down, double f, int pass) {
+    static FIRFilter proto;
+    if (resampler_design(CHECK_FS, up, down, 5000.0, 0.5, 60.0, &proto) != 0)
+        return 1;
+    Capture in, out;
+    memset(&out, 0, sizeof(out));
+    if (capture_init(&in, 1, 16000, 0) != 0)
+        return 1;
+    in.fs = CHECK_FS;
+    in.t0 = 0.0;
+    check_tone(in.ch[0], in.n_samples, f, 1.0, 0.0);
+
+    int failed = 0;
+    if (capture_resample(&in, up, down, &proto, &out) != 0 || out.fs != CHECK_FS * up / down) {
+        failed = 1;
+        goto cleanup;
+    }
+
+    // Away from both ends, where the filter sees the whole tone
+    int edge = (int)ceil(proto.num_taps / (double)up * out.fs / CHECK_FS) + 1;
+    double err = 0.0, peak = 0.0;
+    for (int m = edge; m < out.n_samples - edge; m++) {
+        double t = out.t0 + m / out.fs;
+        err = fmax(err, fabs(out.ch[0][m] - cos(2.0 * M_PI * f * t)));
+        peak = fmax(peak, fabs(out.ch[0][m]));
+    }
+    char what[64];
+    if (pass) {
+        snprintf(what, sizeof(what), "resample %d/%d %.0f Hz tone error", up, down, f);
+        failed += report(what, err, "", out.n_samples > 2 * edge && err < RESAMPLE_CHECK_GAIN_TOL);
+    } else {
+        double reject_db = peak > 0.0 ? 20.0 * log10(peak) : DB_FLOOR;
+        snprintf(what, sizeof(what), "resample %d/%d %.0f Hz tone", up, down, f);
+        failed += report(what, reject_db, "dB", out.n_samples > 2 * edge && reject_db < RESAMPLE_CHECK_REJECT_DB);
+    }
+
+cleanup:
+    capture_free(&in);
+    capture_free(&out);
+    return failed;
+}
+
+static int check_resample(void) {
+    int failed = 0;
+    int n_ratios = sizeof(resample_ratios) / sizeof(resample_ratios[0]);
+    for (int k = 0; k < n_ratios; k++)
+        failed += check_resample_ratio(resample_ratios[k][0], resample_ratios[k][1]);
+    failed += check_resample_tone(3, 2, 3000.0, 1);
+    failed += check_resample_tone(1, 4, 3000.0, 1);
+    failed += check_resample_tone(1, 4, 12000.0, 0);
+    return failed;
+}
+
+#define LOCKIN_CHECK_DB_TOL 0.02
+#define LOCKIN_CHECK_DEG_TOL 0.2        // what is left of the 2 f_ref image
+#define LOCKIN_CHECK_BLOCK_TOL 1e-12
+
+// ch1 = ratio * ch0 shifted by phase_deg, and the bearing that makes
+typedef struct {
+    double ratio;
+    double phase_deg;
+    double bearing_deg;
+} LockInCase;
+
+static const LockInCase lockin_cases[] = {
+    { 0.5, 0.0, 26.5651 },
+    { 2.0, 180.0, -63.4349 },
+    { 1.0, 40.0, 45.0 },
+    { 0.1, -30.0, 4.9592 },
+};
+
+static double wrap_deg(double d) {
+    return d - 360.0 * floor((d + 180.0) / 360.0);
+}
+
+// The whole signal in blocks of block samples (0 for one go)
+static int lockin_run(const LockInConfig *cfg, const double *x0, const double *x1, int n, int block,
+                      LockInOutput *out, int max_out) {
+    LockIn li;
+    if (lockin_init(&li, cfg) != 0)
+        return -1;
+    int n_out = 0;
+    if (block <= 0)
+        block = n;
+    for (int i0 = 0; i0 < n; i0 += block) {
+        int len = n - i0 < block ? n - i0 : block;
+        int got = lockin_process(&li, x0 + i0, x1 + i0, NULL, len, out + n_out, max_out - n_out);
+        if (got < 0)
+            return -1;
+        n_out += got;
+    }
+    return n_out;
+}
+
+static int check_lockin(void) {
+    LockInConfig cfg = { CHECK_FS, CHECK_CARRIER_HZ, 20.0, 2, 100.0 };
+    int n = CHECK_SAMPLES, max_out = 2 * (int)(n * cfg.update_hz / CHECK_FS) + 2;
+    double *x[2] = { (double*)malloc(n * sizeof(double)), (double*)malloc(n * sizeof(double)) };
+    LockInOutput *out = (LockInOutput*)malloc(2 * max_out * sizeof(LockInOutput));
+    int failed = 0;
+    if (!x[0] || !x[1] || !out) {
+        failed = 1;
+        goto cleanup;
+    }
+
+    double a0 = 1e-3;
+    int n_cases = sizeof(lockin_cases) / sizeof(lockin_cases[0]);
+    for (int k = 0; k < n_cases; k++) {
+        const LockInCase *c = &lockin_cases[k];
+        check_tone(x[0], n, CHECK_CARRIER_HZ, a0, 0.3);
+        check_tone(x[1], n, CHECK_CARRIER_HZ, a0 * c->ratio, 0.3 + c->phase_deg * M_PI / 180.0);
+        int n_out = lockin_run(&cfg, x[0], x[1], n, 0, out, max_out);
+
+        // Every settled reading, worst of each
+        double db_err = 0.0, phase_err = 0.0, bearing_err = 0.0, amp_err = 0.0;
+        int n_settled = 0;
+        for (int m = 0; m < n_out; m++) {
+            if (!out[m].settled)
+                continue;
+            n_settled++;
+            db_err = fmax(db_err, fabs(out[m].ratio_db - 20.0 * log10(c->ratio)));
+            phase_err = fmax(phase_err, fabs(wrap_deg(out[m].phase_deg - c->phase_deg)));
+            bearing_err = fmax(bearing_err, fabs(wrap_deg(2.0 * (out[m].bearing_deg - c->bearing_deg)) / 2.0));
+            amp_err = fmax(amp_err, fabs(cabs(out[m].z[0]) - a0) / a0);
+        }
+        int ok = n_settled > 0 && db_err < LOCKIN_CHECK_DB_TOL && phase_err < LOCKIN_CHECK_DEG_TOL
+              && bearing_err < LOCKIN_CHECK_DEG_TOL && amp_err < 0.01;
+        char what[64];
+        snprintf(what, sizeof(what), "lock-in %.1f at %.0f deg, bearing error", c->ratio, c->phase_deg);
+        failed += report(what, bearing_err, "deg", ok);
+        if (!ok)
+            printf("  %d settled readings: ratio error %.3g dB, phase error %.3g deg, |CH 0| error %.3g\n",
+                   n_settled, db_err, phase_err, amp_err);
+
+        // In blocks that do not line up with the readings
+        LockInOutput *blk = out + max_out;
+        int n_blk = lockin_run(&cfg, x[0], x[1], n, 997, blk, max_out);
+        double err = 0.0;
+        for (int m = 0; m < n_out && m < n_blk; m++)
+            for (int ch = 0; ch < 2; ch++)
+                err = fmax(err, cabs(blk[m].z[ch] - out[m].z[ch]) / a0);
+        snprintf(what, sizeof(what), "lock-in %.1f at %.0f deg in blocks", c->ratio, c->phase_deg);
+        failed += report(what, err, "", n_blk == n_out && err < LOCKIN_CHECK_BLOCK_TOL);
+    }
+
+cleanup:
+    free(x[0]);
+    free(x[1]);
+    free(out);
+    return failed;
+}
+
+int main(void) {
+    int failed = check_ddc();
+    failed += check_resample();
+    failed += check_lockin();
+
+    arena_free(scratch_arena());
+    window_cache_free();
+    fir_design_cache_free();
+    printf("%s\n", failed ? "Baseband check failed." : "Baseband check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
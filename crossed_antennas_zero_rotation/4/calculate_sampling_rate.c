@@ -1,5 +1,29 @@
 #include "includes.h"
 
+// Sampling rate and accuracy from n timestamps spaced stride doubles apart,
+// by a least-squares fit over all of them
+static int sampling_rate_from_times(const double *times, size_t stride, int n_samples,
+                                    double *sampling_rate, double *accuracy_percent) {
+    TimebaseEstimator tb;
+    Timebase fit;
+    timebase_init(&tb);
+    timebase_push(&tb, times, stride, n_samples);
+    if (timebase_fit(&tb, &fit) != 0) {
+        fprintf(stderr, "Timestamps do not advance.\n");
+        return -1;
+    }
+
+    *sampling_rate = fit.fs;
+    *accuracy_percent = fit.accuracy_percent;
+
+    // Debug output
+    printf("Calculated average sampling interval: %lf seconds\n", 1.0 / fit.fs);
+    printf("Sampling rate: %lf Hz\n", *sampling_rate);
+    printf("Accuracy: ±%lf%%\n", *accuracy_percent);
+
+    return 0;
+}
+
 // Function to calculate sampling rate and accuracy
 int calculate_sampling_rate(const DataSample *samples, int n_samples, double *sampling_rate, double *accuracy_percent) {
     if (n_samples < 2 || !samples || !sampling_rate || !accuracy_percent) {
@@ -7,33 +31,26 @@ int calculate_sampling_rate(const DataSample *samples, int n_samples, double *sa
         return -1;
     }
 
-    double total_diff = 0.0;
-    double max_diff = -1e9;
-    double min_diff = 1e9;
+    return sampling_rate_from_times(&samples[0].time, sizeof(DataSample) / sizeof(double),
+                                    n_samples, sampling_rate, accuracy_percent);
+}
 
-    // Calculate differences between consecutive timestamps
-    for (int i = 1; i < n_samples; i++) {
-        double diff = samples[i].time - samples[i - 1].time;
-        total_diff += diff;
-        if (diff > max_diff) max_diff = diff;
-        if (diff < min_diff) min_diff = diff;
+// Captures with an implicit time base are exact by construction
+int calculate_sampling_rate_capture(const Capture *cap, double *sampling_rate, double *accuracy_percent) {
+    if (!cap || cap->n_samples < 2 || !sampling_rate || !accuracy_percent) {
+        fprintf(stderr, "Insufficient data samples provided.\n");
+        return -1;
     }
 
-    // Average sampling interval
-    double avg_interval = total_diff / (n_samples - 1);
-
-    // Derived sampling rate
-    *sampling_rate = 1.0 / avg_interval;
-
-    // Calculate accuracy as percent deviation of intervals from average interval
-    double max_deviation = fmax(fabs(max_diff - avg_interval), fabs(min_diff - avg_interval));
-    *accuracy_percent = (max_deviation / avg_interval) * 100.0;
-
-    // Debug output
-    printf("Calculated average sampling interval: %lf seconds\n", avg_interval);
-    printf("Sampling rate: %lf Hz\n", *sampling_rate);
-    printf("Accuracy: ±%lf%%\n", *accuracy_percent);
+    if (!cap->time) {
+        if (cap->fs <= 0.0) {
+            fprintf(stderr, "Capture has no time base.\n");
+            return -1;
+        }
+        *sampling_rate = cap->fs;
+        *accuracy_percent = 0.0;
+        return 0;
+    }
 
-    return 0;
+    return sampling_rate_from_times(cap->time, 1, cap->n_samples, sampling_rate, accuracy_percent);
 }
-
@@ -0,0 +1,189 @@
+#include "includes.h"
+#include <sys/mman.h>
+
+// Channel-planar capture buffers.
+// Each channel is its own 64-byte aligned array of doubles, so per-channel
+// kernels run over unit-stride memory and never load timestamps. The time
+// axis is either implicit (t0 + i / fs) or a separate array. Captures loaded
+// from .cml files may instead point into a private file mapping (cap->map),
+// which capture_free unmaps and capture_reserve moves to the heap.
+
+static double *capture_alloc_plane(int n_samples, int zero) {
+    size_t bytes = (size_t)(n_samples > 0 ? n_samples : 1) * sizeof(double);
+    bytes = (bytes + CAPTURE_ALIGN - 1) / CAPTURE_ALIGN * CAPTURE_ALIGN;
+    double *plane = (double*)aligned_alloc(CAPTURE_ALIGN, bytes);
+    if (plane && zero)
+        memset(plane, 0, bytes);
+    return plane;
+}
+
+// Allocate a zeroed capture; with_time adds an explicit timestamp array
+int capture_init(Capture *cap, int n_channels, int n_samples, int with_time) {
+    if (!cap || n_channels <= 0 || n_channels > CAPTURE_MAX_CHANNELS || n_samples < 0) {
+        fprintf(stderr, "Invalid capture parameters.\n");
+        return -1;
+    }
+
+    memset(cap, 0, sizeof(*cap));
+    cap->n_channels = n_channels;
+    cap->n_samples = n_samples;
+    cap->capacity = n_samples;
+
+    for (int c = 0; c < n_channels; c++) {
+        cap->ch[c] = capture_alloc_plane(n_samples, 1);
+        if (!cap->ch[c]) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            capture_free(cap);
+            return -1;
+        }
+    }
+
+    if (with_time) {
+        cap->time = capture_alloc_plane(n_samples, 1);
+        if (!cap->time) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            capture_free(cap);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void capture_free(Capture *cap) {
+    if (!cap)
+        return;
+    if (cap->map) {
+        munmap(cap->map, cap->map_size);
+    } else {
+        for (int c = 0; c < CAPTURE_MAX_CHANNELS; c++)
+            free(cap->ch[c]);
+        free(cap->time);
+    }
+    memset(cap, 0, sizeof(*cap));
+}
+
+// Move a plane into a larger aligned allocation; the new space past
+// n_used is left uninitialized for the caller to fill
+static int capture_grow_plane(double **plane, int n_used, int capacity) {
+    double *grown = capture_alloc_plane(capacity, 0);
+    if (!grown)
+        return -1;
+    if (*plane)
+        memcpy(grown, *plane, (size_t)n_used * sizeof(double));
+    free(*plane);
+    *plane = grown;
+    return 0;
+}
+
+// Make room for at least capacity samples, keeping the current contents
+int capture_reserve(Capture *cap, int capacity) {
+    if (capacity <= cap->capacity)
+        return 0;
+
+    // A mapped capture moves to the heap all at once
+    if (cap->map) {
+        Capture grown = *cap;
+        grown.map = NULL;
+        for (int c = 0; c < cap->n_channels; c++)
+            grown.ch[c] = NULL;
+        grown.time = NULL;
+        for (int c = 0; c < cap->n_channels; c++)
+            if (capture_grow_plane(&grown.ch[c], 0, capacity) != 0)
+                goto fail_mapped;
+        if (cap->time && capture_grow_plane(&grown.time, 0, capacity) != 0)
+            goto fail_mapped;
+        for (int c = 0; c < cap->n_channels; c++)
+            memcpy(grown.ch[c], cap->ch[c], (size_t)cap->n_samples * sizeof(double));
+        if (cap->time)
+            memcpy(grown.time, cap->time, (size_t)cap->n_samples * sizeof(double));
+        munmap(cap->map, cap->map_size);
+        grown.map_size = 0;
+        grown.capacity = capacity;
+        *cap = grown;
+        return 0;
+
+fail_mapped:
+        for (int c = 0; c < cap->n_channels; c++)
+            free(grown.ch[c]);
+        free(grown.time);
+        goto fail;
+    }
+
+    for (int c = 0; c < cap->n_channels; c++)
+        if (capture_grow_plane(&cap->ch[c], cap->n_samples, capacity) != 0)
+            goto fail;
+    if (cap->time && capture_grow_plane(&cap->time, cap->n_samples, capacity) != 0)
+        goto fail;
+
+    cap->capacity = capacity;
+    return 0;
+
+fail:
+    fprintf(stderr, "Memory allocation failed growing capture to %d samples.\n", capacity);
+    return -1;
+}
+
+// Append one sample (values for every channel), growing geometrically
+int capture_append(Capture *cap, double time, const double *values) {
+    if (cap->n_samples == cap->capacity) {
+        long long capacity = cap->capacity < 4096 ? 4096 : cap->capacity + cap->capacity / 2LL;
+        if (capacity > INT_MAX)
+            capacity = INT_MAX;
+        if (capacity <= cap->capacity) {
+            fprintf(stderr, "Capture too long.\n");
+            return -1;
+        }
+        if (capture_reserve(cap, (int)capacity) != 0)
+            return -1;
+    }
+
+    int i = cap->n_samples++;
+    if (cap->time)
+        cap->time[i] = time;
+    for (int c = 0; c < cap->n_channels; c++)
+        cap->ch[c][i] = values[c];
+    return 0;
+}
+
+// Timestamp of sample i, explicit or from the implicit time base
+double capture_time(const Capture *cap, int i) {
+    if (cap->time)
+        return cap->time[i];
+    return cap->t0 + (cap->fs > 0.0 ? i / cap->fs : 0.0);
+}
+
+// Two-channel capture with explicit timestamps from a DataSample array
+int capture_from_samples(Capture *cap, const DataSample *data, int n_samples) {
+    if (!data || capture_init(cap, 2, n_samples, 1) != 0)
+        return -1;
+
+    for (int i = 0; i < n_samples; i++) {
+        cap->time[i] = data[i].time;
+        cap->ch[0][i] = data[i].ch0;
+        cap->ch[1][i] = data[i].ch1;
+    }
+
+    if (n_samples > 1 && data[1].time > data[0].time) {
+        cap->t0 = data[0].time;
+        cap->fs = 1.0 / (data[1].time - data[0].time);
+    }
+
+    return 0;
+}
+
+// Fill data[0..n_samples-1] from the first two channels of a capture
+int capture_to_samples(const Capture *cap, DataSample *data) {
+    if (!cap || !data || cap->n_channels < 2) {
+        fprintf(stderr, "Capture needs two channels for DataSample.\n");
+        return -1;
+    }
+
+    for (int i = 0; i < cap->n_samples; i++) {
+        data[i].time = capture_time(cap, i);
+        data[i].ch0 = cap->ch[0][i];
+        data[i].ch1 = cap->ch[1][i];
+    }
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "includes.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary captures (.cml).
+// A fixed CMLHeader is followed by channel-planar float32 or float64 data,
+// every plane starting on a CAPTURE_ALIGN boundary. float64 files are
+// mapped privately and the capture planes point straight into the mapping:
+// loading costs one mmap, pages are read on first access, and in-place
+// processing copies only the pages it writes. float32 files are widened to
+// double on load.
+
+static size_t cml_plane_bytes(uint64_t n_samples, size_t sample_size) {
+    size_t bytes = (size_t)n_samples * sample_size;
+    return (bytes + CAPTURE_ALIGN - 1) / CAPTURE_ALIGN * CAPTURE_ALIGN;
+}
+
+static size_t cml_sample_size(uint32_t type) {
+    return type == CML_FLOAT32 ? sizeof(float) : sizeof(double);
+}
+
+int is_cml_file(const char *filename) {
+    size_t len = strlen(filename);
+    return len > 4 && strcmp(filename + len - 4, ".cml") == 0;
+}
+
+static int cml_write_plane(FILE *file, const double *x, int n, CMLSampleType type) {
+    size_t sample_size = cml_sample_size(type);
+    size_t bytes = (size_t)n * sample_size;
+    size_t padded = cml_plane_bytes(n, sample_size);
+    static const char zeros[CAPTURE_ALIGN];
+
+    if (type == CML_FLOAT64) {
+        if (fwrite(x, sizeof(double), n, file) != (size_t)n)
+            return -1;
+    } else {
+        float buf[1024];
+        for (int i = 0; i < n; i += 1024) {
+            int m = n - i < 1024 ? n - i : 1024;
+            for (int k = 0; k < m; k++)
+                buf[k] = (float)x[i + k];
+            if (fwrite(buf, sizeof(float), m, file) != (size_t)m)
+                return -1;
+        }
+    }
+    if (padded > bytes && fwrite(zeros, 1, padded - bytes, file) != padded - bytes)
+        return -1;
+    return 0;
+}
+
+// Channels are written as type; the time plane, if the capture has one,
+// always as float64. units[c] names channel c's unit, NULL for "V".
+int write_cml_capture(const char *filename, const Capture *cap, CMLSampleType type,
+                      const char *const *units) {
+    if (!filename || !cap || cap->n_channels <= 0 || (type != CML_FLOAT32 && type != CML_FLOAT64)) {
+        fprintf(stderr, "Invalid arguments for write_cml_capture.\n");
+        return -1;
+    }
+
+    CMLHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CML_MAGIC, 4);
+    header.byte_order = CML_BYTE_ORDER;
+    header.version = CML_VERSION;
+    header.header_size = CML_HEADER_SIZE;
+    header.n_channels = cap->n_channels;
+    header.sample_type = type;
+    header.flags = cap->time ? CML_FLAG_TIME : 0;
+    header.n_samples = cap->n_samples;
+    header.fs = cap->fs;
+    header.t0 = cap->t0;
+    strncpy(header.time_units, "s", CML_UNIT_LEN - 1);
+    for (int c = 0; c < cap->n_channels; c++)
+        strncpy(header.units[c], units && units[c] ? units[c] : "V", CML_UNIT_LEN - 1);
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) { perror("fopen"); return -1; }
+
+    char block[CML_HEADER_SIZE] = {0};
+    memcpy(block, &header, sizeof(header));
+    int rv = 0;
+    if (fwrite(block, 1, sizeof(block), file) != sizeof(block))
+        rv = -1;
+    if (!rv && cap->time)
+        rv = cml_write_plane(file, cap->time, cap->n_samples, CML_FLOAT64);
+    for (int c = 0; !rv && c < cap->n_channels; c++)
+        rv = cml_write_plane(file, cap->ch[c], cap->n_samples, type);
+    if (fclose(file) != 0)
+        rv = -1;
+
+    if (rv)
+        fprintf(stderr, "Error writing %s.\n", filename);
+    return rv;
+}
+
+static int cml_check_header(const char *filename, const CMLHeader *header, size_t file_size) {
+    const char *why = NULL;
+    if (memcmp(header->magic, CML_MAGIC, 4) != 0)
+        why = "not a .cml file";
+    else if (header->byte_order != CML_BYTE_ORDER)
+        why = "written with the other byte order";
+    else if (header->version != CML_VERSION)
+        why = "unsupported version";
+    else if (header->header_size < sizeof(CMLHeader) || header->header_size % CAPTURE_ALIGN)
+        why = "bad header size";
+    else if (header->n_channels == 0 || header->n_channels > CAPTURE_MAX_CHANNELS)
+        why = "bad channel count";
+    else if (header->sample_type != CML_FLOAT32 && header->sample_type != CML_FLOAT64)
+        why = "unknown sample type";
+    else if (header->n_samples > INT_MAX)
+        why = "too many samples";
+    else if (!(header->flags & CML_FLAG_TIME) && header->n_samples > 1 && !(header->fs > 0.0))
+        why = "no time base";
+
+    if (!why) {
+        size_t need = header->header_size
+                    + header->n_channels * cml_plane_bytes(header->n_samples, cml_sample_size(header->sample_type));
+        if (header->flags & CML_FLAG_TIME)
+            need += cml_plane_bytes(header->n_samples, sizeof(double));
+        if (file_size < need)
+            why = "file is truncated";
+    }
+
+    if (why) {
+        fprintf(stderr, "%s: %s.\n", filename, why);
+        return -1;
+    }
+    return 0;
+}
+
+// Load a .cml file into cap; header receives the file header if not NULL
+int read_cml_capture(const char *filename, Capture *cap, CMLHeader *header) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { perror("open"); return -1; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CMLHeader)) {
+        fprintf(stderr, "%s: not a .cml file.\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    // Private writable mapping: the file is never modified
+    char *map = (char*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return -1; }
+
+    CMLHeader h;
+    memcpy(&h, map, sizeof(h));
+    if (cml_check_header(filename, &h, st.st_size) != 0) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    if (header)
+        *header = h;
+
+    int n = (int)h.n_samples;
+    char *plane = map + h.header_size;
+    size_t plane_bytes = cml_plane_bytes(h.n_samples, cml_sample_size(h.sample_type));
+
+    memset(cap, 0, sizeof(*cap));
+    cap->n_channels = h.n_channels;
+    cap->n_samples = n;
+    cap->capacity = n;
+    cap->fs = h.fs;
+    cap->t0 = h.t0;
+
+    if (h.sample_type == CML_FLOAT64) {
+        cap->map = map;
+        cap->map_size = st.st_size;
+        if (h.flags & CML_FLAG_TIME) {
+            cap->time = (double*)plane;
+            plane += cml_plane_bytes(h.n_samples, sizeof(double));
+        }
+        for (int c = 0; c < cap->n_channels; c++, plane += plane_bytes)
+            cap->ch[c] = (double*)plane;
+        return 0;
+    }
+
+    // float32 is widened into heap planes
+    if (capture_init(cap, h.n_channels, n, (h.flags & CML_FLAG_TIME) != 0) != 0) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    cap->fs = h.fs;
+    cap->t0 = h.t0;
+    if (h.flags & CML_FLAG_TIME) {
+        memcpy(cap->time, plane, (size_t)n * sizeof(double));
+        plane += cml_plane_bytes(h.n_samples, sizeof(double));
+    }
+    for (int c = 0; c < cap->n_channels; c++, plane += plane_bytes) {
+        const float *x = (const float*)plane;
+        for (int i = 0; i < n; i++)
+            cap->ch[c][i] = x[i];
+    }
+    munmap(map, st.st_size);
+    return 0;
+}
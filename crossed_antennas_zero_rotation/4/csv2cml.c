@@ -0,0 +1,111 @@
+#include "includes.h"
+#include <sys/stat.h>
+
+// csv2cml: convert a scope CSV export to a binary .cml capture.
+// Timestamps that sit on the least-squares grid are replaced by t0 and fs;
+// otherwise they are kept as a plane. The tolerance, in sample periods,
+// allows for the few digits the scope prints (1 us steps at 64 kHz are 0.064
+// periods) while still catching a dropped or repeated sample.
+
+#define CML_TIME_TOL 0.25
+
+// Unit in parentheses in a header field, e.g. "Voltage (V) - CH 0" -> "V"
+static void header_unit(const char *field, char *unit) {
+    const char *open = strchr(field, '(');
+    const char *close = open ? strchr(open, ')') : NULL;
+    if (!open || !close || close - open - 1 <= 0 || close - open - 1 >= CML_UNIT_LEN) {
+        strcpy(unit, "V");
+        return;
+    }
+    memcpy(unit, open + 1, close - open - 1);
+    unit[close - open - 1] = '\0';
+}
+
+static void read_units(const char *filename, char units[][CML_UNIT_LEN], int n_channels) {
+    char line[LINE_SIZE] = "";
+    FILE *file = fopen(filename, "r");
+    if (file) {
+        if (!fgets(line, sizeof(line), file))
+            line[0] = '\0';
+        fclose(file);
+    }
+
+    char *rest = line, *field;
+    strtok_r(rest, ",\r\n", &rest);  // time column
+    for (int c = 0; c < n_channels; c++) {
+        field = strtok_r(rest, ",\r\n", &rest);
+        header_unit(field ? field : "", units[c]);
+    }
+}
+
+// Largest distance of a timestamp from the grid t0 + i / fs, in periods
+static double grid_residual(const Capture *cap) {
+    double worst = 0.0;
+    for (int i = 0; i < cap->n_samples; i++)
+        worst = fmax(worst, fabs(cap->time[i] - (cap->t0 + i / cap->fs)));
+    return worst * cap->fs;
+}
+
+static long long file_size(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+int main(int argc, char **argv) {
+    CMLSampleType type = CML_FLOAT64;
+    int keep_time = 0;
+    int a = 1;
+    for (; a < argc && argv[a][0] == '-'; a++) {
+        if (strcmp(argv[a], "-f") == 0) type = CML_FLOAT32;
+        else if (strcmp(argv[a], "-t") == 0) keep_time = 1;
+        else break;
+    }
+    if (argc - a != 2) {
+        fprintf(stderr, "Usage: %s [-f] [-t] <data_file.csv> <capture.cml>\n"
+                        "  -f  store channels as float32 (default float64)\n"
+                        "  -t  always keep the timestamps\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *in = argv[a], *out = argv[a + 1];
+
+    Capture cap = {0};
+    if (!read_csv_capture(in, &cap)) {
+        fprintf(stderr, "Error reading CSV file.\n");
+        return EXIT_FAILURE;
+    }
+    if (cap.n_samples == 0) {
+        fprintf(stderr, "No valid samples found.\n");
+        capture_free(&cap);
+        return EXIT_FAILURE;
+    }
+
+    // read_csv_capture leaves the least-squares grid in t0 and fs
+    int n = cap.n_samples;
+    double residual = cap.fs > 0.0 ? grid_residual(&cap) : INFINITY;
+    int explicit_time = keep_time || residual > CML_TIME_TOL;
+    double *time = cap.time;
+    if (!explicit_time)
+        cap.time = NULL;
+
+    char units[CAPTURE_MAX_CHANNELS][CML_UNIT_LEN];
+    const char *unit_names[CAPTURE_MAX_CHANNELS];
+    read_units(in, units, cap.n_channels);
+    for (int c = 0; c < cap.n_channels; c++)
+        unit_names[c] = units[c];
+
+    int rv = write_cml_capture(out, &cap, type, unit_names);
+    cap.time = time;
+
+    if (rv == 0) {
+        long long in_size = file_size(in), out_size = file_size(out);
+        printf("%s: %d samples, %d channels, %s, %s time (fs = %lf Hz, grid residual %lg periods)\n",
+               out, n, cap.n_channels, type == CML_FLOAT32 ? "float32" : "float64",
+               explicit_time ? "explicit" : "implicit",
+               cap.fs, residual);
+        printf("%lld -> %lld bytes (%.2fx smaller)\n", in_size, out_size,
+               out_size > 0 ? (double)in_size / out_size : 0.0);
+    }
+
+    capture_free(&cap);
+    return rv == 0 ? 0 : EXIT_FAILURE;
+}
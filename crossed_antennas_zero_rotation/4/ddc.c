@@ -0,0 +1,302 @@
+#include "includes.h"
+
+// Digital downconversion to complex baseband.
+// The signal of interest is a few hundred Hz around the carrier, so it is
+// mixed to 0 Hz and the rate brought down before any further analysis.
+// The NCO is a 64-bit phase accumulator; within a block of NCO_BLOCK
+// samples the mixer rotates a unit phasor and re-anchors it from the
+// accumulator at the start of the next, so the phase never drifts. Mixing
+// doubles the samples, so a real sinusoid of amplitude A comes out as a
+// phasor of magnitude A. Decimation by 2 runs through half-band filters,
+// in which every other tap is zero, for as long as the band is narrow
+// against the rate; the rest goes through one decimating FIR designed to
+// keep the band free of aliases, which only computes the outputs that are
+// kept (the polyphase form). Every filter is symmetric, so each pair of
+// taps costs one multiply per output.
+
+#define NCO_BLOCK 256
+#define DDC_BLOCK 4096
+#define DDC_MAX_HALFBAND_TAPS 127
+
+// Kaiser half-band by 2 for a band of +-edge Hz at rate fs: the lowpass
+// with its transition centred on fs / 4, 4k + 3 taps long so the
+// outermost ones are not zero. NULL if it would be too long.
+static double *ddc_halfband(double fs, double edge, double ripple_db, double atten_db, int *n_taps) {
+    FIRSpec spec = { fs, 0.0, edge, fs / 2.0 - 2.0 * edge, ripple_db, atten_db };
+    int n = fir_kaiser_length(&spec);
+    if (n < 0)
+        return NULL;
+    n = n / 4 * 4 + 3;                  // odd n up to the next 4k + 3
+    if (n > DDC_MAX_HALFBAND_TAPS)
+        return NULL;
+
+    FIRFilter *fir = (FIRFilter*)malloc(sizeof(FIRFilter));
+    double *taps = (double*)malloc(n * sizeof(double));
+    if (!fir || !taps || design_fir_kaiser(&spec, n, fir) != 0) {
+        free(fir);
+        free(taps);
+        return NULL;
+    }
+    // Unit gain at 0 Hz, and the even offsets exactly zero
+    int M = (n - 1) / 2;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        taps[i] = (i != M && ((i - M) & 1) == 0) ? 0.0 : fir->taps[i];
+        sum += taps[i];
+    }
+    for (int i = 0; i < n; i++)
+        taps[i] /= sum;
+    free(fir);
+    *n_taps = n;
+    return taps;
+}
+
+void ddc_free(DDC *ddc) {
+    for (int s = 0; s < ddc->n_stages; s++) {
+        free(ddc->stage[s].taps);
+        for (int c = 0; c < ddc->n_channels; c++)
+            free(ddc->stage[s].hist[c]);
+    }
+    memset(ddc, 0, sizeof(*ddc));
+}
+
+void ddc_reset(DDC *ddc) {
+    ddc->phase = 0;
+    for (int s = 0; s < ddc->n_stages; s++) {
+        DDCStage *st = &ddc->stage[s];
+        st->skip = 0;
+        for (int c = 0; c < ddc->n_channels; c++)
+            memset(st->hist[c], 0, (st->n_taps - 1) * sizeof(double complex));
+    }
+}
+
+static int ddc_add_stage(DDC *ddc, int factor, int halfband, double *taps, int n_taps) {
+    if (!taps || ddc->n_stages == DDC_MAX_STAGES) {
+        free(taps);
+        return -1;
+    }
+    DDCStage *st = &ddc->stage[ddc->n_stages++];
+    st->factor = factor;
+    st->halfband = halfband;
+    st->taps = taps;
+    st->n_taps = n_taps;
+    for (int c = 0; c < ddc->n_channels; c++) {
+        st->hist[c] = (double complex*)calloc(n_taps, sizeof(double complex));
+        if (!st->hist[c])
+            return -1;
+    }
+    return 0;
+}
+
+int ddc_init(DDC *ddc, const DDCConfig *cfg, int n_channels) {
+    memset(ddc, 0, sizeof(*ddc));
+    if (!cfg || n_channels < 1 || n_channels > CAPTURE_MAX_CHANNELS || cfg->fs <= 0.0
+        || cfg->fs_out <= cfg->bandwidth || cfg->bandwidth <= 0.0 || cfg->fs_out > cfg->fs) {
+        fprintf(stderr, "Invalid downconverter parameters.\n");
+        return -1;
+    }
+    double ratio = cfg->fs / cfg->fs_out;
+    int decimation = (int)llround(ratio);
+    if (fabs(ratio - decimation) > 1e-6 * ratio) {
+        fprintf(stderr, "Downconverter output rate must divide %lf Hz.\n", cfg->fs);
+        return -1;
+    }
+
+    ddc->cfg = *cfg;
+    ddc->n_channels = n_channels;
+    ddc->decimation = decimation;
+    double turns = fmod(cfg->f_center / cfg->fs, 1.0);
+    if (turns < 0.0)
+        turns += 1.0;
+    ddc->step = (uint64_t)ldexp(turns, 64);
+
+    // Half-bands while the band edge is below an eighth of the stage rate
+    double edge = cfg->bandwidth / 2.0;
+    double fs = cfg->fs;
+    int rest = decimation;
+    while (rest % 2 == 0 && edge <= fs / 8.0) {
+        int n_taps;
+        double *taps = ddc_halfband(fs, edge, cfg->ripple_db, cfg->atten_db, &n_taps);
+        if (!taps)
+            break;
+        if (ddc_add_stage(ddc, 2, 1, taps, n_taps) != 0)
+            goto fail;
+        ddc->delay += (n_taps - 1) / 2.0 * (cfg->fs / fs);
+        fs /= 2.0;
+        rest /= 2;
+    }
+
+    // The rest: passband +-edge, aliases kept out of it
+    FIRSpec spec = { fs, 0.0, edge, cfg->fs_out - 2.0 * edge, cfg->ripple_db, cfg->atten_db };
+    FIRFilter *fir = (FIRFilter*)malloc(sizeof(FIRFilter));
+    if (!fir || design_fir_min(&spec, FIR_DESIGN_AUTO, MAX_FIR_TAPS, fir) != 0) {
+        free(fir);
+        goto fail;
+    }
+    double *taps = (double*)malloc(fir->num_taps * sizeof(double));
+    int n_taps = fir->num_taps;
+    if (taps)
+        memcpy(taps, fir->taps, n_taps * sizeof(double));
+    free(fir);
+    if (ddc_add_stage(ddc, rest, 0, taps, n_taps) != 0)
+        goto fail;
+    ddc->delay += (n_taps - 1) / 2.0 * (cfg->fs / fs);
+    return 0;
+
+fail:
+    fprintf(stderr, "Downconverter setup failed.\n");
+    ddc_free(ddc);
+    return -1;
+}
+
+// Mix one block of every channel down by the NCO, into y
+static void ddc_mix(DDC *ddc, const double *const *x, int offset, int n, double complex *const *y) {
+    uint64_t phase = ddc->phase;
+    double complex inc = cexp(-2.0 * M_PI * I * ldexp((double)ddc->step, -64));
+    for (int i0 = 0; i0 < n; i0 += NCO_BLOCK) {
+        int len = n - i0 < NCO_BLOCK ? n - i0 : NCO_BLOCK;
+        double complex start = 2.0 * cexp(-2.0 * M_PI * I * ldexp((double)phase, -64));
+        for (int c = 0; c < ddc->n_channels; c++) {
+            const double *in = x[c] + offset + i0;
+            double complex *out = y[c] + i0;
+            double complex rot = start;
+            for (int i = 0; i < len; i++) {
+                out[i] = in[i] * rot;
+                rot *= inc;
+            }
+        }
+        phase += ddc->step * (uint64_t)len;
+    }
+    ddc->phase = phase;
+}
+
+// Outputs of one stage over n inputs; w holds the last n_taps - 1 inputs
+// followed by the new ones, and output j filters w[j .. j + n_taps).
+// Returns the number of outputs.
+static int ddc_stage_run(const DDCStage *st, double complex *w, int n, double complex *out) {
+    int L = st->n_taps, M = (L - 1) / 2;
+    const double *h = st->taps;
+    int n_out = 0;
+    for (int j = st->skip; j < n; j += st->factor) {
+        const double complex *x = w + j;
+        double complex sum = h[M] * x[M];
+        if (st->halfband) {
+            for (int k = 1; k <= M; k += 2)
+                sum += h[M - k] * (x[M - k] + x[M + k]);
+        } else {
+            for (int k = 0; k < M; k++)
+                sum += h[k] * (x[k] + x[L - 1 - k]);
+        }
+        out[n_out++] = sum;
+    }
+    return n_out;
+}
+
+// Filter and decimate n samples of every channel. out needs room for
+// n / decimation + 1 samples per channel; returns how many were written.
+int ddc_process(DDC *ddc, const double *const *x, int n, double complex *const *out) {
+    if (!ddc || !x || !out || n < 0) {
+        fprintf(stderr, "Invalid arguments for ddc_process.\n");
+        return -1;
+    }
+
+    int max_taps = 0;
+    for (int s = 0; s < ddc->n_stages; s++)
+        if (ddc->stage[s].n_taps > max_taps)
+            max_taps = ddc->stage[s].n_taps;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *blk[CAPTURE_MAX_CHANNELS];
+    double complex *win = (double complex*)arena_alloc(arena, (DDC_BLOCK + max_taps) * sizeof(double complex));
+    int ok = win != NULL;
+    for (int c = 0; c < ddc->n_channels && ok; c++) {
+        blk[c] = (double complex*)arena_alloc(arena, DDC_BLOCK * sizeof(double complex));
+        ok = blk[c] != NULL;
+    }
+    if (!ok) {
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    int n_out = 0;
+    for (int i0 = 0; i0 < n; i0 += DDC_BLOCK) {
+        int len = n - i0 < DDC_BLOCK ? n - i0 : DDC_BLOCK;
+        ddc_mix(ddc, x, i0, len, blk);
+
+        // Stage by stage, each channel through the same window in place
+        for (int s = 0; s < ddc->n_stages; s++) {
+            DDCStage *st = &ddc->stage[s];
+            int hist = st->n_taps - 1;
+            int len_out = 0;
+            for (int c = 0; c < ddc->n_channels; c++) {
+                memcpy(win, st->hist[c], hist * sizeof(double complex));
+                memcpy(win + hist, blk[c], len * sizeof(double complex));
+                len_out = ddc_stage_run(st, win, len, blk[c]);
+                memcpy(st->hist[c], win + len, hist * sizeof(double complex));
+            }
+            st->skip += len_out * st->factor - len;
+            len = len_out;
+        }
+
+        for (int c = 0; c < ddc->n_channels; c++)
+            memcpy(out[c] + n_out, blk[c], len * sizeof(double complex));
+        n_out += len;
+    }
+
+    arena_release(arena, mark);
+    return n_out;
+}
+
+void ddc_print(const DDC *ddc) {
+    printf("DDC: %.1lf Hz to 0 Hz, %.0lf -> %.1lf Hz (x%d), %.0lf Hz band:",
+           ddc->cfg.f_center, ddc->cfg.fs, ddc->cfg.fs_out, ddc->decimation, ddc->cfg.bandwidth);
+    for (int s = 0; s < ddc->n_stages; s++) {
+        const DDCStage *st = &ddc->stage[s];
+        if (st->halfband)
+            printf(" half-band %d taps /2,", st->n_taps);
+        else
+            printf(" FIR %d taps /%d", st->n_taps, st->factor);
+    }
+    printf(", delay %.1lf samples\n", ddc->delay);
+}
+
+void iq_capture_free(IQCapture *iq) {
+    for (int c = 0; c < iq->n_channels; c++)
+        free(iq->ch[c]);
+    memset(iq, 0, sizeof(*iq));
+}
+
+// Every channel of a capture to baseband at cfg->fs_out
+int capture_downconvert(const Capture *cap, const DDCConfig *cfg, IQCapture *iq) {
+    memset(iq, 0, sizeof(*iq));
+    DDC ddc;
+    if (ddc_init(&ddc, cfg, cap->n_channels) != 0)
+        return -1;
+    ddc_print(&ddc);
+
+    int capacity = cap->n_samples / ddc.decimation + 1;
+    iq->n_channels = cap->n_channels;
+    for (int c = 0; c < cap->n_channels; c++) {
+        iq->ch[c] = (double complex*)malloc(capacity * sizeof(double complex));
+        if (!iq->ch[c]) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            iq_capture_free(iq);
+            ddc_free(&ddc);
+            return -1;
+        }
+    }
+
+    int n = ddc_process(&ddc, (const double *const *)cap->ch, cap->n_samples, iq->ch);
+    if (n < 0) {
+        iq_capture_free(iq);
+        ddc_free(&ddc);
+        return -1;
+    }
+    iq->n_samples = n;
+    iq->fs = cfg->fs_out;
+    iq->t0 = cap->t0 - ddc.delay / cfg->fs;
+    iq->f_center = cfg->f_center;
+    ddc_free(&ddc);
+    return 0;
+}
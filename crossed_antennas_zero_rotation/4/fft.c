@@ -0,0 +1,471 @@
+#include "includes.h"
+
+// Mixed-radix FFT with reusable plans.
+// A plan holds the factorization of n and a table of n twiddle factors, so
+// repeated transforms of the same length only pay for the passes. Each pass
+// is one step of the Stockham autosort decimation in frequency: with the
+// current length l = r m and stride s (l s = n), point q + s j of every
+// r-point group, j < m, becomes
+//     y[q + s (r j + k)] = w_l^(j k) sum_i x[q + s (j + i m)] w_r^(i k)
+// after which the m-point transforms of stride s r follow. The result
+// comes out in natural order, the passes alternate between the output and
+// one scratch buffer, and the inner loop runs over q, contiguous in both.
+// The transform is unnormalized in both directions. Prime radices above
+// FFT_CHIRP_MIN_RADIX go through Bluestein's chirp-z algorithm instead of a
+// plain DFT, so a length like 7 * 1163 costs O(n log n) rather than O(n p).
+
+#define FFT_CHIRP_MIN_RADIX 16          // crossover measured between 17 and 23
+
+// Bluestein tables for one prime radix p. With qk = (q^2 + k^2 - (k - q)^2) / 2
+// the p-point DFT is X[k] = c[k] sum_q x[q] c[q] conj(c[k - q]) for the chirp
+// c[j] = exp(-+i pi j^2 / p): a convolution, done with power-of-2 FFTs of
+// len >= 2p - 1 points.
+struct FFTChirp {
+    int radix;
+    int len;
+    FFTPlan *plan;                      // forward, len points
+    double complex *chirp;              // c[0..radix - 1]
+    double complex *filter;             // FFT of conj(c) wrapped around, over len
+    FFTChirp *next;
+};
+
+// Radices of n: fours, at most one two, then the odd primes in increasing
+// order. Returns their number, -1 if there are too many.
+static int fft_factor(int n, int *radix) {
+    int count = 0;
+    for (int p = 4; n > 1; ) {
+        if (n % p == 0) {
+            if (count >= FFT_MAX_FACTORS)
+                return -1;
+            radix[count++] = p;
+            n /= p;
+            continue;
+        }
+        if (p == 4)
+            p = 2;
+        else if (p == 2)
+            p = 3;
+        else if ((long long)p * p > n)
+            p = n;                      // what is left is prime
+        else
+            p += 2;
+    }
+    return count;
+}
+
+static void fft_chirp_destroy(FFTChirp *ch) {
+    fft_plan_destroy(ch->plan);
+    free(ch->chirp);
+    free(ch->filter);
+    free(ch);
+}
+
+static FFTChirp *fft_chirp_create(int radix, int inverse) {
+    int len = 1;
+    while (len < 2 * radix - 1)
+        len <<= 1;
+
+    FFTChirp *ch = (FFTChirp*)calloc(1, sizeof(FFTChirp));
+    if (!ch)
+        return NULL;
+    ch->radix = radix;
+    ch->len = len;
+    ch->plan = fft_plan_create(len, 0);
+    ch->chirp = (double complex*)malloc(radix * sizeof(double complex));
+    ch->filter = (double complex*)malloc(len * sizeof(double complex));
+    double complex *b = (double complex*)calloc(len, sizeof(double complex));
+    if (!ch->plan || !ch->chirp || !ch->filter || !b) {
+        free(b);
+        fft_chirp_destroy(ch);
+        return NULL;
+    }
+
+    // j^2 mod 2p keeps the phase exact for large j
+    double sign = inverse ? 1.0 : -1.0;
+    for (int j = 0; j < radix; j++) {
+        long long j2 = (long long)j * j % (2 * radix);
+        ch->chirp[j] = cexp(I * (sign * M_PI * j2 / radix));
+    }
+    b[0] = conj(ch->chirp[0]);
+    for (int j = 1; j < radix; j++)
+        b[j] = b[len - j] = conj(ch->chirp[j]);
+
+    int rv = fft_execute(ch->plan, b, ch->filter);
+    free(b);
+    if (rv != 0) {
+        fft_chirp_destroy(ch);
+        return NULL;
+    }
+    for (int j = 0; j < len; j++)
+        ch->filter[j] /= len;
+    return ch;
+}
+
+static const FFTChirp *fft_find_chirp(const FFTPlan *plan, int radix) {
+    const FFTChirp *ch = plan->chirps;
+    while (ch && ch->radix != radix)
+        ch = ch->next;
+    return ch;
+}
+
+FFTPlan *fft_plan_create(int n, int inverse) {
+    if (n <= 0) {
+        fprintf(stderr, "Invalid FFT length %d.\n", n);
+        return NULL;
+    }
+
+    FFTPlan *plan = (FFTPlan*)calloc(1, sizeof(FFTPlan));
+    if (!plan) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return NULL;
+    }
+
+    plan->n = n;
+    plan->inverse = inverse;
+    plan->twiddles = (double complex*)malloc(n * sizeof(double complex));
+    if (!plan->twiddles) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        free(plan);
+        return NULL;
+    }
+
+    double sign = inverse ? 1.0 : -1.0;
+    for (int k = 0; k < n; k++)
+        plan->twiddles[k] = cexp(I * (sign * 2.0 * M_PI * k / n));
+
+    plan->n_factors = fft_factor(n, plan->radix);
+    if (plan->n_factors < 0) {
+        fprintf(stderr, "FFT length %d has too many factors.\n", n);
+        fft_plan_destroy(plan);
+        return NULL;
+    }
+
+    for (int f = 0; f < plan->n_factors; f++) {
+        int radix = plan->radix[f];
+        if (radix <= FFT_CHIRP_MIN_RADIX || fft_find_chirp(plan, radix))
+            continue;
+        FFTChirp *ch = fft_chirp_create(radix, inverse);
+        if (!ch) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            fft_plan_destroy(plan);
+            return NULL;
+        }
+        ch->next = plan->chirps;
+        plan->chirps = ch;
+    }
+
+    return plan;
+}
+
+void fft_plan_destroy(FFTPlan *plan) {
+    if (!plan)
+        return;
+    while (plan->chirps) {
+        FFTChirp *ch = plan->chirps;
+        plan->chirps = ch->next;
+        fft_chirp_destroy(ch);
+    }
+    free(plan->twiddles);
+    free(plan);
+}
+
+// One pass of radix 2 over groups j < m at stride s
+static void fft_pass2(const FFTPlan *p, const double complex *x, double complex *y, int m, int s) {
+    const double complex *tw = p->twiddles;
+    for (int j = 0; j < m; j++) {
+        double complex w1 = tw[(size_t)j * s];
+        const double complex *a = x + (size_t)s * j;
+        double complex *b = y + (size_t)s * 2 * j;
+        size_t d = (size_t)s * m;
+        for (int q = 0; q < s; q++) {
+            double complex a0 = a[q], a1 = a[q + d];
+            b[q] = a0 + a1;
+            b[q + s] = (a0 - a1) * w1;
+        }
+    }
+}
+
+static void fft_pass3(const FFTPlan *p, const double complex *x, double complex *y, int m, int s) {
+    const double complex *tw = p->twiddles;
+    // w_3 = -1/2 + i h, h = -+sqrt(3)/2
+    double h = cimag(tw[p->n / 3]);
+    for (int j = 0; j < m; j++) {
+        double complex w1 = tw[(size_t)j * s], w2 = tw[(size_t)2 * j * s];
+        const double complex *a = x + (size_t)s * j;
+        double complex *b = y + (size_t)s * 3 * j;
+        size_t d = (size_t)s * m;
+        for (int q = 0; q < s; q++) {
+            double complex a0 = a[q], a1 = a[q + d], a2 = a[q + 2 * d];
+            double complex sum = a1 + a2;
+            double complex mid = a0 - 0.5 * sum;
+            double complex rot = I * h * (a1 - a2);
+            b[q] = a0 + sum;
+            b[q + s] = (mid + rot) * w1;
+            b[q + 2 * s] = (mid - rot) * w2;
+        }
+    }
+}
+
+static void fft_pass4(const FFTPlan *p, const double complex *x, double complex *y, int m, int s) {
+    const double complex *tw = p->twiddles;
+    // w_4: -i forward, +i inverse
+    double complex w4 = p->inverse ? I : -I;
+    for (int j = 0; j < m; j++) {
+        double complex w1 = tw[(size_t)j * s], w2 = tw[(size_t)2 * j * s], w3 = tw[(size_t)3 * j * s];
+        const double complex *a = x + (size_t)s * j;
+        double complex *b = y + (size_t)s * 4 * j;
+        size_t d = (size_t)s * m;
+        for (int q = 0; q < s; q++) {
+            double complex a0 = a[q], a1 = a[q + d], a2 = a[q + 2 * d], a3 = a[q + 3 * d];
+            double complex even_sum = a0 + a2, even_diff = a0 - a2;
+            double complex odd_sum = a1 + a3, odd_diff = (a1 - a3) * w4;
+            b[q] = even_sum + odd_sum;
+            b[q + s] = (even_diff + odd_diff) * w1;
+            b[q + 2 * s] = (even_sum - odd_sum) * w2;
+            b[q + 3 * s] = (even_diff - odd_diff) * w3;
+        }
+    }
+}
+
+static void fft_pass5(const FFTPlan *p, const double complex *x, double complex *y, int m, int s) {
+    const double complex *tw = p->twiddles;
+    // w_5 and w_5^2
+    double c1 = creal(tw[p->n / 5]), h1 = cimag(tw[p->n / 5]);
+    double c2 = creal(tw[2 * (p->n / 5)]), h2 = cimag(tw[2 * (p->n / 5)]);
+    for (int j = 0; j < m; j++) {
+        double complex w1 = tw[(size_t)j * s], w2 = tw[(size_t)2 * j * s];
+        double complex w3 = tw[(size_t)3 * j * s], w4 = tw[(size_t)4 * j * s];
+        const double complex *a = x + (size_t)s * j;
+        double complex *b = y + (size_t)s * 5 * j;
+        size_t d = (size_t)s * m;
+        for (int q = 0; q < s; q++) {
+            double complex a0 = a[q], a1 = a[q + d], a2 = a[q + 2 * d], a3 = a[q + 3 * d], a4 = a[q + 4 * d];
+            double complex sum14 = a1 + a4, diff14 = a1 - a4;
+            double complex sum23 = a2 + a3, diff23 = a2 - a3;
+            double complex re1 = a0 + c1 * sum14 + c2 * sum23;
+            double complex im1 = I * (h1 * diff14 + h2 * diff23);
+            double complex re2 = a0 + c2 * sum14 + c1 * sum23;
+            double complex im2 = I * (h2 * diff14 - h1 * diff23);
+            b[q] = a0 + sum14 + sum23;
+            b[q + s] = (re1 + im1) * w1;
+            b[q + 2 * s] = (re2 + im2) * w2;
+            b[q + 3 * s] = (re2 - im2) * w3;
+            b[q + 4 * s] = (re1 - im1) * w4;
+        }
+    }
+}
+
+// Any other radix as a direct r-point DFT; w_r^(i k) is entry i k n / r of
+// the table, taken mod n
+static void fft_pass_dft(const FFTPlan *p, const double complex *x, double complex *y, int m, int s, int r) {
+    const double complex *tw = p->twiddles;
+    size_t n = p->n, step = n / r;
+    size_t d = (size_t)s * m;
+    for (int j = 0; j < m; j++) {
+        const double complex *a = x + (size_t)s * j;
+        double complex *b = y + (size_t)s * r * j;
+        for (int k = 0; k < r; k++) {
+            double complex wk = tw[(size_t)j * k * s];
+            size_t inc = (size_t)k * step;
+            for (int q = 0; q < s; q++) {
+                double complex sum = a[q];
+                size_t idx = 0;
+                for (int i = 1; i < r; i++) {
+                    idx += inc;
+                    if (idx >= n)
+                        idx -= n;
+                    sum += a[q + i * d] * tw[idx];
+                }
+                b[q + (size_t)k * s] = sum * wk;
+            }
+        }
+    }
+}
+
+// Prime radix through Bluestein: each group is multiplied by the chirp,
+// convolved with its conjugate, and multiplied by the chirp again; the
+// inverse transform of the convolution is taken as conj(FFT(conj(.))).
+static int fft_pass_chirp(const FFTPlan *p, const double complex *x, double complex *y, int m, int s,
+                          const FFTChirp *ch) {
+    const double complex *tw = p->twiddles;
+    int r = ch->radix, len = ch->len;
+    size_t d = (size_t)s * m;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *a = (double complex*)arena_alloc(arena, 2 * (size_t)len * sizeof(double complex));
+    if (!a)
+        return -1;
+    double complex *spec = a + len;
+    int rv = 0;
+
+    for (int j = 0; j < m && rv == 0; j++) {
+        for (int q = 0; q < s && rv == 0; q++) {
+            const double complex *in = x + (size_t)s * j + q;
+            for (int i = 0; i < r; i++)
+                a[i] = in[i * d] * ch->chirp[i];
+            for (int i = r; i < len; i++)
+                a[i] = 0.0;
+
+            rv = fft_execute(ch->plan, a, spec);
+            for (int i = 0; i < len; i++)
+                spec[i] = conj(spec[i] * ch->filter[i]);
+            if (rv == 0)
+                rv = fft_execute(ch->plan, spec, a);
+
+            double complex *out = y + (size_t)s * r * j + q;
+            for (int k = 0; k < r; k++)
+                out[(size_t)k * s] = ch->chirp[k] * conj(a[k]) * tw[(size_t)j * k * s];
+        }
+    }
+
+    arena_release(arena, mark);
+    return rv;
+}
+
+static int fft_pass(const FFTPlan *p, const double complex *x, double complex *y, int m, int s, int r) {
+    switch (r) {
+        case 2: fft_pass2(p, x, y, m, s); return 0;
+        case 3: fft_pass3(p, x, y, m, s); return 0;
+        case 4: fft_pass4(p, x, y, m, s); return 0;
+        case 5: fft_pass5(p, x, y, m, s); return 0;
+        default: {
+            const FFTChirp *ch = fft_find_chirp(p, r);
+            if (ch)
+                return fft_pass_chirp(p, x, y, m, s, ch);
+            fft_pass_dft(p, x, y, m, s, r);
+            return 0;
+        }
+    }
+}
+
+// Out-of-place transform, in and out must not overlap
+int fft_execute(const FFTPlan *plan, const double complex *in, double complex *out) {
+    if (!plan || !in || !out || in == out) {
+        fprintf(stderr, "Invalid arguments for fft_execute.\n");
+        return -1;
+    }
+
+    int n = plan->n, n_passes = plan->n_factors;
+    if (n_passes == 0) {
+        out[0] = in[0];
+        return 0;
+    }
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *work = NULL;
+    if (n_passes > 1) {
+        work = (double complex*)arena_alloc(arena, n * sizeof(double complex));
+        if (!work)
+            return -1;
+    }
+
+    // The last pass writes out, so the first writes out after an even
+    // number of passes to go
+    const double complex *x = in;
+    double complex *y = (n_passes & 1) ? out : work;
+    int rv = 0;
+    for (int f = 0, l = n, s = 1; f < n_passes && rv == 0; f++) {
+        int r = plan->radix[f];
+        l /= r;
+        rv = fft_pass(plan, x, y, l, s, r);
+        s *= r;
+        x = y;
+        y = y == out ? work : out;
+    }
+
+    arena_release(arena, mark);
+    return rv;
+}
+
+// Forward transform of a real sequence read with the given stride (in doubles),
+// e.g. &data[0].ch0 with a stride of sizeof(DataSample) / sizeof(double)
+int fft_real(const FFTPlan *plan, const double *x, int stride, double complex *out) {
+    if (!plan || !x || !out || plan->inverse) {
+        fprintf(stderr, "Invalid arguments for fft_real.\n");
+        return -1;
+    }
+
+    int n = plan->n;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *in = (double complex*)arena_alloc(arena, n * sizeof(double complex));
+    if (!in)
+        return -1;
+
+    for (int i = 0; i < n; i++)
+        in[i] = x[(size_t)i * stride];
+
+    int rv = fft_execute(plan, in, out);
+    arena_release(arena, mark);
+    return rv;
+}
+
+// Separate the spectra of two real signals packed as z = x0 + i*x1 using
+// X0[k] = (Z[k] + conj(Z[n-k])) / 2 and X1[k] = (Z[k] - conj(Z[n-k])) / 2i.
+// Writes the n/2 + 1 non-negative frequency bins of each signal.
+void fft_split_dual_real(const double complex *z, int n, double complex *spec0, double complex *spec1) {
+    for (int k = 0; k <= n / 2; k++) {
+        double complex zk = z[k];
+        double complex zc = conj(z[(n - k) % n]);
+        spec0[k] = 0.5 * (zk + zc);
+        spec1[k] = -0.5 * I * (zk - zc);
+    }
+}
+
+// Transform the packed buffer (first n entries of buf, the rest is scratch)
+// and split it into the two half-spectra
+static int fft_dual_real_packed(const FFTPlan *plan, double complex *buf,
+                                double complex *spec0, double complex *spec1) {
+    double complex *z = buf + plan->n;
+    if (fft_execute(plan, buf, z) != 0)
+        return -1;
+    fft_split_dual_real(z, plan->n, spec0, spec1);
+    return 0;
+}
+
+// Two-for-one transform of ch0 and ch1: one complex FFT of ch0 + i*ch1
+// instead of one per channel. spec0/spec1 receive n/2 + 1 bins each.
+int fft_dual_real(const FFTPlan *plan, const DataSample *data, double complex *spec0, double complex *spec1) {
+    if (!plan || !data || !spec0 || !spec1 || plan->inverse) {
+        fprintf(stderr, "Invalid arguments for fft_dual_real.\n");
+        return -1;
+    }
+
+    int n = plan->n;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *buf = (double complex*)arena_alloc(arena, 2 * (size_t)n * sizeof(double complex));
+    if (!buf)
+        return -1;
+
+    for (int i = 0; i < n; i++)
+        buf[i] = data[i].ch0 + I * data[i].ch1;
+
+    int rv = fft_dual_real_packed(plan, buf, spec0, spec1);
+    arena_release(arena, mark);
+    return rv;
+}
+
+// Same for two planar channels, e.g. cap->ch[0] and cap->ch[1]
+int fft_dual_real_planar(const FFTPlan *plan, const double *x0, const double *x1,
+                         double complex *spec0, double complex *spec1) {
+    if (!plan || !x0 || !x1 || !spec0 || !spec1 || plan->inverse) {
+        fprintf(stderr, "Invalid arguments for fft_dual_real_planar.\n");
+        return -1;
+    }
+
+    int n = plan->n;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *buf = (double complex*)arena_alloc(arena, 2 * (size_t)n * sizeof(double complex));
+    if (!buf)
+        return -1;
+
+    for (int i = 0; i < n; i++)
+        buf[i] = x0[i] + I * x1[i];
+
+    int rv = fft_dual_real_packed(plan, buf, spec0, spec1);
+    arena_release(arena, mark);
+    return rv;
+}
@@ -0,0 +1,82 @@
+#include "includes.h"
+
+// fft_check: compare fft_execute against a direct DFT.
+// Lengths cover powers of 2, mixed radices, small primes on the plain
+// butterfly, large primes on Bluestein's path and the 7 * 1163 of a
+// bundled capture. The error is the largest bin difference over the
+// largest bin, in both directions; exits non-zero if any length fails.
+
+#define FFT_CHECK_TOL 1e-9
+
+static const int check_lengths[] = { 1, 2, 3, 7 * 11 * 13, 16, 360, 1000, 1024, 31, 37, 97, 997, 2 * 1163, 8141, 4096 * 3 };
+
+// Direct DFT with the phase index reduced mod n, so the reference does not
+// lose accuracy to large arguments; w holds the n roots of unity
+static void dft(const double complex *x, double complex *y, double complex *w, int n, int inverse) {
+    double sign = inverse ? 1.0 : -1.0;
+    for (int k = 0; k < n; k++)
+        w[k] = cexp(I * (sign * 2.0 * M_PI * k / n));
+    for (int k = 0; k < n; k++) {
+        double complex sum = 0.0;
+        int idx = 0;
+        for (int j = 0; j < n; j++) {
+            sum += x[j] * w[idx];
+            idx += k;
+            if (idx >= n)
+                idx -= n;
+        }
+        y[k] = sum;
+    }
+}
+
+static double check_length(int n, int inverse) {
+    double complex *x = (double complex*)malloc(n * sizeof(double complex));
+    double complex *y = (double complex*)malloc(n * sizeof(double complex));
+    double complex *ref = (double complex*)malloc(n * sizeof(double complex));
+    double complex *w = (double complex*)malloc(n * sizeof(double complex));
+    FFTPlan *plan = fft_plan_create(n, inverse);
+    double err = -1.0;
+    if (!x || !y || !ref || !w || !plan)
+        goto cleanup;
+
+    srand(n);
+    for (int i = 0; i < n; i++)
+        x[i] = (rand() / (double)RAND_MAX - 0.5) + I * (rand() / (double)RAND_MAX - 0.5);
+
+    if (fft_execute(plan, x, y) != 0)
+        goto cleanup;
+    dft(x, ref, w, n, inverse);
+
+    double diff = 0.0, peak = 0.0;
+    for (int k = 0; k < n; k++) {
+        diff = fmax(diff, cabs(y[k] - ref[k]));
+        peak = fmax(peak, cabs(ref[k]));
+    }
+    err = peak > 0.0 ? diff / peak : diff;
+
+cleanup:
+    fft_plan_destroy(plan);
+    free(x);
+    free(y);
+    free(ref);
+    free(w);
+    return err;
+}
+
+int main(void) {
+    int failed = 0;
+    int n_lengths = sizeof(check_lengths) / sizeof(check_lengths[0]);
+    for (int i = 0; i < n_lengths; i++) {
+        for (int inverse = 0; inverse < 2; inverse++) {
+            int n = check_lengths[i];
+            double err = check_length(n, inverse);
+            int ok = err >= 0.0 && err < FFT_CHECK_TOL;
+            printf("%-7s n = %5d: error %.2e %s\n", inverse ? "inverse" : "forward", n, err, ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+    }
+
+    arena_free(scratch_arena());
+    printf("%s\n", failed ? "FFT check failed." : "FFT check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,437 @@
+#include "includes.h"
+
+// Zero-phase IIR filtering (forward-backward).
+// Both passes start from Gustafsson's initial states: the forward and
+// backward delay-line contents that make forward-backward and
+// backward-forward filtering of the signal agree in the least-squares
+// sense. That removes the start-up ringing of passes run from rest without
+// padding the signal. Once the signal is longer than four impulse responses
+// the two ends decouple, and each end's states are solved from a window of
+// twice the impulse response length there.
+// sos_filtfilt works in place on the whole signal; sos_filtfilt_multi runs
+// several signals of one length together in SIMD lanes. The block mode runs the
+// forward pass causally with its state carried between blocks, and the
+// backward pass over each block plus a lookahead, started from rest at the
+// far end; output lags input by the lookahead and, away from the two ends,
+// differs from sos_filtfilt by the impulse response left after that many
+// samples.
+
+#define SOS_GUST_EPS 1e-9              // impulse response tail ignored, relative to its peak
+#define SOS_GUST_MAX_IRLEN (1 << 16)
+
+static void reverse(double *x, int n) {
+    for (int i = 0, j = n - 1; i < j; i++, j--) {
+        double t = x[i];
+        x[i] = x[j];
+        x[j] = t;
+    }
+}
+
+// Samples until the impulse response stays below SOS_GUST_EPS of its peak,
+// at most SOS_GUST_MAX_IRLEN
+int sos_impulse_length(const SOSFilter *sos) {
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *h = (double*)arena_alloc(arena, SOS_GUST_MAX_IRLEN * sizeof(double));
+    if (!h)
+        return SOS_GUST_MAX_IRLEN;
+
+    SOSFilter f = *sos;
+    sos_reset(&f);
+    memset(h, 0, SOS_GUST_MAX_IRLEN * sizeof(double));
+    h[0] = 1.0;
+    sos_process(&f, h, SOS_GUST_MAX_IRLEN);
+
+    double peak = 0.0;
+    for (int i = 0; i < SOS_GUST_MAX_IRLEN; i++)
+        peak = fmax(peak, fabs(h[i]));
+    int last = SOS_GUST_MAX_IRLEN - 1;
+    while (last > 0 && fabs(h[last]) <= SOS_GUST_EPS * peak)
+        last--;
+    arena_release(arena, mark);
+    return last + 1;
+}
+
+// Column k of obs: the zero-input response over rows samples from unit
+// state k; column k of s: that response reversed and filtered from rest
+static void sos_state_responses(const SOSFilter *sos, int rows, double *obs, double *s) {
+    for (int k = 0; k < 2 * sos->n_sections; k++) {
+        double *o = obs + (size_t)k * rows, *sk = s + (size_t)k * rows;
+        double v[2 * SOS_MAX_SECTIONS] = {0};
+        SOSFilter f = *sos;
+        v[k] = 1.0;
+        sos_set_state(&f, v);
+        memset(o, 0, rows * sizeof(double));
+        sos_process(&f, o, rows);
+
+        memcpy(sk, o, rows * sizeof(double));
+        reverse(sk, rows);
+        sos_reset(&f);
+        sos_process(&f, sk, rows);
+    }
+}
+
+// Backward-forward minus forward-backward output, both from rest
+static void naive_bf_minus_fb(const SOSFilter *sos, const double *x, int n, double *fb, double *delta) {
+    SOSFilter f = *sos;
+    memcpy(fb, x, n * sizeof(double));
+    sos_reset(&f);
+    sos_process(&f, fb, n);
+    sos_reset(&f);
+    sos_process_reverse(&f, fb, n);
+
+    memcpy(delta, x, n * sizeof(double));
+    sos_reset(&f);
+    sos_process_reverse(&f, delta, n);
+    sos_reset(&f);
+    sos_process(&f, delta, n);
+    for (int i = 0; i < n; i++)
+        delta[i] -= fb[i];
+}
+
+// Minimize |A x - b| by Householder QR; A is column-major and, with b,
+// overwritten. Columns with no independent contribution get x = 0, as do
+// those past the last row when there are fewer rows than columns: R has
+// no diagonal there.
+static void least_squares(double *A, int rows, int cols, double *b, double *x) {
+    double r_max = 0.0;
+    for (int k = 0; k < cols; k++) {
+        double *ak = A + (size_t)k * rows;
+        double norm = 0.0;
+        for (int i = k; i < rows; i++)
+            norm += ak[i] * ak[i];
+        norm = sqrt(norm);
+        if (norm == 0.0)
+            continue;
+        double akk = ak[k];
+        double alpha = akk > 0.0 ? -norm : norm;
+        ak[k] = akk - alpha;            // v = a - alpha e_k, kept in place
+        double vv = norm * norm - akk * akk + ak[k] * ak[k];
+
+        for (int j = k + 1; j <= cols; j++) {
+            double *aj = j < cols ? A + (size_t)j * rows : b;
+            double d = 0.0;
+            for (int i = k; i < rows; i++)
+                d += ak[i] * aj[i];
+            d *= 2.0 / vv;
+            for (int i = k; i < rows; i++)
+                aj[i] -= d * ak[i];
+        }
+        ak[k] = alpha;                  // R diagonal; the rest of v is no longer needed
+        r_max = fmax(r_max, fabs(alpha));
+    }
+
+    for (int k = cols - 1; k >= 0; k--) {
+        double rkk = k < rows ? A[(size_t)k * rows + k] : 0.0;
+        if (fabs(rkk) <= 1e-12 * r_max) {
+            x[k] = 0.0;
+            continue;
+        }
+        double sum = b[k];
+        for (int j = k + 1; j < cols; j++)
+            sum -= A[(size_t)j * rows + k] * x[j];
+        x[k] = sum / rkk;
+    }
+}
+
+typedef enum {
+    GUST_BOTH,                          // whole signal, ends coupled
+    GUST_START,                         // forward states only
+    GUST_END                            // backward states only
+} GustPart;
+
+// Gustafsson's states for x[0 .. n): forward ic[0 .. p) and backward
+// ic[p .. 2p), p = 2 * n_sections. GUST_BOTH solves
+// [S^R - O, O^R - S] ic = bf - fb over all n samples. GUST_START solves the
+// first block over the first n / 2 rows and GUST_END the second over the
+// last n / 2, for windows of twice the impulse response length.
+static int sos_gust_solve(const SOSFilter *sos, const double *x, int n, GustPart part, double *ic) {
+    int p = 2 * sos->n_sections;
+    int m = part == GUST_BOTH ? n : n / 2;
+    int cols = part == GUST_BOTH ? 2 * p : p;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *obs = (double*)arena_alloc(arena, (size_t)p * m * sizeof(double));
+    double *s = (double*)arena_alloc(arena, (size_t)p * m * sizeof(double));
+    double *A = (double*)arena_alloc(arena, (size_t)cols * m * sizeof(double));
+    double *fb = (double*)arena_alloc(arena, n * sizeof(double));
+    double *delta = (double*)arena_alloc(arena, n * sizeof(double));
+    if (!obs || !s || !A || !fb || !delta) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    sos_state_responses(sos, m, obs, s);
+    for (int k = 0; k < p; k++) {
+        const double *o = obs + (size_t)k * m, *sk = s + (size_t)k * m;
+        double *a_fwd = A + (size_t)k * m;
+        double *a_back = A + (size_t)(part == GUST_BOTH ? p + k : k) * m;
+        for (int i = 0; i < m; i++) {
+            if (part != GUST_END)
+                a_fwd[i] = sk[m - 1 - i] - o[i];
+            if (part != GUST_START)
+                a_back[i] = o[m - 1 - i] - sk[i];
+        }
+    }
+
+    naive_bf_minus_fb(sos, x, n, fb, delta);
+    double *rhs = part == GUST_END ? delta + n - m : delta;
+    least_squares(A, m, cols, rhs, part == GUST_END ? ic + p : ic);
+    arena_release(arena, mark);
+    return 0;
+}
+
+// Both sets of states for a whole signal of n samples; m is the filter's
+// sos_impulse_length, worked out once by the caller. With fewer samples
+// than states the fit is underdetermined and both passes start from rest.
+static int sos_gust_conditions(const SOSFilter *sos, int m, const double *x, int n, double *ic) {
+    int p = 2 * sos->n_sections;
+    if (n < 2 * p) {
+        memset(ic, 0, 2 * p * sizeof(double));
+        return 0;
+    }
+    if (n < 4 * m)
+        return sos_gust_solve(sos, x, n, GUST_BOTH, ic);
+    if (sos_gust_solve(sos, x, 2 * m, GUST_START, ic) != 0)
+        return -1;
+    return sos_gust_solve(sos, x + n - 2 * m, 2 * m, GUST_END, ic);
+}
+
+static int sos_filtfilt_one(const SOSFilter *sos, int m, double *x, int n) {
+    double ic[4 * SOS_MAX_SECTIONS];
+    if (sos_gust_conditions(sos, m, x, n, ic) != 0)
+        return -1;
+
+    SOSFilter f = *sos;
+    sos_set_state(&f, ic);
+    if (sos_process_parallel(&f, x, n, 0) != 0)
+        return -1;
+    sos_set_state(&f, ic + 2 * sos->n_sections);
+    return sos_process_reverse_parallel(&f, x, n, 0);
+}
+
+// Zero-phase filtering of x in place; the coefficients' own state is not used
+int sos_filtfilt(const SOSFilter *sos, double *x, int n) {
+    if (!sos || !x || n <= 0 || sos->n_sections <= 0) {
+        fprintf(stderr, "Invalid arguments for sos_filtfilt.\n");
+        return -1;
+    }
+    return sos_filtfilt_one(sos, sos_impulse_length(sos), x, n);
+}
+
+// Long signals run one by one block-parallel across cores, shorter ones
+// side by side in SIMD lanes
+static int sos_filtfilt_group(const SOSFilter *sos, int m, double *const *x, int n_sig, int n) {
+    if (n_sig == 1 || sos_parallel_threads(n, 0) > 1) {
+        for (int k = 0; k < n_sig; k++)
+            if (sos_filtfilt_one(sos, m, x[k], n) != 0)
+                return -1;
+        return 0;
+    }
+
+    int p = 2 * sos->n_sections;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    SOSFilter *f = (SOSFilter*)arena_alloc(arena, n_sig * sizeof(SOSFilter));
+    double *ic = (double*)arena_alloc(arena, (size_t)n_sig * 2 * p * sizeof(double));
+    int ret = -1;
+    if (!f || !ic)
+        goto cleanup;
+
+    for (int k = 0; k < n_sig; k++) {
+        if (sos_gust_conditions(sos, m, x[k], n, ic + k * 2 * p) != 0)
+            goto cleanup;
+        f[k] = *sos;
+        sos_set_state(&f[k], ic + k * 2 * p);
+    }
+    if (sos_process_lanes(f, x, n_sig, n, 0) != 0)
+        goto cleanup;
+    for (int k = 0; k < n_sig; k++)
+        sos_set_state(&f[k], ic + k * 2 * p + p);
+    ret = sos_process_lanes(f, x, n_sig, n, 1);
+
+cleanup:
+    arena_release(arena, mark);
+    return ret;
+}
+
+// Zero-phase filtering of n_sig signals of n samples each, in place
+int sos_filtfilt_multi(const SOSFilter *sos, double *const *x, int n_sig, int n) {
+    if (!sos || !x || n_sig < 0 || n <= 0 || sos->n_sections <= 0) {
+        fprintf(stderr, "Invalid arguments for sos_filtfilt_multi.\n");
+        return -1;
+    }
+    return sos_filtfilt_group(sos, sos_impulse_length(sos), x, n_sig, n);
+}
+
+// Zero-phase filtering of every channel
+int filter_capture_zero_phase(Capture *cap, const SOSFilter *sos) {
+    if (cap->n_samples <= 0)
+        return 0;
+    return sos_filtfilt_multi(sos, cap->ch, cap->n_channels, cap->n_samples);
+}
+
+// A batch of captures: channels of captures with the same length share lanes
+int filter_captures_zero_phase(Capture *const *caps, int n_caps, const SOSFilter *sos) {
+    if (!caps || n_caps < 0 || !sos || sos->n_sections <= 0) {
+        fprintf(stderr, "Invalid arguments for filter_captures_zero_phase.\n");
+        return -1;
+    }
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    char *done = (char*)arena_alloc(arena, n_caps + 1);
+    double **x = (double**)arena_alloc(arena, ((size_t)n_caps * CAPTURE_MAX_CHANNELS + 1) * sizeof(double*));
+    int ret = -1;
+    if (!done || !x)
+        goto cleanup;
+    memset(done, 0, n_caps);
+    int m = sos_impulse_length(sos);
+
+    for (int a = 0; a < n_caps; a++) {
+        if (done[a])
+            continue;
+        int n = caps[a]->n_samples;
+        int n_sig = 0;
+        for (int b = a; b < n_caps; b++) {
+            if (done[b] || caps[b]->n_samples != n)
+                continue;
+            for (int c = 0; c < caps[b]->n_channels; c++)
+                x[n_sig++] = caps[b]->ch[c];
+            done[b] = 1;
+        }
+        if (n > 0 && sos_filtfilt_group(sos, m, x, n_sig, n) != 0)
+            goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    arena_release(arena, mark);
+    return ret;
+}
+
+// Outputs lag inputs by lookahead samples, 0 for the impulse response
+// length; pushes take at most max_block samples
+int sos_filtfilt_stream_init(SOSFiltfiltStream *st, const SOSFilter *sos, int max_block, int lookahead) {
+    if (!st || !sos || sos->n_sections <= 0 || max_block <= 0 || lookahead < 0) {
+        fprintf(stderr, "Invalid zero-phase stream parameters.\n");
+        return -1;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->coef = *sos;
+    sos_reset(&st->coef);
+    st->fwd = st->coef;
+    st->irlen = sos_impulse_length(sos);
+    st->lookahead = lookahead > 0 ? lookahead : st->irlen;
+    st->max_block = max_block;
+
+    // Room for the start window, held back until the forward pass can begin
+    int edge = 4 * st->irlen;
+    st->capacity = (st->lookahead > edge ? st->lookahead : edge) + max_block;
+    st->buf = (double*)malloc((size_t)st->capacity * sizeof(double));
+    st->back = (double*)malloc((size_t)st->capacity * sizeof(double));
+    st->raw = (double*)malloc((size_t)2 * st->irlen * sizeof(double));
+    if (!st->buf || !st->back || !st->raw) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        sos_filtfilt_stream_free(st);
+        return -1;
+    }
+    return 0;
+}
+
+void sos_filtfilt_stream_free(SOSFiltfiltStream *st) {
+    if (!st)
+        return;
+    free(st->buf);
+    free(st->back);
+    free(st->raw);
+    memset(st, 0, sizeof(*st));
+}
+
+// Backward pass over the first n_buf forward outputs from the given state
+// (NULL for rest); the first n_out results go to out
+static void filtfilt_stream_backward(SOSFiltfiltStream *st, int n_buf, const double *state,
+                                     double *out, int n_out) {
+    SOSFilter b = st->coef;
+    if (state)
+        sos_set_state(&b, state);
+    memcpy(st->back, st->buf, n_buf * sizeof(double));
+    sos_process_reverse(&b, st->back, n_buf);
+    memcpy(out, st->back, n_out * sizeof(double));
+}
+
+// Remember the newest 2 * irlen raw inputs for the end states
+static void filtfilt_stream_keep_raw(SOSFiltfiltStream *st, const double *x, int n) {
+    int keep = 2 * st->irlen;
+    if (n >= keep) {
+        memcpy(st->raw, x + n - keep, keep * sizeof(double));
+        st->n_raw = keep;
+        return;
+    }
+    int old = st->n_raw + n > keep ? keep - n : st->n_raw;
+    memmove(st->raw, st->raw + st->n_raw - old, old * sizeof(double));
+    memcpy(st->raw + old, x, n * sizeof(double));
+    st->n_raw = old + n;
+}
+
+// Filter n <= max_block inputs. Writes the outputs that are ready to out
+// and returns how many; out needs room for capacity samples.
+int sos_filtfilt_stream_process(SOSFiltfiltStream *st, const double *x, int n, double *out) {
+    if (n <= 0)
+        return 0;
+    if (n > st->max_block) {
+        fprintf(stderr, "Block of %d exceeds the zero-phase stream's %d.\n", n, st->max_block);
+        return -1;
+    }
+
+    filtfilt_stream_keep_raw(st, x, n);
+    double *y = st->buf + st->n_buf;
+    memcpy(y, x, n * sizeof(double));
+    st->n_buf += n;
+
+    if (!st->started) {
+        // Input waits until the forward states' window is in; shorter
+        // streams are filtered whole by sos_filtfilt_stream_finish
+        if (st->n_buf < 4 * st->irlen)
+            return 0;
+        double ic[4 * SOS_MAX_SECTIONS];
+        if (sos_gust_solve(&st->coef, st->buf, 2 * st->irlen, GUST_START, ic) != 0)
+            return -1;
+        sos_set_state(&st->fwd, ic);
+        y = st->buf;
+        n = st->n_buf;
+        st->started = 1;
+    }
+    sos_process(&st->fwd, y, n);
+
+    int n_out = st->n_buf - st->lookahead;
+    if (n_out <= 0)
+        return 0;
+    filtfilt_stream_backward(st, st->n_buf, NULL, out, n_out);
+    st->n_buf -= n_out;
+    memmove(st->buf, st->buf + n_out, st->n_buf * sizeof(double));
+    return n_out;
+}
+
+// The outputs still held back, the last ones from Gustafsson's backward
+// states; out needs room for capacity samples. Returns how many.
+int sos_filtfilt_stream_finish(SOSFiltfiltStream *st, double *out) {
+    int n = st->n_buf;
+    if (n == 0)
+        return 0;
+    st->n_buf = 0;
+
+    if (!st->started) {
+        memcpy(out, st->buf, n * sizeof(double));
+        return sos_filtfilt(&st->coef, out, n) == 0 ? n : -1;
+    }
+
+    double ic[4 * SOS_MAX_SECTIONS];
+    if (sos_gust_solve(&st->coef, st->raw, st->n_raw, GUST_END, ic) != 0)
+        return -1;
+    filtfilt_stream_backward(st, n, ic + 2 * st->coef.n_sections, out, n);
+    return n;
+}
@@ -0,0 +1,66 @@
+#include "includes.h"
+
+// filtfilt_check: zero-phase filtering of short signals.
+// A unit sine at the centre of an order-4 bandpass goes through
+// sos_filtfilt and sos_filtfilt_multi at lengths from one sample, where the
+// initial states are underdetermined or not fitted at all, up to several
+// impulse responses. Forward-backward Butterworth gain never exceeds 1, so
+// any peak above FILTFILT_CHECK_GAIN means the states blew up; long signals
+// must also pass the tone. Exits non-zero if any length fails.
+
+#define FILTFILT_CHECK_FS 64000.0
+#define FILTFILT_CHECK_GAIN 1.05
+
+static const int check_lengths[] = { 1, 2, 3, 4, 8, 15, 16, 17, 31, 32, 33, 64, 200, 1000, 5000 };
+
+static double check_peak(const SOSFilter *sos, int n, int lanes) {
+    double *x[2];
+    x[0] = (double*)malloc(n * sizeof(double));
+    x[1] = (double*)malloc(n * sizeof(double));
+    double peak = -1.0;
+    if (!x[0] || !x[1])
+        goto cleanup;
+
+    for (int i = 0; i < n; i++)
+        x[0][i] = x[1][i] = sin(2.0 * M_PI * 25000.0 * i / FILTFILT_CHECK_FS);
+    int rv = lanes ? sos_filtfilt_multi(sos, x, 2, n) : sos_filtfilt(sos, x[0], n);
+    if (rv != 0)
+        goto cleanup;
+
+    peak = 0.0;
+    for (int i = 0; i < n; i++) {
+        if (!isfinite(x[0][i])) {
+            peak = INFINITY;
+            break;
+        }
+        peak = fmax(peak, fabs(x[0][i]));
+    }
+
+cleanup:
+    free(x[0]);
+    free(x[1]);
+    return peak;
+}
+
+int main(void) {
+    SOSFilter sos;
+    if (design_butterworth_bandpass(FILTFILT_CHECK_FS, 24000.0, 26000.0, 4, &sos) != 0)
+        return EXIT_FAILURE;
+    int long_n = 4 * sos_impulse_length(&sos);
+
+    int failed = 0;
+    int n_lengths = sizeof(check_lengths) / sizeof(check_lengths[0]);
+    for (int i = 0; i < n_lengths; i++) {
+        for (int lanes = 0; lanes < 2; lanes++) {
+            int n = check_lengths[i];
+            double peak = check_peak(&sos, n, lanes);
+            int ok = peak >= 0.0 && peak <= FILTFILT_CHECK_GAIN && (n < long_n || peak > 0.95);
+            printf("%-6s n = %4d: peak %.4lf %s\n", lanes ? "lanes" : "single", n, peak, ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+    }
+
+    arena_free(scratch_arena());
+    printf("%s\n", failed ? "filtfilt check failed." : "filtfilt check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
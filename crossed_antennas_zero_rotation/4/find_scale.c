@@ -16,3 +16,19 @@ double find_scale(const DataSample *data, int n_samples) {
 
     return max_abs;
 }
+
+// Largest absolute value over all channels of a capture
+double find_scale_capture(const Capture *cap) {
+    double max_abs = 0.0;
+
+    for (int c = 0; c < cap->n_channels; c++) {
+        const double *x = cap->ch[c];
+        for (int i = 0; i < cap->n_samples; i++) {
+            double a = fabs(x[i]);
+            if (a > max_abs)
+                max_abs = a;
+        }
+    }
+
+    return max_abs;
+}
@@ -0,0 +1,219 @@
+#include "includes.h"
+
+// fir_check: compare the FIR kernels against a direct convolution.
+// Symmetric filters of odd and even length go through each symmetric
+// kernel (scalar, SSE2, AVX2, NEON; the ones this CPU lacks are skipped)
+// on signals from one sample, all edge, up to many filter lengths.
+// Symmetric and asymmetric filters go through overlap-save at the
+// shortest FFT length it accepts and at a longer one, so signals both
+// shorter and longer than a block are covered. The fused two-channel
+// filters, direct and overlap-save, run on a DataSample array and on two
+// channel planes, and each channel must match its own direct convolution.
+// The error is the largest output difference over the largest output,
+// worst over the signal lengths; exits non-zero if any case fails.
+
+#define FIR_CHECK_TOL 1e-12
+
+static const int check_taps[] = { 1, 2, 3, 4, 31, 32, 201, 256 };
+static const int check_lengths[] = { 1, 2, 5, 31, 32, 33, 255, 1000, 4099 };
+
+// y[i] = sum_j taps[j] * x[i - half + j], zeros outside the signal
+static void fir_direct(const double *x, double *y, int n, const FIRFilter *filter) {
+    int half_len = filter->num_taps / 2;
+    for (int i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (int j = 0; j < filter->num_taps; j++) {
+            int idx = i - half_len + j;
+            if (idx >= 0 && idx < n)
+                sum += x[idx] * filter->taps[j];
+        }
+        y[i] = sum;
+    }
+}
+
+static double relative_error(const double *y, const double *ref, int n) {
+    double diff = 0.0, peak = 0.0;
+    for (int i = 0; i < n; i++) {
+        diff = fmax(diff, fabs(y[i] - ref[i]));
+        peak = fmax(peak, fabs(ref[i]));
+    }
+    return peak > 0.0 ? diff / peak : diff;
+}
+
+static void check_signal(double *x, int n, int seed) {
+    srand(seed);
+    for (int i = 0; i < n; i++)
+        x[i] = rand() / (double)RAND_MAX - 0.5;
+}
+
+// Random taps, mirrored when symmetric
+static void check_filter(FIRFilter *filter, int n_taps, int symmetric) {
+    filter->num_taps = n_taps;
+    srand(n_taps);
+    for (int j = 0; j < n_taps; j++)
+        filter->taps[j] = rand() / (double)RAND_MAX - 0.5;
+    for (int j = 0; symmetric && j < n_taps / 2; j++)
+        filter->taps[n_taps - 1 - j] = filter->taps[j];
+}
+
+// Error of one symmetric kernel, -1 on failure
+static double check_symmetric(const FIRFilter *filter, int n, FIRKernel kernel) {
+    double *x = (double*)malloc(n * sizeof(double));
+    double *ref = (double*)malloc(n * sizeof(double));
+    double err = -1.0;
+    if (!x || !ref)
+        goto cleanup;
+
+    check_signal(x, n, n);
+    fir_direct(x, ref, n, filter);
+    if (filter_fir_symmetric(x, n, filter, kernel) != 0)
+        goto cleanup;
+    err = relative_error(x, ref, n);
+
+cleanup:
+    free(x);
+    free(ref);
+    return err;
+}
+
+static double check_overlap_save(const FIRFilter *filter, int n, int fft_len) {
+    double *x = (double*)malloc(n * sizeof(double));
+    double *ref = (double*)malloc(n * sizeof(double));
+    double err = -1.0;
+    if (!x || !ref)
+        goto cleanup;
+
+    check_signal(x, n, n);
+    fir_direct(x, ref, n, filter);
+    if (filter_fir_overlap_save(x, n, filter, fft_len) != 0)
+        goto cleanup;
+    err = relative_error(x, ref, n);
+
+cleanup:
+    free(x);
+    free(ref);
+    return err;
+}
+
+// Fused ch0/ch1 filtering; fft_len 0 for the direct form
+static double check_dual(const FIRFilter *filter, int n, int fft_len, int planar) {
+    double *x[2], *ref[2];
+    DataSample *data = (DataSample*)malloc(n * sizeof(DataSample));
+    for (int c = 0; c < 2; c++) {
+        x[c] = (double*)malloc(n * sizeof(double));
+        ref[c] = (double*)malloc(n * sizeof(double));
+    }
+    double err = -1.0;
+    if (!data || !x[0] || !x[1] || !ref[0] || !ref[1])
+        goto cleanup;
+
+    for (int c = 0; c < 2; c++) {
+        check_signal(x[c], n, 2 * n + c);
+        fir_direct(x[c], ref[c], n, filter);
+    }
+    int rv;
+    if (planar) {
+        rv = fft_len ? filter_dual_fir_overlap_save_planar(x[0], x[1], x[0], x[1], n, filter, fft_len)
+                     : filter_dual_fir_direct_planar(x[0], x[1], x[0], x[1], n, filter);
+    } else {
+        for (int i = 0; i < n; i++) {
+            data[i].time = i;
+            data[i].ch0 = x[0][i];
+            data[i].ch1 = x[1][i];
+        }
+        rv = fft_len ? filter_dual_fir_overlap_save(data, n, filter, fft_len)
+                     : filter_dual_fir_direct(data, n, filter);
+        for (int i = 0; i < n; i++) {
+            x[0][i] = data[i].ch0;
+            x[1][i] = data[i].ch1;
+            // The time column must come through untouched
+            if (data[i].time != i)
+                rv = -1;
+        }
+    }
+    if (rv != 0)
+        goto cleanup;
+    err = fmax(relative_error(x[0], ref[0], n), relative_error(x[1], ref[1], n));
+
+cleanup:
+    free(data);
+    for (int c = 0; c < 2; c++) {
+        free(x[c]);
+        free(ref[c]);
+    }
+    return err;
+}
+
+// Worst error so far; a failed run (negative) sticks
+static double worse(double worst, double err) {
+    return worst < 0.0 || err < 0.0 ? -1.0 : fmax(worst, err);
+}
+
+static int report(const char *what, const FIRFilter *filter, double worst) {
+    int ok = worst >= 0.0 && worst < FIR_CHECK_TOL;
+    printf("%-24s taps = %3d: error %.2e %s\n", what, filter->num_taps, worst, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+int main(void) {
+    static FIRFilter filter;
+    static const FIRKernel kernels[] = { FIR_KERNEL_SCALAR, FIR_KERNEL_SSE, FIR_KERNEL_AVX2, FIR_KERNEL_NEON };
+    int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+    int n_taps_cases = sizeof(check_taps) / sizeof(check_taps[0]);
+    int n_lengths = sizeof(check_lengths) / sizeof(check_lengths[0]);
+    char what[64];
+    int failed = 0;
+
+    // Each line is the worst error over all signal lengths
+    for (int t = 0; t < n_taps_cases; t++) {
+        check_filter(&filter, check_taps[t], 1);
+        for (int k = 0; k < n_kernels; k++) {
+            if (!fir_kernel_available(kernels[k]))
+                continue;
+            double worst = 0.0;
+            for (int i = 0; i < n_lengths; i++)
+                worst = worse(worst, check_symmetric(&filter, check_lengths[i], kernels[k]));
+            snprintf(what, sizeof(what), "symmetric %s", fir_kernel_name(kernels[k]));
+            failed += report(what, &filter, worst);
+        }
+    }
+
+    for (int t = 0; t < n_taps_cases; t++) {
+        for (int symmetric = 0; symmetric < 2; symmetric++) {
+            check_filter(&filter, check_taps[t], symmetric);
+            int fft_len = 2;
+            while (fft_len < filter.num_taps)
+                fft_len <<= 1;
+            for (int len = fft_len; len <= 8 * fft_len; len *= 8) {
+                double worst = 0.0;
+                for (int i = 0; i < n_lengths; i++)
+                    worst = worse(worst, check_overlap_save(&filter, check_lengths[i], len));
+                snprintf(what, sizeof(what), "overlap-save %s %d", symmetric ? "sym" : "asym", len);
+                failed += report(what, &filter, worst);
+            }
+        }
+    }
+
+    for (int t = 0; t < n_taps_cases; t++) {
+        for (int symmetric = 0; symmetric < 2; symmetric++) {
+            check_filter(&filter, check_taps[t], symmetric);
+            int fft_len = 2;
+            while (fft_len < 2 * filter.num_taps)
+                fft_len <<= 1;
+            for (int planar = 0; planar < 2; planar++) {
+                for (int len = 0; len <= fft_len; len += fft_len) {
+                    double worst = 0.0;
+                    for (int i = 0; i < n_lengths; i++)
+                        worst = worse(worst, check_dual(&filter, check_lengths[i], len, planar));
+                    snprintf(what, sizeof(what), "dual %s %s %s", planar ? "planar" : "packed",
+                             len ? "os" : "direct", symmetric ? "sym" : "asym");
+                    failed += report(what, &filter, worst);
+                }
+            }
+        }
+    }
+
+    arena_free(scratch_arena());
+    printf("%s\n", failed ? "FIR check failed." : "FIR check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,567 @@
+#include "includes.h"
+#include <pthread.h>
+
+// Linear-phase FIR bandpass (or, with f_low 0, lowpass) design to a
+// specification. The spec is the passband, the width of the transition band on either
+// side, the passband ripple (peak to peak, dB) and the stopband
+// attenuation. The Kaiser designer windows the ideal bandpass, with its
+// edges in the middle of the transition bands, by a Kaiser window whose
+// beta and length follow from the tighter of the two ripples. The Remez
+// designer is Parks-McClellan: the weighted equiripple fit over the bands
+// by the exchange algorithm, in barycentric form. It needs noticeably
+// fewer taps for the same spec. design_fir_min searches for the fewest
+// taps that still meet the spec, since filtering cost grows with them, and
+// keeps what it found: the DDC and the resampler ask for the same few
+// filters every time they start.
+
+#define REMEZ_GRID_DENSITY 16
+#define REMEZ_MAX_ITER 40
+#define REMEZ_TOL 1e-6
+#define FIR_CHECK_DENSITY 16            // response samples per tap in the check
+
+// A search result, found again by spec, method and tap limit
+typedef struct FIRDesignEntry {
+    FIRSpec spec;
+    FIRDesign method;
+    int max_taps;
+    FIRFilter filter;
+    struct FIRDesignEntry *next;
+} FIRDesignEntry;
+
+static pthread_mutex_t design_lock = PTHREAD_MUTEX_INITIALIZER;
+static FIRDesignEntry *design_cache = NULL;
+
+typedef struct {
+    double lo, hi;                      // cycles per sample
+    double desired;
+    double weight;
+} FIRBand;
+
+// Passband and stopband ripple as linear deviations
+static void fir_spec_deltas(const FIRSpec *spec, double *dp, double *ds) {
+    double g = pow(10.0, spec->ripple_db / 20.0);
+    *dp = (g - 1.0) / (g + 1.0);
+    *ds = pow(10.0, -spec->atten_db / 20.0);
+}
+
+static int fir_spec_valid(const FIRSpec *spec) {
+    return spec && spec->fs > 0.0 && spec->transition > 0.0 && spec->ripple_db > 0.0
+        && spec->atten_db > 0.0 && (spec->f_low == 0.0 || spec->f_low - spec->transition > 0.0)
+        && spec->f_low < spec->f_high && spec->f_high + spec->transition < spec->fs / 2.0;
+}
+
+// Stopband, passband, stopband in cycles per sample, or passband and
+// stopband for a lowpass; returns the number of bands
+static int fir_spec_bands(const FIRSpec *spec, FIRBand band[3]) {
+    double dp, ds;
+    fir_spec_deltas(spec, &dp, &ds);
+    int n = 0;
+    if (spec->f_low > 0.0)
+        band[n++] = (FIRBand){ 0.0, (spec->f_low - spec->transition) / spec->fs, 0.0, dp / ds };
+    band[n++] = (FIRBand){ spec->f_low / spec->fs, spec->f_high / spec->fs, 1.0, 1.0 };
+    band[n++] = (FIRBand){ (spec->f_high + spec->transition) / spec->fs, 0.5, 0.0, dp / ds };
+    return n;
+}
+
+// A(w) = h[M] + 2 sum h[M - k] cos(k w) of a symmetric odd-length filter
+static double fir_amplitude(const double *taps, int num_taps, double w) {
+    int M = (num_taps - 1) / 2;
+    double c = cos(w);
+    double t0 = 1.0, t1 = c;             // cos(k w) by the Chebyshev recurrence
+    double a = taps[M];
+    for (int k = 1; k <= M; k++) {
+        a += 2.0 * taps[M - k] * t1;
+        double t2 = 2.0 * c * t1 - t0;
+        t0 = t1;
+        t1 = t2;
+    }
+    return a;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 200; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-17 * sum)
+            break;
+    }
+    return sum;
+}
+
+// Attenuation the Kaiser design has to reach: its ripple is the same in
+// both bands
+static double kaiser_atten(const FIRSpec *spec) {
+    double dp, ds;
+    fir_spec_deltas(spec, &dp, &ds);
+    return -20.0 * log10(fmin(dp, ds));
+}
+
+double kaiser_beta(double atten_db) {
+    if (atten_db > 50.0)
+        return 0.1102 * (atten_db - 8.7);
+    if (atten_db >= 21.0)
+        return 0.5842 * pow(atten_db - 21.0, 0.4) + 0.07886 * (atten_db - 21.0);
+    return 0.0;
+}
+
+// Kaiser's length estimate, rounded up to odd
+int fir_kaiser_length(const FIRSpec *spec) {
+    if (!fir_spec_valid(spec))
+        return -1;
+    double df = spec->transition / spec->fs;
+    int n = (int)ceil((kaiser_atten(spec) - 7.95) / (14.36 * df)) + 1;
+    return n | 1;
+}
+
+// Herrmann's equiripple length estimate, rounded up to odd
+int fir_remez_length(const FIRSpec *spec) {
+    if (!fir_spec_valid(spec))
+        return -1;
+    double dp, ds;
+    fir_spec_deltas(spec, &dp, &ds);
+    double lp = log10(dp), ls = log10(ds);
+    double d = (0.005309 * lp * lp + 0.07114 * lp - 0.4761) * ls
+             - (0.00266 * lp * lp + 0.5941 * lp + 0.4278);
+    double fk = 11.01217 + 0.51244 * (lp - ls);
+    double df = spec->transition / spec->fs;
+    int n = (int)ceil(d / df - fk * df) + 1;
+    return n | 1;
+}
+
+int design_fir_kaiser(const FIRSpec *spec, int num_taps, FIRFilter *filter) {
+    if (!fir_spec_valid(spec) || !filter || num_taps < 3 || num_taps > MAX_FIR_TAPS || !(num_taps & 1)) {
+        fprintf(stderr, "Invalid Kaiser design parameters.\n");
+        return -1;
+    }
+
+    double f1 = spec->f_low > 0.0 ? (spec->f_low - spec->transition / 2.0) / spec->fs : 0.0;
+    double f2 = (spec->f_high + spec->transition / 2.0) / spec->fs;
+    double beta = kaiser_beta(kaiser_atten(spec));
+    double norm = bessel_i0(beta);
+    int M = (num_taps - 1) / 2;
+
+    filter->num_taps = num_taps;
+    for (int n = 0; n < num_taps; n++) {
+        int k = n - M;
+        double ideal = k == 0 ? 2.0 * (f2 - f1)
+                              : (sin(2.0 * M_PI * f2 * k) - sin(2.0 * M_PI * f1 * k)) / (M_PI * k);
+        double r = (double)k / M;
+        filter->taps[n] = ideal * bessel_i0(beta * sqrt(fmax(0.0, 1.0 - r * r))) / norm;
+    }
+    return 0;
+}
+
+// log |1 / prod (x[k] - x[j])| over j != k, and its sign
+static double remez_log_weight(const double *x, int n, int k, int *neg) {
+    double lsum = 0.0;
+    *neg = 0;
+    for (int j = 0; j < n; j++) {
+        if (j == k)
+            continue;
+        double d = x[k] - x[j];
+        lsum -= log(fabs(d));
+        *neg ^= d < 0.0;
+    }
+    return lsum;
+}
+
+// Barycentric weights of the nodes x[0 .. n), up to a common factor,
+// formed in logs since the products over- or underflow for long filters
+static void remez_weights(const double *x, int n, double *b) {
+    int neg;
+    double top = -INFINITY;
+    for (int k = 0; k < n; k++) {
+        b[k] = remez_log_weight(x, n, k, &neg);
+        top = fmax(top, b[k]);
+    }
+    for (int k = 0; k < n; k++) {
+        remez_log_weight(x, n, k, &neg);
+        b[k] = (neg ? -1.0 : 1.0) * exp(b[k] - top);
+    }
+}
+
+// Interpolant through (x[k], c[k]), k < n, at xv
+static double remez_eval(const double *x, const double *b, const double *c, int n, double xv) {
+    double num = 0.0, den = 0.0;
+    for (int k = 0; k < n; k++) {
+        double d = xv - x[k];
+        if (d == 0.0)
+            return c[k];
+        double t = b[k] / d;
+        num += t * c[k];
+        den += t;
+    }
+    return num / den;
+}
+
+// The exchange itself; -1 without a message when it loses alternation,
+// which the length search expects for too short filters
+static int remez_design(const FIRSpec *spec, int num_taps, FIRFilter *filter) {
+    FIRBand band[3];
+    int n_bands = fir_spec_bands(spec, band);
+    int M = (num_taps - 1) / 2;
+    int r = M + 2;                      // extremal frequencies
+
+    // Dense grid over the bands, spread by bandwidth, band edges included
+    double total = 0.0;
+    for (int i = 0; i < n_bands; i++)
+        total += band[i].hi - band[i].lo;
+    int n_grid = REMEZ_GRID_DENSITY * r + 3;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *gx = (double*)arena_alloc(arena, n_grid * sizeof(double));
+    double *gd = (double*)arena_alloc(arena, n_grid * sizeof(double));
+    double *gw = (double*)arena_alloc(arena, n_grid * sizeof(double));
+    double *err = (double*)arena_alloc(arena, n_grid * sizeof(double));
+    int *ext = (int*)arena_alloc(arena, 3 * n_grid * sizeof(int));
+    int *cand = ext + n_grid;
+    int *gb = cand + n_grid;            // band of each grid point
+    double *x = (double*)arena_alloc(arena, r * sizeof(double));
+    double *b = (double*)arena_alloc(arena, r * sizeof(double));
+    double *c = (double*)arena_alloc(arena, r * sizeof(double));
+    int ret = -1;
+    if (!gx || !gd || !gw || !err || !ext || !x || !b || !c)
+        goto cleanup;
+
+    int g = 0;
+    for (int i = 0; i < n_bands; i++) {
+        int pts = (int)ceil((band[i].hi - band[i].lo) / total * (n_grid - 3)) + 1;
+        if (g + pts > n_grid)
+            pts = n_grid - g;
+        for (int k = 0; k < pts; k++) {
+            double f = band[i].lo + (band[i].hi - band[i].lo) * k / (pts > 1 ? pts - 1 : 1);
+            gx[g] = cos(2.0 * M_PI * f);
+            gd[g] = band[i].desired;
+            gw[g] = band[i].weight;
+            gb[g] = i;
+            g++;
+        }
+    }
+    n_grid = g;
+
+    for (int k = 0; k < r; k++)
+        ext[k] = (int)((double)k * (n_grid - 1) / (r - 1));
+
+    double delta = 0.0;
+    int iter;
+    for (iter = 0; iter < REMEZ_MAX_ITER; iter++) {
+        for (int k = 0; k < r; k++)
+            x[k] = gx[ext[k]];
+        remez_weights(x, r, b);
+
+        // Levelled error of the best fit on this set
+        double num = 0.0, den = 0.0;
+        for (int k = 0; k < r; k++) {
+            num += b[k] * gd[ext[k]];
+            den += b[k] * ((k & 1) ? -1.0 : 1.0) / gw[ext[k]];
+        }
+        delta = num / den;
+        for (int k = 0; k < r; k++)
+            c[k] = gd[ext[k]] - ((k & 1) ? -1.0 : 1.0) * delta / gw[ext[k]];
+
+        // Interpolate through the first r - 1 points
+        for (int k = 0; k < r - 1; k++)
+            b[k] *= x[k] - x[r - 1];
+
+        double emax = 0.0;
+        for (int i = 0; i < n_grid; i++) {
+            err[i] = gw[i] * (gd[i] - remez_eval(x, b, c, r - 1, gx[i]));
+            emax = fmax(emax, fabs(err[i]));
+        }
+
+        // The nodes are levelled by construction; pin them against rounding
+        for (int k = 0; k < r; k++)
+            err[ext[k]] = (k & 1) ? -delta : delta;
+
+        // Local extrema at least |delta| in size, alternating in sign
+        int n_cand = 0;
+        for (int i = 0; i < n_grid; i++) {
+            double e = err[i];
+            // Band edges only compare with their own band
+            int first = i == 0 || gb[i - 1] != gb[i];
+            int last = i == n_grid - 1 || gb[i + 1] != gb[i];
+            int is_ext = fabs(e) >= fabs(delta)
+                && (first || (e > 0 ? e >= err[i - 1] : e <= err[i - 1]))
+                && (last || (e > 0 ? e >= err[i + 1] : e <= err[i + 1]));
+            if (!is_ext)
+                continue;
+            if (n_cand > 0 && (err[cand[n_cand - 1]] > 0) == (e > 0)) {
+                if (fabs(e) > fabs(err[cand[n_cand - 1]]))
+                    cand[n_cand - 1] = i;
+                continue;
+            }
+            cand[n_cand++] = i;
+        }
+        // Too many: drop the smallest, with an interior one also the smaller
+        // of its neighbours, which then share a sign; one over, an end
+        while (n_cand > r) {
+            int k = 0;
+            for (int j = 1; j < n_cand; j++)
+                if (fabs(err[cand[j]]) < fabs(err[cand[k]]))
+                    k = j;
+            int drop = 1;
+            if (k > 0 && k < n_cand - 1) {
+                if (n_cand - r >= 2) {
+                    drop = 2;
+                    if (fabs(err[cand[k - 1]]) < fabs(err[cand[k + 1]]))
+                        k--;
+                } else {
+                    k = fabs(err[cand[0]]) < fabs(err[cand[n_cand - 1]]) ? 0 : n_cand - 1;
+                }
+            }
+            memmove(cand + k, cand + k + drop, (n_cand - k - drop) * sizeof(int));
+            n_cand -= drop;
+        }
+        if (n_cand < r)
+            goto cleanup;
+
+        int same = 1;
+        for (int k = 0; k < r; k++) {
+            same &= ext[k] == cand[k];
+            ext[k] = cand[k];
+        }
+        if (same || (emax - fabs(delta)) <= REMEZ_TOL * emax)
+            break;
+    }
+
+    // Taps from the amplitude response sampled at 2 pi j / N
+    filter->num_taps = num_taps;
+    for (int k = 0; k < r; k++)
+        x[k] = gx[ext[k]];
+    remez_weights(x, r, b);
+    for (int k = 0; k < r; k++)
+        c[k] = gd[ext[k]] - ((k & 1) ? -1.0 : 1.0) * delta / gw[ext[k]];
+    for (int k = 0; k < r - 1; k++)
+        b[k] *= x[k] - x[r - 1];
+
+    double *amp = err;                  // N <= grid size
+    for (int j = 0; j < num_taps; j++)
+        amp[j] = remez_eval(x, b, c, r - 1, cos(2.0 * M_PI * j / num_taps));
+    for (int n = 0; n <= M; n++) {
+        double sum = amp[0];
+        for (int j = 1; j <= M; j++)
+            sum += 2.0 * amp[j] * cos(2.0 * M_PI * j * (n - M) / num_taps);
+        filter->taps[n] = filter->taps[num_taps - 1 - n] = sum / num_taps;
+    }
+    ret = 0;
+
+cleanup:
+    arena_release(arena, mark);
+    return ret;
+}
+
+int design_fir_remez(const FIRSpec *spec, int num_taps, FIRFilter *filter) {
+    if (!fir_spec_valid(spec) || !filter || num_taps < 3 || num_taps > MAX_FIR_TAPS || !(num_taps & 1)) {
+        fprintf(stderr, "Invalid Remez design parameters.\n");
+        return -1;
+    }
+    if (remez_design(spec, num_taps, filter) != 0) {
+        fprintf(stderr, "Remez exchange did not converge at %d taps.\n", num_taps);
+        return -1;
+    }
+    return 0;
+}
+
+// Measured passband ripple (peak to peak) and stopband attenuation, in dB;
+// 1 if they meet the spec
+int fir_check_spec(const FIRFilter *filter, const FIRSpec *spec, double *ripple_db, double *atten_db) {
+    FIRBand band[3];
+    int n_bands = fir_spec_bands(spec, band);
+    const FIRBand *pass = &band[n_bands == 3 ? 1 : 0];
+    double pmin = INFINITY, pmax = 0.0, smax = 0.0;
+    int n = FIR_CHECK_DENSITY * filter->num_taps;
+    for (int i = 0; i <= n + 2; i++) {
+        // The passband edges too, which the sampling may step over
+        double f = i <= n ? 0.5 * i / n : (i == n + 1 ? pass->lo : pass->hi);
+        int b = 0;
+        while (b < n_bands && !(f >= band[b].lo && f <= band[b].hi))
+            b++;
+        if (b == n_bands)
+            continue;
+        double a = fabs(fir_amplitude(filter->taps, filter->num_taps, 2.0 * M_PI * f));
+        if (&band[b] == pass) {
+            pmin = fmin(pmin, a);
+            pmax = fmax(pmax, a);
+        } else {
+            smax = fmax(smax, a);
+        }
+    }
+
+    double rp = pmin > 0.0 ? 20.0 * log10(pmax / pmin) : INFINITY;
+    double as = smax > 0.0 ? -20.0 * log10(smax) : INFINITY;
+    if (ripple_db) *ripple_db = rp;
+    if (atten_db) *atten_db = as;
+    return rp <= spec->ripple_db && as >= spec->atten_db;
+}
+
+static int fir_design_one(const FIRSpec *spec, FIRDesign method, int num_taps, FIRFilter *filter) {
+    if (method == FIR_DESIGN_KAISER)
+        return design_fir_kaiser(spec, num_taps, filter);
+    return remez_design(spec, num_taps, filter);
+}
+
+// 1 if num_taps of the method meet the spec. *excess is the worse of the
+// measured deviations over the allowed one, infinite without a design
+static int fir_design_meets(const FIRSpec *spec, FIRDesign method, int num_taps, FIRFilter *filter,
+                            double *excess) {
+    *excess = INFINITY;
+    if (fir_design_one(spec, method, num_taps, filter) != 0)
+        return 0;
+    double rp, as, dp, ds;
+    int ok = fir_check_spec(filter, spec, &rp, &as);
+    fir_spec_deltas(spec, &dp, &ds);
+    double g = pow(10.0, rp / 20.0);
+    if (isfinite(g))
+        *excess = fmax((g - 1.0) / (g + 1.0) / dp, pow(10.0, -as / 20.0) / ds);
+    return ok;
+}
+
+// Fewest odd taps, up to max_taps, of one method that meet the spec. The
+// log of the excess falls about linearly with the length, so secant steps
+// on it from the length estimate, Kaiser's slope until there are two
+// points, land within a few taps; bisection takes over after two steps
+// that did not halve the bracket. A longer filter of the same design is taken to
+// meet the spec whenever a shorter one does.
+static int fir_design_search(const FIRSpec *spec, FIRDesign method, int max_taps, FIRFilter *filter) {
+    max_taps = (max_taps - 1) | 1;
+    int n = method == FIR_DESIGN_KAISER ? fir_kaiser_length(spec) : fir_remez_length(spec);
+    if (n < 3)
+        n = 3;
+    if (n > max_taps)
+        n = max_taps;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    FIRFilter *trial = (FIRFilter*)arena_alloc(arena, sizeof(FIRFilter));
+    if (!trial)
+        return -1;
+
+    double slope = -M_LN10 / 20.0 * 14.36 * spec->transition / spec->fs;   // ln excess per tap
+    int lo = 1, hi = 0;                 // lo fails (1 if none tried), hi meets (0 if none)
+    int prev_n = 0, step = 2, slow = 0;
+    double prev_e = INFINITY;
+    for (;;) {
+        int width = hi ? hi - lo : 0;
+        double e;
+        if (fir_design_meets(spec, method, n, trial, &e)) {
+            hi = n;
+            *filter = *trial;
+        } else {
+            lo = n;
+        }
+        if (hi ? hi - lo <= 2 : lo >= max_taps)
+            break;
+
+        slow = width && 2 * (hi - lo) > width ? slow + 1 : 0;
+        if (isfinite(e) && isfinite(prev_e) && e > 0.0 && prev_e > 0.0 && e != prev_e
+            && log(e / prev_e) / (n - prev_n) < 0.0)
+            slope = log(e / prev_e) / (n - prev_n);
+        int next;
+        if (isfinite(e) && e > 0.0 && slow < 2)
+            next = (int)lround(n - log(e) / slope) | 1;
+        else if (hi)
+            next = ((lo + hi) / 2) | 1;
+        else
+            next = lo + (step *= 2);
+        if (next <= lo)
+            next = lo + 2;
+        if (hi && next >= hi)
+            next = hi - 2;
+        if (next > max_taps)
+            next = max_taps;
+        prev_n = n;
+        prev_e = e;
+        n = next;
+    }
+
+    arena_release(arena, mark);
+    return hi ? 0 : -1;
+}
+
+static int fir_design_min_search(const FIRSpec *spec, FIRDesign method, int max_taps, FIRFilter *filter) {
+    if (method != FIR_DESIGN_AUTO) {
+        if (fir_design_search(spec, method, max_taps, filter) != 0) {
+            fprintf(stderr, "No %s design within %d taps meets the spec.\n",
+                    fir_design_name(method), max_taps);
+            return -1;
+        }
+        return 0;
+    }
+
+    FIRFilter kaiser;
+    int have_kaiser = fir_design_search(spec, FIR_DESIGN_KAISER, max_taps, &kaiser) == 0;
+    int have_remez = fir_design_search(spec, FIR_DESIGN_REMEZ, max_taps, filter) == 0;
+    if (have_kaiser && (!have_remez || kaiser.num_taps < filter->num_taps))
+        *filter = kaiser;
+    if (!have_kaiser && !have_remez) {
+        fprintf(stderr, "No design within %d taps meets the spec.\n", max_taps);
+        return -1;
+    }
+    return 0;
+}
+
+static int fir_spec_equal(const FIRSpec *a, const FIRSpec *b) {
+    return a->fs == b->fs && a->f_low == b->f_low && a->f_high == b->f_high
+        && a->transition == b->transition && a->ripple_db == b->ripple_db && a->atten_db == b->atten_db;
+}
+
+// Shortest filter meeting the spec; FIR_DESIGN_AUTO takes the shorter of
+// the two designs. Each spec is searched once, until fir_design_cache_free.
+int design_fir_min(const FIRSpec *spec, FIRDesign method, int max_taps, FIRFilter *filter) {
+    if (!fir_spec_valid(spec) || !filter || max_taps < 3) {
+        fprintf(stderr, "Invalid FIR design parameters.\n");
+        return -1;
+    }
+    if (max_taps > MAX_FIR_TAPS)
+        max_taps = MAX_FIR_TAPS;
+
+    pthread_mutex_lock(&design_lock);
+    FIRDesignEntry *e = design_cache;
+    while (e && (e->method != method || e->max_taps != max_taps || !fir_spec_equal(&e->spec, spec)))
+        e = e->next;
+    int rv = 0;
+    if (e) {
+        *filter = e->filter;
+    } else {
+        rv = fir_design_min_search(spec, method, max_taps, filter);
+        // Without room to keep it the design is still good, just not kept
+        e = rv == 0 ? (FIRDesignEntry*)malloc(sizeof(FIRDesignEntry)) : NULL;
+        if (e) {
+            e->spec = *spec;
+            e->method = method;
+            e->max_taps = max_taps;
+            e->filter = *filter;
+            e->next = design_cache;
+            design_cache = e;
+        }
+    }
+    pthread_mutex_unlock(&design_lock);
+    return rv;
+}
+
+void fir_design_cache_free(void) {
+    pthread_mutex_lock(&design_lock);
+    while (design_cache) {
+        FIRDesignEntry *e = design_cache;
+        design_cache = e->next;
+        free(e);
+    }
+    pthread_mutex_unlock(&design_lock);
+}
+
+const char *fir_design_name(FIRDesign method) {
+    switch (method) {
+        case FIR_DESIGN_KAISER: return "kaiser";
+        case FIR_DESIGN_REMEZ: return "remez";
+        default: return "auto";
+    }
+}
+
+void fir_print_design(const FIRFilter *filter, const FIRSpec *spec) {
+    double rp, as;
+    fir_check_spec(filter, spec, &rp, &as);
+    printf("FIR %s %.0lf-%.0lf Hz: %d taps, ripple %.3lf dB, attenuation %.1lf dB\n",
+           spec->f_low > 0.0 ? "bandpass" : "lowpass", spec->f_low, spec->f_high, filter->num_taps, rp, as);
+}
@@ -0,0 +1,321 @@
+#include "includes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIR_HAVE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FIR_HAVE_NEON 1
+#endif
+
+// Fused two-channel FIR filtering, in place on the DataSample array or on
+// two channel planes. Both channels go through the filter in one sweep and
+// the only state is a history of the last num_taps inputs, so memory is
+// O(taps) and each sample is read and written once. The two layouts differ
+// only in the stride between a channel's samples, so they share one sweep.
+
+// Direct form. Inputs are gathered chunk by chunk into a history buffer of
+// interleaved (ch0, ch1) pairs that carries the last num_taps - 1 inputs
+// over from the previous chunk. Each tap is loaded once for both channels;
+// with symmetric taps the vector kernels compute both channels of one
+// (SSE2, NEON) or two (AVX2) outputs per instruction.
+
+#define DUAL_FIR_CHUNK 512
+
+// w points at the interleaved window of the first output; out gets
+// interleaved (ch0, ch1) pairs
+typedef void (*DualFIRKernel)(const double *w, double *out, int n_out,
+                              const double *taps, int n_taps);
+
+static void dual_fir_scalar(const double *w, double *out, int n_out,
+                            const double *taps, int n_taps) {
+    for (int r = 0; r < n_out; r++, w += 2) {
+        double sum0 = 0.0, sum1 = 0.0;
+        for (int j = 0; j < n_taps; j++) {
+            sum0 += taps[j] * w[2 * j];
+            sum1 += taps[j] * w[2 * j + 1];
+        }
+        out[2 * r] = sum0;
+        out[2 * r + 1] = sum1;
+    }
+}
+
+static void dual_fir_sym_scalar(const double *w, double *out, int n_out,
+                                const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    double center = (n_taps & 1) ? taps[n_pairs] : 0.0;
+
+    for (int r = 0; r < n_out; r++, w += 2) {
+        double sum0 = center * w[2 * n_pairs];
+        double sum1 = center * w[2 * n_pairs + 1];
+        for (int j = 0; j < n_pairs; j++) {
+            const double *hi = w + 2 * (n_taps - 1 - j);
+            sum0 += taps[j] * (w[2 * j] + hi[0]);
+            sum1 += taps[j] * (w[2 * j + 1] + hi[1]);
+        }
+        out[2 * r] = sum0;
+        out[2 * r + 1] = sum1;
+    }
+}
+
+#ifdef FIR_HAVE_X86
+__attribute__((target("sse2")))
+static void dual_fir_sym_sse2(const double *w, double *out, int n_out,
+                              const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    __m128d center = _mm_set1_pd((n_taps & 1) ? taps[n_pairs] : 0.0);
+    int r = 0;
+
+    // Lanes are (ch0, ch1); two outputs per iteration for ILP
+    for (; r + 2 <= n_out; r += 2, w += 4) {
+        __m128d acc0 = _mm_mul_pd(center, _mm_loadu_pd(w + 2 * n_pairs));
+        __m128d acc1 = _mm_mul_pd(center, _mm_loadu_pd(w + 2 * n_pairs + 2));
+        for (int j = 0; j < n_pairs; j++) {
+            __m128d h = _mm_set1_pd(taps[j]);
+            const double *lo = w + 2 * j;
+            const double *hi = w + 2 * (n_taps - 1 - j);
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(h, _mm_add_pd(_mm_loadu_pd(lo), _mm_loadu_pd(hi))));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(h, _mm_add_pd(_mm_loadu_pd(lo + 2), _mm_loadu_pd(hi + 2))));
+        }
+        _mm_storeu_pd(out + 2 * r, acc0);
+        _mm_storeu_pd(out + 2 * r + 2, acc1);
+    }
+    dual_fir_sym_scalar(w, out + 2 * r, n_out - r, taps, n_taps);
+}
+
+__attribute__((target("avx2,fma")))
+static void dual_fir_sym_avx2(const double *w, double *out, int n_out,
+                              const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    __m256d center = _mm256_set1_pd((n_taps & 1) ? taps[n_pairs] : 0.0);
+    int r = 0;
+
+    // Lanes are (ch0, ch1) of outputs r and r + 1; four outputs per iteration
+    for (; r + 4 <= n_out; r += 4, w += 8) {
+        __m256d acc0 = _mm256_mul_pd(center, _mm256_loadu_pd(w + 2 * n_pairs));
+        __m256d acc1 = _mm256_mul_pd(center, _mm256_loadu_pd(w + 2 * n_pairs + 4));
+        for (int j = 0; j < n_pairs; j++) {
+            __m256d h = _mm256_broadcast_sd(taps + j);
+            const double *lo = w + 2 * j;
+            const double *hi = w + 2 * (n_taps - 1 - j);
+            acc0 = _mm256_fmadd_pd(h, _mm256_add_pd(_mm256_loadu_pd(lo), _mm256_loadu_pd(hi)), acc0);
+            acc1 = _mm256_fmadd_pd(h, _mm256_add_pd(_mm256_loadu_pd(lo + 4), _mm256_loadu_pd(hi + 4)), acc1);
+        }
+        _mm_storeu_pd(out + 2 * r, _mm256_castpd256_pd128(acc0));
+        _mm_storeu_pd(out + 2 * r + 2, _mm256_extractf128_pd(acc0, 1));
+        _mm_storeu_pd(out + 2 * r + 4, _mm256_castpd256_pd128(acc1));
+        _mm_storeu_pd(out + 2 * r + 6, _mm256_extractf128_pd(acc1, 1));
+    }
+    dual_fir_sym_scalar(w, out + 2 * r, n_out - r, taps, n_taps);
+}
+#endif
+
+#ifdef FIR_HAVE_NEON
+static void dual_fir_sym_neon(const double *w, double *out, int n_out,
+                              const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    float64x2_t center = vdupq_n_f64((n_taps & 1) ? taps[n_pairs] : 0.0);
+    int r = 0;
+
+    for (; r + 2 <= n_out; r += 2, w += 4) {
+        float64x2_t acc0 = vmulq_f64(center, vld1q_f64(w + 2 * n_pairs));
+        float64x2_t acc1 = vmulq_f64(center, vld1q_f64(w + 2 * n_pairs + 2));
+        for (int j = 0; j < n_pairs; j++) {
+            float64x2_t h = vdupq_n_f64(taps[j]);
+            const double *lo = w + 2 * j;
+            const double *hi = w + 2 * (n_taps - 1 - j);
+            acc0 = vfmaq_f64(acc0, h, vaddq_f64(vld1q_f64(lo), vld1q_f64(hi)));
+            acc1 = vfmaq_f64(acc1, h, vaddq_f64(vld1q_f64(lo + 2), vld1q_f64(hi + 2)));
+        }
+        vst1q_f64(out + 2 * r, acc0);
+        vst1q_f64(out + 2 * r + 2, acc1);
+    }
+    dual_fir_sym_scalar(w, out + 2 * r, n_out - r, taps, n_taps);
+}
+#endif
+
+static DualFIRKernel dual_fir_kernel(int symmetric) {
+    if (!symmetric)
+        return dual_fir_scalar;
+
+    switch (fir_kernel_best()) {
+#ifdef FIR_HAVE_X86
+        case FIR_KERNEL_AVX2: return dual_fir_sym_avx2;
+        case FIR_KERNEL_SSE: return dual_fir_sym_sse2;
+#elif defined(FIR_HAVE_NEON)
+        case FIR_KERNEL_NEON: return dual_fir_sym_neon;
+#endif
+        default: return dual_fir_sym_scalar;
+    }
+}
+
+// Estimated cost per output sample and channel, in scalar multiply-adds
+double filter_dual_fir_cost(const FIRFilter *filter) {
+    if (!fir_is_symmetric(filter))
+        return filter->num_taps;
+    // Same lane count as the single-channel kernel, lanes just span channels
+    return fir_symmetric_cost(filter->num_taps);
+}
+
+// Samples of a channel are stride doubles apart, in x and in y; y may be x
+static int dual_fir_direct(const double *x0, const double *x1, double *y0, double *y1,
+                           int stride, int n_samples, const FIRFilter *filter) {
+    int n_taps = filter->num_taps;
+    int half_len = n_taps / 2;
+    // Output i is complete once input i + lag has been read
+    int lag = n_taps - 1 - half_len;
+    DualFIRKernel kernel = dual_fir_kernel(fir_is_symmetric(filter));
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *hist = (double*)arena_alloc(arena, 2 * (DUAL_FIR_CHUNK + n_taps - 1) * sizeof(double));
+    double *out = (double*)arena_alloc(arena, 2 * DUAL_FIR_CHUNK * sizeof(double));
+    if (!hist || !out) {
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    // Pair k of the history is input i0 - half_len + k for the chunk at i0
+    for (int k = 0; k < n_taps - 1; k++) {
+        int idx = k - half_len;
+        int valid = idx >= 0 && idx < n_samples;
+        hist[2 * k] = valid ? x0[(size_t)idx * stride] : 0.0;
+        hist[2 * k + 1] = valid ? x1[(size_t)idx * stride] : 0.0;
+    }
+
+    for (int i0 = 0; i0 < n_samples; i0 += DUAL_FIR_CHUNK) {
+        int n_out = (n_samples - i0 < DUAL_FIR_CHUNK) ? n_samples - i0 : DUAL_FIR_CHUNK;
+
+        double *in = hist + 2 * (n_taps - 1);
+        for (int r = 0; r < n_out; r++) {
+            int idx = i0 + lag + r;
+            int valid = idx < n_samples;
+            in[2 * r] = valid ? x0[(size_t)idx * stride] : 0.0;
+            in[2 * r + 1] = valid ? x1[(size_t)idx * stride] : 0.0;
+        }
+
+        // Every input these outputs overwrite has already been copied
+        kernel(hist, out, n_out, filter->taps, n_taps);
+        for (int r = 0; r < n_out; r++) {
+            y0[(size_t)(i0 + r) * stride] = out[2 * r];
+            y1[(size_t)(i0 + r) * stride] = out[2 * r + 1];
+        }
+
+        memmove(hist, hist + 2 * n_out, 2 * (n_taps - 1) * sizeof(double));
+    }
+
+    arena_release(arena, mark);
+    return 0;
+}
+
+int filter_dual_fir_direct(DataSample *data, int n_samples, const FIRFilter *filter) {
+    if (!data || !filter || n_samples <= 0 || filter->num_taps <= 0) {
+        fprintf(stderr, "Invalid arguments for filter_dual_fir_direct.\n");
+        return -1;
+    }
+    int stride = sizeof(DataSample) / sizeof(double);
+    return dual_fir_direct(&data->ch0, &data->ch1, &data->ch0, &data->ch1, stride, n_samples, filter);
+}
+
+// Two channel planes; y0, y1 may be x0, x1
+int filter_dual_fir_direct_planar(const double *x0, const double *x1, double *y0, double *y1,
+                                  int n_samples, const FIRFilter *filter) {
+    if (!x0 || !x1 || !y0 || !y1 || !filter || n_samples <= 0 || filter->num_taps <= 0) {
+        fprintf(stderr, "Invalid arguments for filter_dual_fir_direct_planar.\n");
+        return -1;
+    }
+    return dual_fir_direct(x0, x1, y0, y1, 1, n_samples, filter);
+}
+
+// Overlap-save form. ch0 and ch1 are packed into the real and imaginary
+// parts of one complex block, so a single FFT pair filters both channels.
+// The block buffer carries the num_taps - 1 inputs shared with the next
+// block; outputs lag the inputs still to be read, so they can be written
+// back in place.
+static int dual_fir_overlap_save(const double *x0, const double *x1, double *y0, double *y1,
+                                 int stride, int n_samples, const FIRFilter *filter, int fft_len) {
+    int n_taps = filter->num_taps;
+    int half_len = n_taps / 2;
+    int step = fft_len - n_taps + 1;
+
+    FFTPlan *fwd = fft_plan_create(fft_len, 0);
+    FFTPlan *inv = fft_plan_create(fft_len, 1);
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *h_spec = (double complex*)arena_alloc(arena, fft_len * sizeof(double complex));
+    double complex *block = (double complex*)arena_alloc(arena, fft_len * sizeof(double complex));
+    double complex *spec = (double complex*)arena_alloc(arena, fft_len * sizeof(double complex));
+    double complex *out = (double complex*)arena_alloc(arena, fft_len * sizeof(double complex));
+    int rv = 0;
+
+    if (!fwd || !inv || !h_spec || !block || !spec || !out) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        rv = -1;
+        goto cleanup;
+    }
+
+    for (int k = 0; k < fft_len; k++)
+        block[k] = (k < n_taps) ? filter->taps[n_taps - 1 - k] / fft_len : 0.0;
+    if (fft_execute(fwd, block, h_spec) != 0) {
+        rv = -1;
+        goto cleanup;
+    }
+
+    // First block covers inputs [-half_len, fft_len - half_len)
+    for (int t = 0; t < fft_len; t++) {
+        int idx = t - half_len;
+        block[t] = (idx >= 0 && idx < n_samples) ? x0[(size_t)idx * stride] + I * x1[(size_t)idx * stride] : 0.0;
+    }
+
+    for (int i0 = 0; i0 < n_samples; i0 += step) {
+        if (fft_execute(fwd, block, spec) != 0) {
+            rv = -1;
+            goto cleanup;
+        }
+        for (int k = 0; k < fft_len; k++)
+            spec[k] *= h_spec[k];
+        if (fft_execute(inv, spec, out) != 0) {
+            rv = -1;
+            goto cleanup;
+        }
+
+        int n_out = (n_samples - i0 < step) ? n_samples - i0 : step;
+        const double complex *valid = out + n_taps - 1;
+        for (int t = 0; t < n_out; t++) {
+            y0[(size_t)(i0 + t) * stride] = creal(valid[t]);
+            y1[(size_t)(i0 + t) * stride] = cimag(valid[t]);
+        }
+
+        // Slide: keep the overlap, read the next step inputs
+        memmove(block, block + step, (n_taps - 1) * sizeof(double complex));
+        int next = i0 + step - half_len + n_taps - 1;
+        for (int t = 0; t < step; t++) {
+            int idx = next + t;
+            block[n_taps - 1 + t] = (idx < n_samples) ? x0[(size_t)idx * stride] + I * x1[(size_t)idx * stride] : 0.0;
+        }
+    }
+
+cleanup:
+    fft_plan_destroy(fwd);
+    fft_plan_destroy(inv);
+    arena_release(arena, mark);
+    return rv;
+}
+
+int filter_dual_fir_overlap_save(DataSample *data, int n_samples, const FIRFilter *filter, int fft_len) {
+    if (!data || !filter || n_samples <= 0 || fft_len < filter->num_taps) {
+        fprintf(stderr, "Invalid arguments for filter_dual_fir_overlap_save.\n");
+        return -1;
+    }
+    int stride = sizeof(DataSample) / sizeof(double);
+    return dual_fir_overlap_save(&data->ch0, &data->ch1, &data->ch0, &data->ch1, stride, n_samples, filter, fft_len);
+}
+
+int filter_dual_fir_overlap_save_planar(const double *x0, const double *x1, double *y0, double *y1,
+                                        int n_samples, const FIRFilter *filter, int fft_len) {
+    if (!x0 || !x1 || !y0 || !y1 || !filter || n_samples <= 0 || fft_len < filter->num_taps) {
+        fprintf(stderr, "Invalid arguments for filter_dual_fir_overlap_save_planar.\n");
+        return -1;
+    }
+    return dual_fir_overlap_save(x0, x1, y0, y1, 1, n_samples, filter, fft_len);
+}
@@ -0,0 +1,268 @@
+#include "includes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIR_HAVE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FIR_HAVE_NEON 1
+#endif
+
+// Linear-phase FIR kernels.
+// Symmetric taps let each pair of samples that share a coefficient be added
+// before the multiply, halving the multiplies. The output range is split
+// into a prologue and an epilogue, where the window hangs off the ends of the
+// signal and is bounds-checked, and a steady state where every index is valid
+// and the inner loop runs without branches. The steady state has scalar,
+// SSE2, AVX2/FMA and NEON versions, chosen at run time.
+
+#define FIR_SYMMETRY_TOL 1e-12
+
+typedef void (*FIRSymKernel)(const double *x, double *y, int i_begin, int i_end,
+                             const double *taps, int n_taps);
+
+// Taps equal to their mirror image within a relative tolerance
+int fir_is_symmetric(const FIRFilter *filter) {
+    if (!filter || filter->num_taps <= 0)
+        return 0;
+
+    int n_taps = filter->num_taps;
+    double max_abs = 0.0;
+    for (int j = 0; j < n_taps; j++)
+        max_abs = fmax(max_abs, fabs(filter->taps[j]));
+
+    for (int j = 0; j < n_taps / 2; j++)
+        if (fabs(filter->taps[j] - filter->taps[n_taps - 1 - j]) > FIR_SYMMETRY_TOL * max_abs)
+            return 0;
+
+    return 1;
+}
+
+// Window of output i starts at x[i - n_taps / 2], as in filter_fir
+static double fir_sym_edge(const double *x, int n_samples, int i, const double *taps, int n_taps) {
+    int start = i - n_taps / 2;
+    int n_pairs = n_taps / 2;
+    double sum = 0.0;
+
+    for (int j = 0; j < n_pairs; j++) {
+        int lo = start + j;
+        int hi = start + n_taps - 1 - j;
+        double pair = 0.0;
+        if (lo >= 0 && lo < n_samples) pair += x[lo];
+        if (hi >= 0 && hi < n_samples) pair += x[hi];
+        sum += taps[j] * pair;
+    }
+    if (n_taps & 1) {
+        int mid = start + n_pairs;
+        if (mid >= 0 && mid < n_samples)
+            sum += taps[n_pairs] * x[mid];
+    }
+    return sum;
+}
+
+static void fir_sym_scalar(const double *x, double *y, int i_begin, int i_end,
+                           const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    double center = (n_taps & 1) ? taps[n_pairs] : 0.0;
+
+    for (int i = i_begin; i < i_end; i++) {
+        const double *w = x + i - n_taps / 2;
+        double sum = center * w[n_pairs];
+        for (int j = 0; j < n_pairs; j++)
+            sum += taps[j] * (w[j] + w[n_taps - 1 - j]);
+        y[i] = sum;
+    }
+}
+
+#ifdef FIR_HAVE_X86
+__attribute__((target("sse2")))
+static void fir_sym_sse2(const double *x, double *y, int i_begin, int i_end,
+                         const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    double center = (n_taps & 1) ? taps[n_pairs] : 0.0;
+    int i = i_begin;
+
+    // Two outputs per iteration
+    for (; i + 2 <= i_end; i += 2) {
+        const double *w = x + i - n_taps / 2;
+        __m128d acc = _mm_mul_pd(_mm_set1_pd(center), _mm_loadu_pd(w + n_pairs));
+        for (int j = 0; j < n_pairs; j++) {
+            __m128d pair = _mm_add_pd(_mm_loadu_pd(w + j), _mm_loadu_pd(w + n_taps - 1 - j));
+            acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(taps[j]), pair));
+        }
+        _mm_storeu_pd(y + i, acc);
+    }
+    fir_sym_scalar(x, y, i, i_end, taps, n_taps);
+}
+
+__attribute__((target("avx2,fma")))
+static void fir_sym_avx2(const double *x, double *y, int i_begin, int i_end,
+                         const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    __m256d center = _mm256_set1_pd((n_taps & 1) ? taps[n_pairs] : 0.0);
+    int i = i_begin;
+
+    // Eight outputs per iteration in two independent accumulators
+    for (; i + 8 <= i_end; i += 8) {
+        const double *w = x + i - n_taps / 2;
+        __m256d acc0 = _mm256_mul_pd(center, _mm256_loadu_pd(w + n_pairs));
+        __m256d acc1 = _mm256_mul_pd(center, _mm256_loadu_pd(w + n_pairs + 4));
+        for (int j = 0; j < n_pairs; j++) {
+            __m256d h = _mm256_broadcast_sd(taps + j);
+            const double *lo = w + j;
+            const double *hi = w + n_taps - 1 - j;
+            acc0 = _mm256_fmadd_pd(h, _mm256_add_pd(_mm256_loadu_pd(lo), _mm256_loadu_pd(hi)), acc0);
+            acc1 = _mm256_fmadd_pd(h, _mm256_add_pd(_mm256_loadu_pd(lo + 4), _mm256_loadu_pd(hi + 4)), acc1);
+        }
+        _mm256_storeu_pd(y + i, acc0);
+        _mm256_storeu_pd(y + i + 4, acc1);
+    }
+    for (; i + 4 <= i_end; i += 4) {
+        const double *w = x + i - n_taps / 2;
+        __m256d acc = _mm256_mul_pd(center, _mm256_loadu_pd(w + n_pairs));
+        for (int j = 0; j < n_pairs; j++) {
+            __m256d pair = _mm256_add_pd(_mm256_loadu_pd(w + j), _mm256_loadu_pd(w + n_taps - 1 - j));
+            acc = _mm256_fmadd_pd(_mm256_broadcast_sd(taps + j), pair, acc);
+        }
+        _mm256_storeu_pd(y + i, acc);
+    }
+    fir_sym_scalar(x, y, i, i_end, taps, n_taps);
+}
+#endif
+
+#ifdef FIR_HAVE_NEON
+static void fir_sym_neon(const double *x, double *y, int i_begin, int i_end,
+                         const double *taps, int n_taps) {
+    int n_pairs = n_taps / 2;
+    float64x2_t center = vdupq_n_f64((n_taps & 1) ? taps[n_pairs] : 0.0);
+    int i = i_begin;
+
+    // Four outputs per iteration in two independent accumulators
+    for (; i + 4 <= i_end; i += 4) {
+        const double *w = x + i - n_taps / 2;
+        float64x2_t acc0 = vmulq_f64(center, vld1q_f64(w + n_pairs));
+        float64x2_t acc1 = vmulq_f64(center, vld1q_f64(w + n_pairs + 2));
+        for (int j = 0; j < n_pairs; j++) {
+            float64x2_t h = vdupq_n_f64(taps[j]);
+            const double *lo = w + j;
+            const double *hi = w + n_taps - 1 - j;
+            acc0 = vfmaq_f64(acc0, h, vaddq_f64(vld1q_f64(lo), vld1q_f64(hi)));
+            acc1 = vfmaq_f64(acc1, h, vaddq_f64(vld1q_f64(lo + 2), vld1q_f64(hi + 2)));
+        }
+        vst1q_f64(y + i, acc0);
+        vst1q_f64(y + i + 2, acc1);
+    }
+    fir_sym_scalar(x, y, i, i_end, taps, n_taps);
+}
+#endif
+
+// Widest kernel this CPU can run
+FIRKernel fir_kernel_best(void) {
+#ifdef FIR_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return FIR_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return FIR_KERNEL_SSE;
+#elif defined(FIR_HAVE_NEON)
+    return FIR_KERNEL_NEON;
+#endif
+    return FIR_KERNEL_SCALAR;
+}
+
+// Output samples computed per vector instruction
+int fir_kernel_lanes(FIRKernel kernel) {
+    switch (kernel) {
+        case FIR_KERNEL_AVX2: return 4;
+        case FIR_KERNEL_SSE:
+        case FIR_KERNEL_NEON: return 2;
+        default: return 1;
+    }
+}
+
+const char *fir_kernel_name(FIRKernel kernel) {
+    switch (kernel) {
+        case FIR_KERNEL_AVX2: return "avx2";
+        case FIR_KERNEL_SSE: return "sse2";
+        case FIR_KERNEL_NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+// NULL when the kernel is not available on this CPU
+static FIRSymKernel fir_sym_kernel(FIRKernel kernel) {
+    FIRKernel best = fir_kernel_best();
+    if (kernel == FIR_KERNEL_AUTO)
+        kernel = best;
+
+    switch (kernel) {
+        case FIR_KERNEL_SCALAR: return fir_sym_scalar;
+#ifdef FIR_HAVE_X86
+        case FIR_KERNEL_SSE: return (best != FIR_KERNEL_SCALAR) ? fir_sym_sse2 : NULL;
+        case FIR_KERNEL_AVX2: return (best == FIR_KERNEL_AVX2) ? fir_sym_avx2 : NULL;
+#elif defined(FIR_HAVE_NEON)
+        case FIR_KERNEL_NEON: return fir_sym_neon;
+#endif
+        default: return NULL;
+    }
+}
+
+int fir_kernel_available(FIRKernel kernel) {
+    return fir_sym_kernel(kernel) != NULL;
+}
+
+// Estimated cost per output sample, in scalar multiply-adds, used to decide
+// between this kernel and overlap-save
+double fir_symmetric_cost(int num_taps) {
+    return (double)(num_taps / 2 + 1) / fir_kernel_lanes(fir_kernel_best());
+}
+
+// Same output alignment as filter_fir. Fails if the taps are not symmetric
+// or the requested kernel is not available on this CPU.
+int filter_fir_symmetric(double *data, int n_samples, const FIRFilter *filter, FIRKernel kernel) {
+    if (!data || !filter || n_samples <= 0 || !fir_is_symmetric(filter))
+        return -1;
+
+    FIRSymKernel steady = fir_sym_kernel(kernel);
+    if (!steady)
+        return -1;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *temp = (double*)arena_alloc(arena, n_samples * sizeof(double));
+    if (!temp)
+        return -1;
+
+    int n_taps = filter->num_taps;
+    int half_len = n_taps / 2;
+
+    // Outputs whose whole window lies inside the signal
+    int i_begin = half_len;
+    int i_end = n_samples - n_taps + 1 + half_len;
+    if (i_end < i_begin)
+        i_begin = i_end = n_samples;
+
+    for (int i = 0; i < i_begin; i++)
+        temp[i] = fir_sym_edge(data, n_samples, i, filter->taps, n_taps);
+    steady(data, temp, i_begin, i_end, filter->taps, n_taps);
+    for (int i = i_end; i < n_samples; i++)
+        temp[i] = fir_sym_edge(data, n_samples, i, filter->taps, n_taps);
+
+    memcpy(data, temp, n_samples * sizeof(double));
+    arena_release(arena, mark);
+    return 0;
+}
+
+// y[k] = sum_j taps[j] * w[k + j] for k < n_out, every index of w valid.
+// Used by the streaming filter, whose history buffer holds the whole window.
+int fir_symmetric_window(const double *w, double *y, int n_out, const FIRFilter *filter, FIRKernel kernel) {
+    if (!w || !y || !filter || n_out <= 0 || !fir_is_symmetric(filter))
+        return -1;
+
+    FIRSymKernel steady = fir_sym_kernel(kernel);
+    if (!steady)
+        return -1;
+
+    steady(w + filter->num_taps / 2, y, 0, n_out, filter->taps, filter->num_taps);
+    return 0;
+}
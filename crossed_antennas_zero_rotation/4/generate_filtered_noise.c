@@ -1,4 +1,5 @@
 #include "includes.h"
+#include <time.h>
 
 
 // White noise generator [-1..1]
@@ -10,19 +11,26 @@ double white_noise() {
 void generate_filtered_noise(DataSample *data, int n_samples, double fs, const FIRFilter *filter) {
     srand(time(NULL));
 
-    double ch0[n_samples], ch1[n_samples];
-
     for (int i = 0; i < n_samples; i++) {
         data[i].time = (double)i / fs;
-        ch0[i] = white_noise();
-        ch1[i] = white_noise();
+        data[i].ch0 = white_noise();
+        data[i].ch1 = white_noise();
     }
 
-    filter_fir(ch0, n_samples, filter);
-    filter_fir(ch1, n_samples, filter);
+    filter_data(data, n_samples, filter);
+}
 
-    for (int i = 0; i < n_samples; i++) {
-        data[i].ch0 = ch0[i];
-        data[i].ch1 = ch1[i];
+void generate_filtered_noise_capture(Capture *cap, double fs, const FIRFilter *filter) {
+    srand(time(NULL));
+
+    cap->fs = fs;
+    cap->t0 = 0.0;
+    for (int i = 0; i < cap->n_samples; i++) {
+        if (cap->time)
+            cap->time[i] = (double)i / fs;
+        for (int c = 0; c < cap->n_channels; c++)
+            cap->ch[c][i] = white_noise();
     }
+
+    filter_capture(cap, filter);
 }
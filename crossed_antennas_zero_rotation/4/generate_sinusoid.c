@@ -43,3 +43,37 @@ void generate_sinusoid(DataSample *data, int n_samples,
         }
     }
 }
+
+// Capture variant: channel 0 and 1 get their own amplitude, the time base
+// becomes implicit at the given rate
+void generate_sinusoid_capture(Capture *cap,
+                               double amplitude_ch0, double amplitude_ch1,
+                               double frequency_hz, double sampling_rate_hz)
+{
+    if (!cap || cap->n_channels < 2 || cap->n_samples <= 0 || sampling_rate_hz <= 0) {
+        fprintf(stderr, "Invalid arguments provided.\n");
+        return;
+    }
+
+    int n_samples = cap->n_samples;
+    cap->fs = sampling_rate_hz;
+    cap->t0 = 0.0;
+    if (cap->time)
+        for (int i = 0; i < n_samples; i++)
+            cap->time[i] = (double)i / sampling_rate_hz;
+
+    if (frequency_hz < 0) {
+        printf("[DEBUG] Negative frequency provided (%.2f Hz). Clearing data array.\n", frequency_hz);
+        for (int c = 0; c < cap->n_channels; c++)
+            memset(cap->ch[c], 0, n_samples * sizeof(double));
+    } else {
+        printf("[DEBUG] Adding sinusoid: frequency = %.2f Hz, amplitudes CH0 = %.2f, CH1 = %.2f\n",
+               frequency_hz, amplitude_ch0, amplitude_ch1);
+
+        for (int i = 0; i < n_samples; i++) {
+            double s = sin(2 * M_PI * frequency_hz * i / sampling_rate_hz);
+            cap->ch[0][i] += amplitude_ch0 * s;
+            cap->ch[1][i] += amplitude_ch1 * s;
+        }
+    }
+}
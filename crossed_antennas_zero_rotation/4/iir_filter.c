@@ -0,0 +1,152 @@
+#include "includes.h"
+
+// Butterworth bandpass as a cascade of second-order sections.
+// The order-N analog lowpass prototype has its poles on the unit circle;
+// the lowpass-to-bandpass transform turns each into two poles around the
+// prewarped centre W0 = sqrt(W1 * W2), and the bilinear transform maps the
+// resulting N quadratics to N digital biquads. Every section has one zero
+// at DC and one at Nyquist and the numerator BW * s, so the cascade has unit
+// gain at the centre frequency. Sections run in transposed direct form II,
+// five multiplies per section per sample, with the state kept between calls.
+
+// Prototype order for atten_db of rejection at f_stop, outside [f_low, f_high]
+int butterworth_bandpass_order(double fs, double f_low, double f_high, double f_stop, double atten_db) {
+    if (fs <= 0.0 || f_low <= 0.0 || f_low >= f_high || f_high >= fs / 2.0
+        || f_stop <= 0.0 || f_stop >= fs / 2.0 || (f_stop >= f_low && f_stop <= f_high) || atten_db <= 0.0) {
+        fprintf(stderr, "Invalid bandpass order parameters.\n");
+        return -1;
+    }
+
+    double W1 = tan(M_PI * f_low / fs);
+    double W2 = tan(M_PI * f_high / fs);
+    double Ws = tan(M_PI * f_stop / fs);
+    double ratio = fabs(Ws * Ws - W1 * W2) / (Ws * (W2 - W1));
+    double n = log10(pow(10.0, atten_db / 10.0) - 1.0) / (2.0 * log10(ratio));
+    return (int)ceil(n);
+}
+
+// Digital biquad from the analog section BW * s / (s^2 + c1 * s + c0),
+// with s = (1 - z^-1) / (1 + z^-1)
+static void sos_bilinear(Biquad *q, double bw, double c1, double c0) {
+    double a0 = 1.0 + c1 + c0;
+    q->b0 = bw / a0;
+    q->b1 = 0.0;
+    q->b2 = -bw / a0;
+    q->a1 = (2.0 * c0 - 2.0) / a0;
+    q->a2 = (1.0 - c1 + c0) / a0;
+}
+
+int design_butterworth_bandpass(double fs, double f_low, double f_high, int order, SOSFilter *sos) {
+    if (!sos || fs <= 0.0 || f_low <= 0.0 || f_low >= f_high || f_high >= fs / 2.0
+        || order < 1 || order > SOS_MAX_SECTIONS) {
+        fprintf(stderr, "Invalid bandpass parameters.\n");
+        return -1;
+    }
+
+    double W1 = tan(M_PI * f_low / fs);
+    double W2 = tan(M_PI * f_high / fs);
+    double bw = W2 - W1;
+    double w0_sq = W1 * W2;
+
+    memset(sos, 0, sizeof(*sos));
+    int s = 0;
+    for (int k = 0; k < (order + 1) / 2; k++) {
+        // Prototype poles in the upper half plane, and the real pole if N is odd
+        double complex p = cexp(I * M_PI * (2.0 * k + order + 1) / (2.0 * order));
+        if (2 * k + 1 == order) {
+            sos_bilinear(&sos->s[s++], bw, bw, w0_sq);
+            continue;
+        }
+
+        // s^2 - p * bw * s + W0^2 = 0 gives the two bandpass poles of p
+        double complex pb = p * bw;
+        double complex root = csqrt(pb * pb - 4.0 * w0_sq);
+        double complex q[2] = { (pb + root) / 2.0, (pb - root) / 2.0 };
+        for (int j = 0; j < 2; j++)
+            sos_bilinear(&sos->s[s++], bw, -2.0 * creal(q[j]), creal(q[j] * conj(q[j])));
+    }
+    sos->n_sections = s;
+    return 0;
+}
+
+void sos_reset(SOSFilter *sos) {
+    memset(sos->z, 0, sizeof(sos->z));
+}
+
+// The delay lines as a vector of 2 * n_sections values, section by section
+void sos_get_state(const SOSFilter *sos, double *v) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        v[2 * s] = sos->z[s][0];
+        v[2 * s + 1] = sos->z[s][1];
+    }
+}
+
+void sos_set_state(SOSFilter *sos, const double *v) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        sos->z[s][0] = v[2 * s];
+        sos->z[s][1] = v[2 * s + 1];
+    }
+}
+
+// In place, section by section over the block
+void sos_process(SOSFilter *sos, double *x, int n) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        double b0 = q->b0, b1 = q->b1, b2 = q->b2, a1 = q->a1, a2 = q->a2;
+        double z0 = sos->z[s][0], z1 = sos->z[s][1];
+        for (int i = 0; i < n; i++) {
+            double in = x[i];
+            double out = b0 * in + z0;
+            z0 = b1 * in - a1 * out + z1;
+            z1 = b2 * in - a2 * out;
+            x[i] = out;
+        }
+        sos->z[s][0] = z0;
+        sos->z[s][1] = z1;
+    }
+}
+
+// sos_process from x[n - 1] down to x[0]
+void sos_process_reverse(SOSFilter *sos, double *x, int n) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        double b0 = q->b0, b1 = q->b1, b2 = q->b2, a1 = q->a1, a2 = q->a2;
+        double z0 = sos->z[s][0], z1 = sos->z[s][1];
+        for (int i = n - 1; i >= 0; i--) {
+            double in = x[i];
+            double out = b0 * in + z0;
+            z0 = b1 * in - a1 * out + z1;
+            z1 = b2 * in - a2 * out;
+            x[i] = out;
+        }
+        sos->z[s][0] = z0;
+        sos->z[s][1] = z1;
+    }
+}
+
+// Complex gain at f Hz
+double complex sos_response(const SOSFilter *sos, double f, double fs) {
+    double complex z1 = cexp(-I * 2.0 * M_PI * f / fs);
+    double complex z2 = z1 * z1;
+    double complex h = 1.0;
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        h *= (q->b0 + q->b1 * z1 + q->b2 * z2) / (1.0 + q->a1 * z1 + q->a2 * z2);
+    }
+    return h;
+}
+
+// Causal filtering of every channel, each from rest: long captures
+// block-parallel, shorter ones with the channels in SIMD lanes
+void filter_capture_sos(Capture *cap, const SOSFilter *sos) {
+    SOSFilter chan[CAPTURE_MAX_CHANNELS];
+    for (int c = 0; c < cap->n_channels; c++) {
+        chan[c] = *sos;
+        sos_reset(&chan[c]);
+    }
+    if (sos_parallel_threads(cap->n_samples, 0) <= 1
+        && sos_process_lanes(chan, cap->ch, cap->n_channels, cap->n_samples, 0) == 0)
+        return;
+    for (int c = 0; c < cap->n_channels; c++)
+        sos_process_parallel(&chan[c], cap->ch[c], cap->n_samples, 0);
+}
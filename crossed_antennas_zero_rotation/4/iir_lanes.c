@@ -0,0 +1,246 @@
+#include "includes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOS_HAVE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SOS_HAVE_NEON 1
+#endif
+
+// Multichannel cascade filtering with signals in SIMD lanes.
+// The biquad recursion cannot be vectorized along time, but the same
+// coefficients run over both channels of every capture. Up to
+// SOS_LANES_MAX signals of equal length are interleaved chunk by chunk,
+// one signal per lane, and advanced together: every vector instruction
+// steps one sample of two (SSE2, NEON) or four (AVX2) independent
+// recursions, and the groups of lanes are independent chains the CPU
+// overlaps. Lanes past the last signal are padded with silence.
+
+#define SOS_LANES_CHUNK 256
+
+// buf holds n samples of lanes interleaved signals; z is [section][2][lanes]
+typedef void (*SOSLanesKernel)(const SOSFilter *sos, double *buf, int n, int lanes, double *z);
+
+static void sos_lanes_scalar(const SOSFilter *sos, double *buf, int n, int lanes, double *z) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        double *z0 = z + 2 * s * lanes;
+        double *z1 = z0 + lanes;
+        for (int i = 0; i < n; i++) {
+            double *x = buf + i * lanes;
+            for (int l = 0; l < lanes; l++) {
+                double in = x[l];
+                double out = q->b0 * in + z0[l];
+                z0[l] = q->b1 * in - q->a1 * out + z1[l];
+                z1[l] = q->b2 * in - q->a2 * out;
+                x[l] = out;
+            }
+        }
+    }
+}
+
+#ifdef SOS_HAVE_X86
+__attribute__((target("sse2")))
+static void sos_lanes_sse2(const SOSFilter *sos, double *buf, int n, int lanes, double *z) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        __m128d b0 = _mm_set1_pd(q->b0), b1 = _mm_set1_pd(q->b1), b2 = _mm_set1_pd(q->b2);
+        __m128d a1 = _mm_set1_pd(q->a1), a2 = _mm_set1_pd(q->a2);
+        double *zs = z + 2 * s * lanes;
+        for (int l = 0; l < lanes; l += 2) {
+            __m128d z0 = _mm_loadu_pd(zs + l);
+            __m128d z1 = _mm_loadu_pd(zs + lanes + l);
+            for (int i = 0; i < n; i++) {
+                double *x = buf + i * lanes + l;
+                __m128d in = _mm_loadu_pd(x);
+                __m128d out = _mm_add_pd(_mm_mul_pd(b0, in), z0);
+                z0 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, in), _mm_mul_pd(a1, out)), z1);
+                z1 = _mm_sub_pd(_mm_mul_pd(b2, in), _mm_mul_pd(a2, out));
+                _mm_storeu_pd(x, out);
+            }
+            _mm_storeu_pd(zs + l, z0);
+            _mm_storeu_pd(zs + lanes + l, z1);
+        }
+    }
+}
+
+// Lanes a multiple of 4; eight lanes run as two interleaved chains
+__attribute__((target("avx2,fma")))
+static void sos_lanes_avx2(const SOSFilter *sos, double *buf, int n, int lanes, double *z) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        __m256d b0 = _mm256_set1_pd(q->b0), b1 = _mm256_set1_pd(q->b1), b2 = _mm256_set1_pd(q->b2);
+        __m256d a1 = _mm256_set1_pd(q->a1), a2 = _mm256_set1_pd(q->a2);
+        double *zs = z + 2 * s * lanes;
+        int l = 0;
+        for (; l + 8 <= lanes; l += 8) {
+            __m256d z0a = _mm256_loadu_pd(zs + l), z0b = _mm256_loadu_pd(zs + l + 4);
+            __m256d z1a = _mm256_loadu_pd(zs + lanes + l), z1b = _mm256_loadu_pd(zs + lanes + l + 4);
+            for (int i = 0; i < n; i++) {
+                double *x = buf + i * lanes + l;
+                __m256d ina = _mm256_loadu_pd(x), inb = _mm256_loadu_pd(x + 4);
+                __m256d outa = _mm256_fmadd_pd(b0, ina, z0a);
+                __m256d outb = _mm256_fmadd_pd(b0, inb, z0b);
+                z0a = _mm256_fnmadd_pd(a1, outa, _mm256_fmadd_pd(b1, ina, z1a));
+                z0b = _mm256_fnmadd_pd(a1, outb, _mm256_fmadd_pd(b1, inb, z1b));
+                z1a = _mm256_fnmadd_pd(a2, outa, _mm256_mul_pd(b2, ina));
+                z1b = _mm256_fnmadd_pd(a2, outb, _mm256_mul_pd(b2, inb));
+                _mm256_storeu_pd(x, outa);
+                _mm256_storeu_pd(x + 4, outb);
+            }
+            _mm256_storeu_pd(zs + l, z0a);
+            _mm256_storeu_pd(zs + l + 4, z0b);
+            _mm256_storeu_pd(zs + lanes + l, z1a);
+            _mm256_storeu_pd(zs + lanes + l + 4, z1b);
+        }
+        for (; l < lanes; l += 4) {
+            __m256d z0 = _mm256_loadu_pd(zs + l);
+            __m256d z1 = _mm256_loadu_pd(zs + lanes + l);
+            for (int i = 0; i < n; i++) {
+                double *x = buf + i * lanes + l;
+                __m256d in = _mm256_loadu_pd(x);
+                __m256d out = _mm256_fmadd_pd(b0, in, z0);
+                z0 = _mm256_fnmadd_pd(a1, out, _mm256_fmadd_pd(b1, in, z1));
+                z1 = _mm256_fnmadd_pd(a2, out, _mm256_mul_pd(b2, in));
+                _mm256_storeu_pd(x, out);
+            }
+            _mm256_storeu_pd(zs + l, z0);
+            _mm256_storeu_pd(zs + lanes + l, z1);
+        }
+    }
+}
+#endif
+
+#ifdef SOS_HAVE_NEON
+static void sos_lanes_neon(const SOSFilter *sos, double *buf, int n, int lanes, double *z) {
+    for (int s = 0; s < sos->n_sections; s++) {
+        const Biquad *q = &sos->s[s];
+        float64x2_t b0 = vdupq_n_f64(q->b0), b1 = vdupq_n_f64(q->b1), b2 = vdupq_n_f64(q->b2);
+        float64x2_t a1 = vdupq_n_f64(q->a1), a2 = vdupq_n_f64(q->a2);
+        double *zs = z + 2 * s * lanes;
+        for (int l = 0; l < lanes; l += 2) {
+            float64x2_t z0 = vld1q_f64(zs + l);
+            float64x2_t z1 = vld1q_f64(zs + lanes + l);
+            for (int i = 0; i < n; i++) {
+                double *x = buf + i * lanes + l;
+                float64x2_t in = vld1q_f64(x);
+                float64x2_t out = vfmaq_f64(z0, b0, in);
+                z0 = vfmsq_f64(vfmaq_f64(z1, b1, in), a1, out);
+                z1 = vfmsq_f64(vmulq_f64(b2, in), a2, out);
+                vst1q_f64(x, out);
+            }
+            vst1q_f64(zs + l, z0);
+            vst1q_f64(zs + lanes + l, z1);
+        }
+    }
+}
+#endif
+
+static SOSLanesKernel sos_lanes_kernel(FIRKernel kernel) {
+    switch (kernel) {
+#ifdef SOS_HAVE_X86
+        case FIR_KERNEL_AVX2: return sos_lanes_avx2;
+        case FIR_KERNEL_SSE: return sos_lanes_sse2;
+#elif defined(SOS_HAVE_NEON)
+        case FIR_KERNEL_NEON: return sos_lanes_neon;
+#endif
+        default: return sos_lanes_scalar;
+    }
+}
+
+// One group of n_sig <= lanes signals
+static void sos_lanes_group(const SOSFilter *coef, SOSFilter *f, double *const *x, int n_sig, int n,
+                            int reverse, SOSLanesKernel kernel, int lanes, double *buf, double *z) {
+    int n_sec = coef->n_sections;
+    memset(z, 0, 2 * n_sec * lanes * sizeof(double));
+    for (int g = 0; g < n_sig; g++) {
+        for (int s = 0; s < n_sec; s++) {
+            z[2 * s * lanes + g] = f[g].z[s][0];
+            z[(2 * s + 1) * lanes + g] = f[g].z[s][1];
+        }
+    }
+
+    // Chunks in processing order; reversed, each is stored back to front
+    for (int i0 = 0; i0 < n; i0 += SOS_LANES_CHUNK) {
+        int len = n - i0 < SOS_LANES_CHUNK ? n - i0 : SOS_LANES_CHUNK;
+        if (n_sig < lanes)
+            memset(buf, 0, (size_t)len * lanes * sizeof(double));
+        for (int g = 0; g < n_sig; g++) {
+            if (reverse) {
+                const double *src = x[g] + n - 1 - i0;
+                for (int i = 0; i < len; i++)
+                    buf[i * lanes + g] = src[-i];
+            } else {
+                const double *src = x[g] + i0;
+                for (int i = 0; i < len; i++)
+                    buf[i * lanes + g] = src[i];
+            }
+        }
+
+        kernel(coef, buf, len, lanes, z);
+
+        for (int g = 0; g < n_sig; g++) {
+            if (reverse) {
+                double *dst = x[g] + n - 1 - i0;
+                for (int i = 0; i < len; i++)
+                    dst[-i] = buf[i * lanes + g];
+            } else {
+                double *dst = x[g] + i0;
+                for (int i = 0; i < len; i++)
+                    dst[i] = buf[i * lanes + g];
+            }
+        }
+    }
+
+    for (int g = 0; g < n_sig; g++) {
+        for (int s = 0; s < n_sec; s++) {
+            f[g].z[s][0] = z[2 * s * lanes + g];
+            f[g].z[s][1] = z[(2 * s + 1) * lanes + g];
+        }
+    }
+}
+
+// n_sig signals of n samples in place, signal k with f[k]'s state, which is
+// updated. All run with f[0]'s coefficients; reverse runs from x[n - 1] down.
+int sos_process_lanes(SOSFilter *f, double *const *x, int n_sig, int n, int reverse) {
+    if (!f || !x || n_sig < 0 || n < 0 || f[0].n_sections > SOS_MAX_SECTIONS) {
+        fprintf(stderr, "Invalid arguments for sos_process_lanes.\n");
+        return -1;
+    }
+    if (n_sig == 0 || n == 0)
+        return 0;
+
+    FIRKernel best = fir_kernel_best();
+    SOSLanesKernel kernel = sos_lanes_kernel(best);
+    int width = kernel == sos_lanes_scalar ? 1 : fir_kernel_lanes(best);
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *buf = (double*)arena_alloc(arena, SOS_LANES_CHUNK * SOS_LANES_MAX * sizeof(double));
+    double *z = (double*)arena_alloc(arena, 2 * SOS_MAX_SECTIONS * SOS_LANES_MAX * sizeof(double));
+    if (!buf || !z) {
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    for (int k = 0; k < n_sig; k += SOS_LANES_MAX) {
+        int n_group = n_sig - k < SOS_LANES_MAX ? n_sig - k : SOS_LANES_MAX;
+        if (n_group == 1) {
+            // Lone signal: the plain kernel, without the interleaving
+            SOSFilter one = f[0];
+            memcpy(one.z, f[k].z, sizeof(one.z));
+            if (reverse)
+                sos_process_reverse(&one, x[k], n);
+            else
+                sos_process(&one, x[k], n);
+            memcpy(f[k].z, one.z, sizeof(one.z));
+            continue;
+        }
+        int lanes = (n_group + width - 1) / width * width;
+        sos_lanes_group(&f[0], &f[k], x + k, n_group, n, reverse, kernel, lanes, buf, z);
+    }
+
+    arena_release(arena, mark);
+    return 0;
+}
@@ -0,0 +1,244 @@
+#include "includes.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Time-parallel cascade filtering.
+// The recursion is linear in its state, so a block filtered from rest
+// differs from the serial result only by the zero-input response of the
+// state the serial filter would have had at the block's start. Blocks are
+// filtered concurrently from rest, each recording the state it ends in and
+// the state-transition matrix A^L of its length; a serial scan then carries
+// the true state across the boundaries, s[k + 1] = e[k] + A^L[k] s[k]; and
+// each block, again concurrently, adds the zero-input response of its true
+// starting state. That response dies out like the impulse response, so the
+// fix-up stops after the first few thousand samples of each block and the
+// total work stays close to one serial pass.
+
+#define SOS_PARALLEL_MAX_THREADS 64
+#define SOS_PARALLEL_MIN_BLOCK (1 << 16)  // fewer samples per thread run serially
+#define SOS_FIXUP_EPS 1e-17                // carried state negligible, relative to its start
+#define SOS_FIXUP_CHECK 64                 // samples between decay checks
+
+typedef struct {
+    const SOSFilter *sos;               // coefficients; block 0 also its state
+    const double *step;                 // one-sample transition matrix, p x p
+    double *x;
+    int n;
+    int reverse;
+    int first;                          // block 0 starts from sos's state
+    double start[2 * SOS_MAX_SECTIONS]; // true starting state, from the scan
+    double end[2 * SOS_MAX_SECTIONS];   // end state of the pass from rest
+    double trans[4 * SOS_MAX_SECTIONS * SOS_MAX_SECTIONS];  // step^n
+    void *(*fn)(void*);                 // pass run by a started thread
+} SOSBlock;
+
+// c = a * b for p x p row-major matrices; c may not alias a or b
+static void mat_mul(const double *a, const double *b, double *c, int p) {
+    for (int i = 0; i < p; i++) {
+        for (int j = 0; j < p; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < p; k++)
+                sum += a[i * p + k] * b[k * p + j];
+            c[i * p + j] = sum;
+        }
+    }
+}
+
+// out = a^e by repeated squaring
+static void mat_pow(const double *a, int e, double *out, int p) {
+    double base[4 * SOS_MAX_SECTIONS * SOS_MAX_SECTIONS];
+    double tmp[4 * SOS_MAX_SECTIONS * SOS_MAX_SECTIONS];
+    memcpy(base, a, (size_t)p * p * sizeof(double));
+    memset(out, 0, (size_t)p * p * sizeof(double));
+    for (int i = 0; i < p; i++)
+        out[i * p + i] = 1.0;
+
+    while (e > 0) {
+        if (e & 1) {
+            mat_mul(out, base, tmp, p);
+            memcpy(out, tmp, (size_t)p * p * sizeof(double));
+        }
+        e >>= 1;
+        if (e) {
+            mat_mul(base, base, tmp, p);
+            memcpy(base, tmp, (size_t)p * p * sizeof(double));
+        }
+    }
+}
+
+// Column k: the state one zero-input sample after unit state k
+static void sos_step_matrix(const SOSFilter *sos, double *a) {
+    int p = 2 * sos->n_sections;
+    double v[2 * SOS_MAX_SECTIONS];
+    for (int k = 0; k < p; k++) {
+        SOSFilter f = *sos;
+        double zero = 0.0;
+        memset(v, 0, p * sizeof(double));
+        v[k] = 1.0;
+        sos_set_state(&f, v);
+        sos_process(&f, &zero, 1);
+        sos_get_state(&f, v);
+        for (int i = 0; i < p; i++)
+            a[i * p + k] = v[i];
+    }
+}
+
+static void *sos_block_filter(void *arg) {
+    SOSBlock *b = (SOSBlock*)arg;
+    SOSFilter f = *b->sos;
+    if (!b->first)
+        sos_reset(&f);
+    if (b->reverse)
+        sos_process_reverse(&f, b->x, b->n);
+    else
+        sos_process(&f, b->x, b->n);
+    sos_get_state(&f, b->end);
+    if (!b->first)
+        mat_pow(b->step, b->n, b->trans, 2 * f.n_sections);
+    return NULL;
+}
+
+// Add the zero-input response of the true starting state
+static void *sos_block_fixup(void *arg) {
+    SOSBlock *b = (SOSBlock*)arg;
+    if (b->first)
+        return NULL;
+
+    SOSFilter f = *b->sos;
+    sos_set_state(&f, b->start);
+    double size = 0.0;
+    for (int i = 0; i < 2 * f.n_sections; i++)
+        size = fmax(size, fabs(b->start[i]));
+    double floor = size * SOS_FIXUP_EPS;
+
+    for (int k = 0; k < b->n; k++) {
+        // Stop once the carried state has decayed to rounding level
+        if ((k & (SOS_FIXUP_CHECK - 1)) == 0) {
+            double left = 0.0;
+            for (int s = 0; s < f.n_sections; s++)
+                left = fmax(left, fmax(fabs(f.z[s][0]), fabs(f.z[s][1])));
+            if (left <= floor)
+                break;
+        }
+
+        double u = 0.0;                 // zero input into the first section
+        for (int s = 0; s < f.n_sections; s++) {
+            const Biquad *q = &f.s[s];
+            double out = q->b0 * u + f.z[s][0];
+            f.z[s][0] = q->b1 * u - q->a1 * out + f.z[s][1];
+            f.z[s][1] = q->b2 * u - q->a2 * out;
+            u = out;
+        }
+        b->x[b->reverse ? b->n - 1 - k : k] += u;
+    }
+    return NULL;
+}
+
+static void *sos_block_thread(void *arg) {
+    SOSBlock *b = (SOSBlock*)arg;
+    b->fn(b);
+    arena_thread_free();
+    return NULL;
+}
+
+// fn on every block, block 0 on the calling thread. Blocks whose thread
+// cannot be started run here too.
+static void sos_run_blocks(void *(*fn)(void*), SOSBlock *blocks, int n_blocks) {
+    pthread_t tid[SOS_PARALLEL_MAX_THREADS];
+    int started[SOS_PARALLEL_MAX_THREADS] = {0};
+
+    for (int b = 1; b < n_blocks; b++) {
+        blocks[b].fn = fn;
+        started[b] = (pthread_create(&tid[b], NULL, sos_block_thread, &blocks[b]) == 0);
+    }
+    fn(&blocks[0]);
+    for (int b = 1; b < n_blocks; b++) {
+        if (started[b])
+            pthread_join(tid[b], NULL);
+        else
+            fn(&blocks[b]);
+    }
+}
+
+// Blocks a signal of n samples is split into, 1 to run serially;
+// n_threads 0 for one per CPU
+int sos_parallel_threads(int n, int n_threads) {
+    if (n_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (n_threads > n / SOS_PARALLEL_MIN_BLOCK)
+        n_threads = n / SOS_PARALLEL_MIN_BLOCK;
+    if (n_threads > SOS_PARALLEL_MAX_THREADS)
+        n_threads = SOS_PARALLEL_MAX_THREADS;
+    return n_threads < 1 ? 1 : n_threads;
+}
+
+static int sos_parallel(SOSFilter *sos, double *x, int n, int n_threads, int reverse) {
+    if (!sos || !x || n < 0) {
+        fprintf(stderr, "Invalid arguments for parallel SOS filtering.\n");
+        return -1;
+    }
+
+    n_threads = sos_parallel_threads(n, n_threads);
+    if (n_threads <= 1 || sos->n_sections <= 0) {
+        if (reverse)
+            sos_process_reverse(sos, x, n);
+        else
+            sos_process(sos, x, n);
+        return 0;
+    }
+
+    int p = 2 * sos->n_sections;
+    double step[4 * SOS_MAX_SECTIONS * SOS_MAX_SECTIONS];
+    sos_step_matrix(sos, step);
+
+    SOSBlock *blocks = (SOSBlock*)calloc(n_threads, sizeof(SOSBlock));
+    if (!blocks) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return -1;
+    }
+
+    // Blocks in processing order; reversed, block 0 is the end of x
+    int len = (n + n_threads - 1) / n_threads;
+    for (int b = 0; b < n_threads; b++) {
+        int offset = b * len;
+        SOSBlock *blk = &blocks[b];
+        blk->sos = sos;
+        blk->step = step;
+        blk->n = n - offset < len ? n - offset : len;
+        blk->x = reverse ? x + n - offset - blk->n : x + offset;
+        blk->reverse = reverse;
+        blk->first = (b == 0);
+    }
+    sos_run_blocks(sos_block_filter, blocks, n_threads);
+
+    // Carry the true state across the boundaries
+    double s[2 * SOS_MAX_SECTIONS];
+    memcpy(s, blocks[0].end, p * sizeof(double));
+    for (int b = 1; b < n_threads; b++) {
+        SOSBlock *blk = &blocks[b];
+        memcpy(blk->start, s, p * sizeof(double));
+        for (int i = 0; i < p; i++) {
+            double sum = blk->end[i];
+            for (int k = 0; k < p; k++)
+                sum += blk->trans[i * p + k] * blk->start[k];
+            s[i] = sum;
+        }
+    }
+
+    sos_run_blocks(sos_block_fixup, blocks, n_threads);
+    sos_set_state(sos, s);
+    free(blocks);
+    return 0;
+}
+
+// Same result and final state as sos_process, within rounding;
+// n_threads 0 for one per CPU
+int sos_process_parallel(SOSFilter *sos, double *x, int n, int n_threads) {
+    return sos_parallel(sos, x, n, n_threads, 0);
+}
+
+int sos_process_reverse_parallel(SOSFilter *sos, double *x, int n, int n_threads) {
+    return sos_parallel(sos, x, n, n_threads, 1);
+}
@@ -5,13 +5,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <complex.h>
+#include <stdint.h>
+#include <sys/resource.h>
 
 #define MAX_SAMPLES 10000
 #define LINE_SIZE 256
-#define MAX_FIR_TAPS 1024
+#define MAX_FIR_TAPS 4096
 #define DB_FLOOR -100.0  // Minimum magnitude displayed (floor) in dB
 #define PI 3.14159265358979323846
 
@@ -30,6 +33,439 @@ typedef struct {
     double taps[MAX_FIR_TAPS];
 } FIRFilter;
 
+// Bandpass requirements for the FIR designers, a lowpass with f_low 0
+typedef struct {
+    double fs;
+    double f_low, f_high;               // passband edges, Hz
+    double transition;                  // width of each transition band, Hz
+    double ripple_db;                   // passband ripple, peak to peak
+    double atten_db;                    // stopband attenuation
+} FIRSpec;
+
+typedef enum {
+    FIR_DESIGN_AUTO,                    // whichever needs fewer taps
+    FIR_DESIGN_KAISER,
+    FIR_DESIGN_REMEZ
+} FIRDesign;
+
+#define CAPTURE_MAX_CHANNELS 8
+#define CAPTURE_ALIGN 64
+
+// Channel-planar capture: one 64-byte aligned array per channel. Time is
+// t0 + i / fs unless an explicit timestamp array is attached.
+typedef struct {
+    int n_channels;
+    int n_samples;
+    int capacity;                       // samples allocated per plane
+    double fs;                          // sampling rate (Hz), 0 if unknown
+    double t0;                          // time of sample 0 (s)
+    double *time;                       // explicit timestamps or NULL
+    double *ch[CAPTURE_MAX_CHANNELS];
+    void *map;                          // planes point into this mapping, or NULL
+    size_t map_size;
+} Capture;
+
+#define CML_MAGIC "CML1"
+#define CML_VERSION 1
+#define CML_BYTE_ORDER 0x01020304u
+#define CML_HEADER_SIZE 256
+#define CML_UNIT_LEN 16
+#define CML_FLAG_TIME 1                 // explicit timestamp plane before the channels
+
+typedef enum {
+    CML_FLOAT32 = 1,
+    CML_FLOAT64 = 2
+} CMLSampleType;
+
+// Binary capture header, followed at header_size by the planes: the
+// optional float64 time plane, then one plane per channel, each padded to
+// CAPTURE_ALIGN bytes. Without explicit time, sample i is at t0 + i / fs.
+typedef struct {
+    char magic[4];
+    uint32_t byte_order;                // CML_BYTE_ORDER as written
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t n_channels;
+    uint32_t sample_type;               // CMLSampleType
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t n_samples;
+    double fs;
+    double t0;
+    char time_units[CML_UNIT_LEN];
+    char units[CAPTURE_MAX_CHANNELS][CML_UNIT_LEN];
+} CMLHeader;
+
+#define ARENA_ALIGN 64
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+// Bump allocator for stage temporaries, released back to a mark
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+} Arena;
+
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+// Steady-state kernels for symmetric FIR filtering
+typedef enum {
+    FIR_KERNEL_AUTO,
+    FIR_KERNEL_SCALAR,
+    FIR_KERNEL_SSE,
+    FIR_KERNEL_AVX2,
+    FIR_KERNEL_NEON
+} FIRKernel;
+
+#define IIR_MAX_ORDER 8
+
+#define SOS_MAX_SECTIONS 16
+#define SOS_LANES_MAX 8                 // signals filtered side by side in SIMD lanes
+
+// (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+typedef struct {
+    double b0, b1, b2;
+    double a1, a2;
+} Biquad;
+
+// Cascade of second-order sections with their transposed direct form II state
+typedef struct {
+    int n_sections;
+    Biquad s[SOS_MAX_SECTIONS];
+    double z[SOS_MAX_SECTIONS][2];
+} SOSFilter;
+
+// Block-wise zero-phase filter: causal forward pass with carried state,
+// backward pass over each block and a lookahead
+typedef struct {
+    SOSFilter coef;                     // coefficients, state unused
+    SOSFilter fwd;                      // forward pass and its state
+    int irlen;                          // impulse response length
+    int lookahead;                      // output delay, in samples
+    int max_block;
+    int capacity;                       // samples buf and back hold
+    int started;                        // forward pass under way
+    int n_buf;
+    double *buf;                        // forward output not yet emitted
+    double *back;                       // backward pass workspace
+    int n_raw;
+    double *raw;                        // newest 2 * irlen inputs
+} SOSFiltfiltStream;
+
+// Direct-form II transposed IIR section with its delay line, a[0] == 1
+typedef struct {
+    int order;
+    double b[IIR_MAX_ORDER + 1];
+    double a[IIR_MAX_ORDER + 1];
+    double z[IIR_MAX_ORDER];
+} StreamIIR;
+
+// Causal FIR that carries its last num_taps - 1 inputs across blocks
+typedef struct {
+    const FIRFilter *filter;
+    int symmetric;
+    int max_block;
+    double *hist;                       // num_taps - 1 past inputs, then the block
+} StreamFIR;
+
+// Fixed delay of d samples
+typedef struct {
+    int d;
+    int pos;
+    double *buf;
+} StreamDelay;
+
+// Line-by-line reader handing out fixed-size blocks of a scope CSV
+typedef struct {
+    FILE *file;
+    long long rows;                     // samples read so far
+    long long lines;                    // lines read, header included
+    long long malformed;                // rows skipped as malformed
+    long long first_malformed;          // line number of the first of them
+} CSVStream;
+
+#define TIMEBASE_WARMUP 32              // steps used to find the nominal period
+#define TIMEBASE_STEP_TOL 0.5           // step deviation, in periods, still counted as normal
+#define TIMEBASE_HIST_BINS 20           // step deviation histogram over +-TIMEBASE_STEP_TOL
+#define TIMEBASE_MAX_EVENTS 16
+
+typedef enum {
+    TIMEBASE_GAP,                       // about k > 1 periods on, the next row agreeing; k - 1 samples missing
+    TIMEBASE_GLITCH,                    // off the grid and not a gap or outlier, row left out
+    TIMEBASE_OUTLIER                    // lone timestamp off the grid, row kept in its slot
+} TimebaseEventKind;
+
+typedef struct {
+    long long row;                      // row of the capture (0-based) after the step
+    TimebaseEventKind kind;
+    long long missing;                  // samples missing before the row (gaps)
+} TimebaseEvent;
+
+typedef void (*TimebaseEventFn)(void *ctx, const TimebaseEvent *ev);
+
+// One-pass least-squares fit t(i) = t0 + i / fs over the rows, where i
+// counts the samples a gap skipped
+typedef struct {
+    long long n_rows;                   // rows pushed
+    long long n_fit;                    // rows in the fit
+    long long index;                    // sample index of the last row placed on the grid
+    long long index_last;               // sample index of t_last
+    double t_first, t_last;             // first and last fitted timestamps
+    int pending;                        // a row off the grid waits for the next one
+    long long pending_row;
+    double pending_t;
+    double dt_nominal;                  // period from the warm-up, 0 until known
+    double mean_i, mean_r;              // fit on r = t - t_first - i * dt_nominal
+    double s_ii, s_ir, s_rr;
+    double dt_min, dt_max;              // extreme normal steps
+    long long n_gaps, n_missing, n_glitches, n_outliers;
+    long long hist[TIMEBASE_HIST_BINS];
+    int n_events;
+    TimebaseEvent events[TIMEBASE_MAX_EVENTS];
+    TimebaseEventFn on_event;           // every event, in row order as it is settled, or NULL
+    void *ctx;
+    int n_warmup;
+    double warmup[TIMEBASE_WARMUP + 1];
+} TimebaseEstimator;
+
+typedef struct {
+    double fs;                          // Hz
+    double t0;                          // time of sample 0 (s)
+    double jitter_rms;                  // rms residual of the fit (s)
+    double accuracy_percent;            // largest normal step deviation from 1 / fs
+} Timebase;
+
+#define SEGMENT_MIN_SAMPLES 64          // shorter runs between faults are blanked
+#define SEGMENT_MAX_PRINT 16
+
+// Run of capture rows on one uniform time grid
+typedef struct {
+    int start;                          // first row
+    int n_samples;
+} CaptureSegment;
+
+// Running ch0/ch1 means and covariance, mergeable block by block
+typedef struct {
+    long long n;
+    double mean[2];
+    double m2[2];                       // sum of squared deviations per channel
+    double c01;                         // sum of cross deviations
+} XYCovariance;
+
+// Principal axes of the XY figure from its covariance
+typedef struct {
+    double bearing_deg;                 // major axis from the ch0 axis, -90 to 90
+    double major_rms, minor_rms;        // RMS along the axes
+    double axis_ratio;                  // minor / major
+    double null_depth_db;               // 20 log10(axis_ratio), -inf for a line
+    double ellipticity_deg;             // atan(axis_ratio): 0 for a line, 45 for a circle
+    double corr;                        // ch0/ch1 correlation coefficient
+} XYEllipse;
+
+// Running statistics, updated block by block
+typedef struct {
+    XYCovariance xy;
+    double peak;                        // largest |value| on either channel
+    TimebaseEstimator timebase;         // of the input timestamps
+} StreamStats;
+
+#define STREAM_BLOCK 4096
+
+typedef struct {
+    double fs;                          // nominal rate for the DC blocker and the flush
+    double dc_cutoff_hz;                // DC blocker corner, <= 0 disables it
+    const FIRFilter *filter;            // NULL skips the FIR stage
+    int block_size;                     // samples per block, 0 for STREAM_BLOCK
+    long long report_every;             // samples between progress lines, 0 for none
+} StreamConfig;
+
+#define DDC_MAX_STAGES 8
+
+// Digital downconverter settings
+typedef struct {
+    double fs;                          // input rate, Hz
+    double f_center;                    // carrier mixed down to 0 Hz
+    double fs_out;                      // output rate; fs / fs_out an integer
+    double bandwidth;                   // two-sided band kept around the carrier, Hz
+    double ripple_db;                   // passband ripple of the final FIR
+    double atten_db;                    // alias rejection of every stage
+} DDCConfig;
+
+// Decimating stage: a half-band by 2, or the final FIR by any factor
+typedef struct {
+    int factor;
+    int halfband;                       // taps at even offsets from the centre are zero
+    int n_taps;
+    double *taps;
+    int skip;                           // inputs to take before the next output
+    double complex *hist[CAPTURE_MAX_CHANNELS];  // last n_taps - 1 inputs
+} DDCStage;
+
+// NCO mixer and decimation chain, with its state between calls
+typedef struct {
+    DDCConfig cfg;
+    int n_channels;
+    int decimation;
+    uint64_t phase, step;               // NCO phase and increment, 2^-64 cycles
+    int n_stages;
+    DDCStage stage[DDC_MAX_STAGES];
+    double delay;                       // group delay of the chain, input samples
+} DDC;
+
+// Complex baseband capture, one plane per channel
+typedef struct {
+    int n_channels;
+    int n_samples;
+    double fs;
+    double t0;                          // time of sample 0, chain delay removed
+    double f_center;                    // carrier at 0 Hz
+    double complex *ch[CAPTURE_MAX_CHANNELS];
+} IQCapture;
+
+#define SDFT_MAX_BINS 64
+
+// Sliding DFT over the last n samples of both channels at a few bins
+typedef struct {
+    int n;                              // window length
+    int n_bins;
+    int n_ref;                          // the last n_ref bins measure the noise
+    int bin[SDFT_MAX_BINS];             // DFT bin indices, 0 to n / 2
+    double fs;
+    double twiddle[SDFT_MAX_BINS][2];   // exp(+j 2 pi bin / n)
+    double s[2][SDFT_MAX_BINS][2];      // [channel][bin][re, im]
+    double *ring[2];                    // last n inputs per channel
+    double *table;                      // cos, sin of 2 pi m / n for re-anchoring
+    int pos;                            // oldest input in the rings
+    int anchor_left;                    // samples until the next re-anchor
+    long long n_in;                     // samples taken since the reset
+} SDFTTracker;
+
+#define LOCKIN_MAX_ORDER 4
+
+// Dual-channel lock-in settings
+typedef struct {
+    double fs;                          // input rate, Hz
+    double f_ref;                       // reference frequency, Hz
+    double bandwidth;                   // -3 dB bandwidth of the low-pass, Hz
+    int order;                          // one-pole sections, 1 to LOCKIN_MAX_ORDER
+    double update_hz;                   // output rate
+} LockInConfig;
+
+// One lock-in reading
+typedef struct {
+    double t;                           // time of the last input sample
+    double complex z[2];                // channel phasors against the reference
+    double ratio_db;                    // |ch1| / |ch0|
+    double phase_deg;                   // arg ch1 - arg ch0, -180 to 180
+    double bearing_deg;                 // major axis from the ch0 axis, -90 to 90
+    int settled;                        // low-pass past its start-up transient
+} LockInOutput;
+
+// Quadrature mixer and low-pass for two channels, with state between calls
+typedef struct {
+    LockInConfig cfg;
+    uint64_t phase, step;               // reference phase and increment, 2^-64 cycles
+    double alpha;                       // one-pole smoothing factor
+    double z[2][LOCKIN_MAX_ORDER][2];   // [channel][section][I, Q]
+    double interval;                    // input samples per output
+    double countdown;                   // samples to the next output
+    long long n;                        // samples taken
+    long long settle;                   // samples before outputs count as settled
+} LockIn;
+
+typedef enum {
+    NULL_NLMS,                          // normalized LMS, step mu
+    NULL_RLS                            // recursive least squares, forgetting factor lambda
+} NullAlgorithm;
+
+// Adaptive one-weight null of the two loops: the output a z0 + b z1 is
+// minimized with one of a, b held at 1 and the other the complex weight w
+typedef struct {
+    NullAlgorithm alg;
+    double mu;
+    double lambda;                      // also the memory of the power estimates
+    double complex w;
+    int ref;                            // channel multiplied by w, the stronger one
+    double power[2];                    // weighted input power per channel
+    double out_power;                   // weighted power of the combined output
+    long long n;
+} NullSteer;
+
+// Electronic null from the converged weight
+typedef struct {
+    double bearing_deg;                 // source, as for the XY ellipse, -90 to 90
+    double null_deg;                    // virtual loop angle of the null
+    double depth_db;                    // combined output against the loops' power
+    double weight_phase_deg;            // quadrature left in the weight, -90 to 90
+    int settled;                        // adapted for NULL_SETTLE_TAU memories
+} NullEstimate;
+
+#define RESAMPLE_MAX_FACTOR 256
+
+// Polyphase FIR resampler by up / down, with its state between calls
+typedef struct {
+    int up, down;                       // in lowest terms
+    int n_taps;                         // prototype length, at fs * up
+    int phase_len;                      // taps per polyphase branch
+    double *branch;                     // up branches of phase_len taps, reversed
+    double *hist;                       // last phase_len - 1 inputs
+    int next;                           // next output, in 1 / up input samples from the next input
+    double delay;                       // group delay, input samples
+} Resampler;
+
+#define FFT_MAX_FACTORS 32
+
+typedef struct FFTChirp FFTChirp;
+
+typedef struct {
+    int n;                              // transform length
+    int inverse;                        // 0 = forward, 1 = inverse (unnormalized)
+    int n_factors;
+    int radix[FFT_MAX_FACTORS];         // one per pass, in order
+    double complex *twiddles;           // exp(-+2*pi*i*k/n), k = 0..n-1
+    FFTChirp *chirps;                   // Bluestein tables for the large prime radices
+} FFTPlan;
+
+typedef enum {
+    WINDOW_RECT,
+    WINDOW_HANN,
+    WINDOW_HAMMING,
+    WINDOW_BLACKMAN_HARRIS              // 4-term, 92 dB sidelobes
+} WindowType;
+
+// Periodic window of length n, shared from the cache
+typedef struct WindowTable {
+    WindowType type;
+    int n;
+    double sum, sum2;                   // of w and of w^2
+    double *w;
+    struct WindowTable *next;
+} WindowTable;
+
+#define WELCH_SEGMENT 1024
+
+// Welch averaging: segments of segment samples, overlapping by a fraction
+typedef struct {
+    int segment;
+    double overlap;                     // 0 to 0.95, 0.5 is usual for Hann
+    WindowType window;
+    int n_threads;                      // 0 for one per CPU
+} WelchConfig;
+
+// One-sided power spectral density of up to two channels, V^2/Hz
+typedef struct {
+    int n_channels;
+    int n_bins;                         // segment / 2 + 1, bin k at k * df
+    double fs, df;
+    int n_segments;
+    double enbw_hz;                     // equivalent noise bandwidth of a bin
+    WindowType window;
+    double *psd[2];
+} WelchPSD;
+
 // Function prototypes
 void close_existing_gnuplot_windows(void);
 void plot_fft_db(DataSample *data, int n_samples);
@@ -37,21 +473,218 @@ void generate_sinusoid(DataSample *data, int n_samples,
                        double amplitude_ch0, double amplitude_ch1,
                        double frequency_hz, double sampling_rate_hz);
 void plot_fft(DataSample *data, int n_samples);
-void filter_fir(double *data, int n_samples, const FIRFilter *filter);
+int filter_fir(double *data, int n_samples, const FIRFilter *filter);
 void generate_filtered_noise(DataSample *data, int n_samples, double fs, const FIRFilter *filter);
 double find_scale(const DataSample *data, int n_samples);
 int calculate_sampling_rate(const DataSample *samples, int n_samples, double *sampling_rate, double *accuracy_percent);
-int generate_fir_bandpass(double fs, double f_low, double f_high,
-    double suppression_db,
-    int max_taps, FIRFilter *filter);
+// Bandpass or lowpass FIR design to a spec, Kaiser window or Remez equiripple
+int fir_kaiser_length(const FIRSpec *spec);
+int fir_remez_length(const FIRSpec *spec);
+double kaiser_beta(double atten_db);
+int design_fir_kaiser(const FIRSpec *spec, int num_taps, FIRFilter *filter);
+int design_fir_remez(const FIRSpec *spec, int num_taps, FIRFilter *filter);
+int fir_check_spec(const FIRFilter *filter, const FIRSpec *spec, double *ripple_db, double *atten_db);
+int design_fir_min(const FIRSpec *spec, FIRDesign method, int max_taps, FIRFilter *filter);
+void fir_design_cache_free(void);
+const char *fir_design_name(FIRDesign method);
+void fir_print_design(const FIRFilter *filter, const FIRSpec *spec);
 void filter_data(DataSample *data, int n_samples, const FIRFilter *filter);
-void filter_fir(double *data, int n_samples, const FIRFilter *filter);
-// Parsing suffixes: 'm' (milli), 'u' (micro)
+int filter_fir(double *data, int n_samples, const FIRFilter *filter);
+// Overlap-save FFT convolution, same output alignment as filter_fir
+int fir_overlap_save_length(int num_taps, int n_samples, double direct_cost);
+int filter_fir_overlap_save(double *data, int n_samples, const FIRFilter *filter, int fft_len);
+// Linear-phase FIR using tap symmetry, runtime-dispatched SIMD steady state
+int fir_is_symmetric(const FIRFilter *filter);
+FIRKernel fir_kernel_best(void);
+int fir_kernel_available(FIRKernel kernel);
+int fir_kernel_lanes(FIRKernel kernel);
+const char *fir_kernel_name(FIRKernel kernel);
+double fir_symmetric_cost(int num_taps);
+int filter_fir_symmetric(double *data, int n_samples, const FIRFilter *filter, FIRKernel kernel);
+int fir_symmetric_window(const double *w, double *y, int n_out, const FIRFilter *filter, FIRKernel kernel);
+// Both channels of a DataSample array, or two channel planes, in one
+// sweep, O(taps) memory
+double filter_dual_fir_cost(const FIRFilter *filter);
+int filter_dual_fir_direct(DataSample *data, int n_samples, const FIRFilter *filter);
+int filter_dual_fir_overlap_save(DataSample *data, int n_samples, const FIRFilter *filter, int fft_len);
+int filter_dual_fir_direct_planar(const double *x0, const double *x1, double *y0, double *y1,
+                                  int n_samples, const FIRFilter *filter);
+int filter_dual_fir_overlap_save_planar(const double *x0, const double *x1, double *y0, double *y1,
+                                        int n_samples, const FIRFilter *filter, int fft_len);
+// Butterworth bandpass as cascaded biquads
+int butterworth_bandpass_order(double fs, double f_low, double f_high, double f_stop, double atten_db);
+int design_butterworth_bandpass(double fs, double f_low, double f_high, int order, SOSFilter *sos);
+void sos_reset(SOSFilter *sos);
+void sos_get_state(const SOSFilter *sos, double *v);
+void sos_set_state(SOSFilter *sos, const double *v);
+void sos_process(SOSFilter *sos, double *x, int n);
+void sos_process_reverse(SOSFilter *sos, double *x, int n);
+double complex sos_response(const SOSFilter *sos, double f, double fs);
+void filter_capture_sos(Capture *cap, const SOSFilter *sos);
+// Time-parallel cascade filtering: blocks from rest, then a state fix-up
+int sos_process_parallel(SOSFilter *sos, double *x, int n, int n_threads);
+int sos_process_reverse_parallel(SOSFilter *sos, double *x, int n, int n_threads);
+int sos_parallel_threads(int n, int n_threads);
+// Several signals with one set of coefficients, side by side in SIMD lanes
+int sos_process_lanes(SOSFilter *f, double *const *x, int n_sig, int n, int reverse);
+// Zero-phase forward-backward filtering from Gustafsson initial states
+int sos_impulse_length(const SOSFilter *sos);
+int sos_filtfilt(const SOSFilter *sos, double *x, int n);
+int sos_filtfilt_multi(const SOSFilter *sos, double *const *x, int n_sig, int n);
+int filter_capture_zero_phase(Capture *cap, const SOSFilter *sos);
+int filter_captures_zero_phase(Capture *const *caps, int n_caps, const SOSFilter *sos);
+int sos_filtfilt_stream_init(SOSFiltfiltStream *st, const SOSFilter *sos, int max_block, int lookahead);
+void sos_filtfilt_stream_free(SOSFiltfiltStream *st);
+int sos_filtfilt_stream_process(SOSFiltfiltStream *st, const double *x, int n, double *out);
+int sos_filtfilt_stream_finish(SOSFiltfiltStream *st, double *out);
+// Parsing suffixes: 'm' (milli), 'u' (micro), also p, n, k, M, G
 int parse_suffix(char *str, double *value);
+const char *parse_si(const char *p, const char *end, double *value);
 int read_csv(const char *filename, DataSample *data, int *n_samples);
 void plot_data(DataSample *data, int n_samples);
 void plot_xy(DataSample *data, int n_samples);
 void remove_dc(DataSample *signal, int N);
+// FFT plans, reusable for any number of transforms of the same length
+FFTPlan *fft_plan_create(int n, int inverse);
+void fft_plan_destroy(FFTPlan *plan);
+int fft_execute(const FFTPlan *plan, const double complex *in, double complex *out);
+int fft_real(const FFTPlan *plan, const double *x, int stride, double complex *out);
+// Both channels through one complex FFT, n/2 + 1 bins per channel
+int fft_dual_real(const FFTPlan *plan, const DataSample *data, double complex *spec0, double complex *spec1);
+int fft_dual_real_planar(const FFTPlan *plan, const double *x0, const double *x1,
+                         double complex *spec0, double complex *spec1);
+void fft_split_dual_real(const double complex *z, int n, double complex *spec0, double complex *spec1);
+// Capture buffers and adapters to/from the DataSample layout
+int capture_init(Capture *cap, int n_channels, int n_samples, int with_time);
+void capture_free(Capture *cap);
+int capture_reserve(Capture *cap, int capacity);
+int capture_append(Capture *cap, double time, const double *values);
+double capture_time(const Capture *cap, int i);
+int capture_from_samples(Capture *cap, const DataSample *data, int n_samples);
+int capture_to_samples(const Capture *cap, DataSample *data);
+// Arena allocation; scratch_arena() is per thread
+void *arena_alloc(Arena *arena, size_t bytes);
+ArenaMark arena_mark(const Arena *arena);
+void arena_release(Arena *arena, ArenaMark mark);
+void arena_free(Arena *arena);
+Arena *scratch_arena(void);
+void arena_thread_free(void);
+// Binary .cml captures; float64 files load as copy-on-write mappings
+int write_cml_capture(const char *filename, const Capture *cap, CMLSampleType type,
+                      const char *const *units);
+int read_cml_capture(const char *filename, Capture *cap, CMLHeader *header);
+int is_cml_file(const char *filename);
+// Streaming least-squares timebase with gap and glitch detection
+void timebase_init(TimebaseEstimator *tb);
+void timebase_push(TimebaseEstimator *tb, const double *time, size_t stride, int n);
+void timebase_finish(TimebaseEstimator *tb);
+long long timebase_settled(const TimebaseEstimator *tb);
+int timebase_fit(const TimebaseEstimator *tb, Timebase *fit);
+void timebase_print(const TimebaseEstimator *tb, const Timebase *fit);
+int capture_fit_timebase(Capture *cap, Timebase *fit, int drop_time);
+long long timebase_step_periods(double step, double period);
+// Splitting a capture at timing faults into independently processed segments
+int capture_find_segments(const Capture *cap, CaptureSegment **segs);
+void capture_segment_view(const Capture *cap, const CaptureSegment *seg, Capture *view);
+void capture_blank_gaps(Capture *cap, const CaptureSegment *segs, int n_segs);
+int capture_longest_segment(const CaptureSegment *segs, int n_segs);
+void capture_print_segments(const Capture *cap, const CaptureSegment *segs, int n_segs);
+// Capture variants of the DataSample stages
+int read_csv_capture(const char *filename, Capture *cap);
+int read_csv_capture_threads(const char *filename, Capture *cap, int n_threads);
+int calculate_sampling_rate_capture(const Capture *cap, double *sampling_rate, double *accuracy_percent);
+void remove_dc_capture(Capture *cap);
+double find_scale_capture(const Capture *cap);
+int filter_capture(Capture *cap, const FIRFilter *filter);
+void generate_sinusoid_capture(Capture *cap,
+                               double amplitude_ch0, double amplitude_ch1,
+                               double frequency_hz, double sampling_rate_hz);
+void generate_filtered_noise_capture(Capture *cap, double fs, const FIRFilter *filter);
+void plot_data_capture(const Capture *cap);
+void plot_fft_capture(const Capture *cap);
+void plot_fft_db_capture(const Capture *cap);
+void plot_xy_capture(const Capture *cap);
+// Stateful filters for block-by-block processing
+int stream_iir_init(StreamIIR *iir, const double *b, const double *a, int order);
+int stream_iir_dc_blocker(StreamIIR *iir, double fs, double cutoff_hz);
+void stream_iir_reset(StreamIIR *iir);
+void stream_iir_prime(StreamIIR *iir, double x0);
+void stream_iir_process(StreamIIR *iir, double *x, int n);
+int stream_fir_init(StreamFIR *fir, const FIRFilter *filter, int max_block);
+void stream_fir_free(StreamFIR *fir);
+void stream_fir_reset(StreamFIR *fir);
+int stream_fir_delay(const StreamFIR *fir);
+void stream_fir_process(StreamFIR *fir, double *x, int n);
+int stream_delay_init(StreamDelay *delay, int d);
+void stream_delay_free(StreamDelay *delay);
+void stream_delay_reset(StreamDelay *delay);
+void stream_delay_process(StreamDelay *delay, double *x, int n);
+// Block-wise CSV input and running analysis
+int csv_stream_open(CSVStream *cs, const char *filename);
+int csv_stream_read(CSVStream *cs, Capture *block);
+void csv_stream_close(CSVStream *cs, const char *filename);
+void stream_stats_reset(StreamStats *stats);
+void stream_stats_update(StreamStats *stats, const double *ch0, const double *ch1, int n);
+void stream_stats_print(const StreamStats *stats);
+// One-pass XY ellipse fit: bearing and depth of the null
+void xy_cov_reset(XYCovariance *cov);
+void xy_cov_update(XYCovariance *cov, const double *ch0, const double *ch1, int n);
+void xy_cov_merge(XYCovariance *cov, const XYCovariance *other);
+int xy_ellipse_fit(const XYCovariance *cov, XYEllipse *fit);
+void xy_ellipse_print(const XYEllipse *fit);
+// Constant-memory pipeline: DC blocker, FIR, running statistics
+int stream_process_csv(const char *filename, const StreamConfig *cfg, StreamStats *stats, Capture *tail);
+// Downconversion to complex baseband: NCO, half-band chain, decimating FIR
+int ddc_init(DDC *ddc, const DDCConfig *cfg, int n_channels);
+void ddc_free(DDC *ddc);
+void ddc_reset(DDC *ddc);
+int ddc_process(DDC *ddc, const double *const *x, int n, double complex *const *out);
+void ddc_print(const DDC *ddc);
+int capture_downconvert(const Capture *cap, const DDCConfig *cfg, IQCapture *iq);
+void iq_capture_free(IQCapture *iq);
+void plot_iq_spectrum(const IQCapture *iq);
+// Sliding DFT bin tracking and tone presence
+int sdft_init(SDFTTracker *tr, double fs, int n, const double *freqs, int n_bins, int n_ref);
+void sdft_free(SDFTTracker *tr);
+void sdft_reset(SDFTTracker *tr);
+void sdft_push(SDFTTracker *tr, const double *ch0, const double *ch1, int n);
+double sdft_bin_hz(const SDFTTracker *tr, int b);
+double complex sdft_bin(const SDFTTracker *tr, int ch, int b);
+double sdft_noise_power(const SDFTTracker *tr, int ch);
+double sdft_bin_db(const SDFTTracker *tr, int ch, int b);
+int sdft_peak_bin(const SDFTTracker *tr, int ch);
+int sdft_present(const SDFTTracker *tr, double min_db);
+// Lock-in demodulation of both channels into a bearing stream
+int lockin_init(LockIn *li, const LockInConfig *cfg);
+void lockin_reset(LockIn *li);
+int lockin_process(LockIn *li, const double *ch0, const double *ch1, const double *time, int n,
+                   LockInOutput *out, int max_out);
+void lockin_print_output(const LockInOutput *o);
+// Adaptive NLMS / RLS null steering on baseband phasors
+int null_steer_init(NullSteer *ns, NullAlgorithm alg, double mu, double lambda);
+void null_steer_reset(NullSteer *ns);
+void null_steer_process(NullSteer *ns, const double complex *z0, const double complex *z1, int n);
+int null_steer_estimate(const NullSteer *ns, NullEstimate *est);
+const char *null_algorithm_name(NullAlgorithm alg);
+// Welch PSD: cached windows, segments transformed on threads
+const WindowTable *window_table(WindowType type, int n);
+void window_cache_free(void);
+const char *window_name(WindowType type);
+int welch_psd(const Capture *cap, const WelchConfig *cfg, WelchPSD *psd);
+void welch_psd_free(WelchPSD *psd);
+double welch_noise_floor(const WelchPSD *psd, int ch);
+double welch_band_power(const WelchPSD *psd, int ch, double f_low, double f_high);
+void welch_print_summary(const WelchPSD *psd, double f_low, double f_high);
+void plot_welch_psd(const WelchPSD *psd);
+// Polyphase integer decimation, interpolation and rational resampling
+int resampler_design(double fs, int up, int down, double f_pass, double ripple_db, double atten_db,
+                     FIRFilter *proto);
+int resampler_init(Resampler *r, int up, int down, const FIRFilter *proto);
+void resampler_free(Resampler *r);
+void resampler_reset(Resampler *r);
+int resampler_max_output(const Resampler *r, int n);
+int resampler_process(Resampler *r, const double *x, int n, double *y);
+int capture_resample(const Capture *in, int up, int down, const FIRFilter *proto, Capture *out);
 
 
 #endif // __INCLUDES_H__
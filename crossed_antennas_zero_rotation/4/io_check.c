@@ -0,0 +1,262 @@
+#include "includes.h"
+#include <unistd.h>
+
+// io_check: the capture input paths.
+// parse_si must give what strtod gives for the same number written out
+// with an exponent, bit for bit; numbers it should not take must be
+// refused. A CSV of several parse chunks, with blank, malformed and CRLF
+// lines scattered through it, is read on one thread and on several; every
+// thread count must give back exactly the rows written. Captures of odd
+// lengths and channel counts, with and without a timestamp plane, go
+// through a .cml file and back: float64 must return every sample bit for
+// bit, float32 each sample rounded to float once; fs, t0 and the units
+// must survive too. Exits non-zero if any case fails.
+
+typedef struct {
+    const char *text;
+    const char *as_exponent;            // the same number for strtod, NULL if text is not a number
+} SICase;
+
+static const SICase si_cases[] = {
+    { "0", "0" },
+    { "-0.0", "-0.0" },
+    { "1", "1" },
+    { "+2.5", "2.5" },
+    { ".5", "0.5" },
+    { "5.", "5" },
+    { "12.5m", "12.5e-3" },
+    { "116.42307m", "116.42307e-3" },
+    { "-112.752914m", "-112.752914e-3" },
+    { "15.625u", "15.625e-6" },
+    { "-3.3n", "-3.3e-9" },
+    { "4.7p", "4.7e-12" },
+    { "2.2k", "2.2e3" },
+    { "1.5M", "1.5e6" },
+    { "7G", "7e9" },
+    { "1e-3", "1e-3" },
+    { "2.5E+2k", "2.5e5" },
+    { "1.25e-3m", "1.25e-6" },
+    { "0.1", "0.1" },
+    { "9007199254740993", "9007199254740993" },
+    { "123456789e-30", "123456789e-30" },
+    { "1e300", "1e300" },
+    { "4.9e-324", "4.9e-324" },
+    { "1234567890123456789", "1234567890123456789" },
+    { "12345678901234567890000", "12345678901234567890000" },
+    { "0.000000000000000000001234567890123456789", "1234567890123456789e-39" },
+    { "", NULL },
+    { "-", NULL },
+    { ".", NULL },
+    { "e5", NULL },
+    { "m", NULL },
+    { "1e", NULL },
+    { "1e+", NULL },
+};
+
+// Whole tokens for parse_suffix; value is only looked at when ok
+typedef struct {
+    const char *text;
+    int ok;
+    double value;
+} SuffixCase;
+
+static const SuffixCase suffix_cases[] = {
+    { " 12.5m \r\n", 1, 12.5e-3 },
+    { "\t-4k", 1, -4e3 },
+    { "1.0x", 0, 0.0 },
+    { "1,2", 0, 0.0 },
+    { "1 2", 0, 0.0 },
+    { "", 0, 0.0 },
+};
+
+static int check_si(void) {
+    int failed = 0;
+    int n_cases = sizeof(si_cases) / sizeof(si_cases[0]);
+    for (int i = 0; i < n_cases; i++) {
+        const SICase *c = &si_cases[i];
+        const char *end = c->text + strlen(c->text);
+        double v = 0.0;
+        const char *stop = parse_si(c->text, end, &v);
+        int ok;
+        if (c->as_exponent) {
+            double ref = strtod(c->as_exponent, NULL);
+            ok = stop == end && memcmp(&v, &ref, sizeof(double)) == 0;
+            printf("parse_si %-42s %.17g %s\n", c->text, v, ok ? "ok" : "FAILED");
+        } else {
+            ok = stop == NULL;
+            printf("parse_si %-42s refused %s\n", c->text[0] ? c->text : "(empty)", ok ? "ok" : "FAILED");
+        }
+        failed += !ok;
+    }
+
+    n_cases = sizeof(suffix_cases) / sizeof(suffix_cases[0]);
+    for (int i = 0; i < n_cases; i++) {
+        const SuffixCase *c = &suffix_cases[i];
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s", c->text);
+        double v = 0.0;
+        int rv = parse_suffix(buf, &v);
+        int ok = rv == c->ok && (!rv || v == c->value);
+        printf("parse_suffix case %d: %s %s\n", i, rv ? "taken" : "refused", ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed;
+}
+
+#define CSV_CHECK_ROWS 400000          // about 14 MB, several parse chunks
+
+static const int csv_threads[] = { 1, 2, 3, 4, 7, 0 };
+
+// Row i of the check file. Values are integer mantissas with a suffix, so
+// the exact double each should parse to is known.
+static void csv_row(int i, long long *t_ns, long long *v0_nv, long long *v1_nv) {
+    *t_ns = (long long)i * 15625;
+    *v0_nv = (long long)((i * 2654435761u) % 400001) - 200000;
+    *v1_nv = (long long)((i * 40503u + 12345u) % 2000001) - 1000000;
+}
+
+// The rows as written; blank and malformed lines are not rows
+static int csv_write(const char *path, Capture *ref) {
+    FILE *file = fopen(path, "w");
+    if (!file || capture_init(ref, 2, CSV_CHECK_ROWS, 1) != 0) {
+        if (file)
+            fclose(file);
+        return -1;
+    }
+    fprintf(file, "Time (s) - CH 0,Voltage (V) - CH 0,Voltage (V) - CH 1\n");
+    for (int i = 0; i < CSV_CHECK_ROWS; i++) {
+        long long t, v0, v1;
+        csv_row(i, &t, &v0, &v1);
+        if (i % 997 == 0)
+            fprintf(file, "\n");
+        if (i % 1499 == 0)
+            fprintf(file, "%lldn,oops,1m\n", t);
+        long long a1 = v1 < 0 ? -v1 : v1;
+        fprintf(file, "%lldn, %lldn,%s%lld.%06lldm%s", t, v0, v1 < 0 ? "-" : "", a1 / 1000000, a1 % 1000000,
+                i % 3 ? "\n" : "\r\n");
+        ref->time[i] = t / 1e9;
+        ref->ch[0][i] = v0 / 1e9;
+        ref->ch[1][i] = (v1 < 0 ? -1.0 : 1.0) * (a1 / 1e9);
+    }
+    ref->n_samples = CSV_CHECK_ROWS;
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static int same_plane(const double *x, const double *y, int n) {
+    return memcmp(x, y, (size_t)n * sizeof(double)) == 0;
+}
+
+static int check_csv(const char *dir) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/check.csv", dir);
+    Capture ref;
+    if (csv_write(path, &ref) != 0) {
+        fprintf(stderr, "Cannot write %s.\n", path);
+        return 1;
+    }
+
+    int failed = 0;
+    int n_cases = sizeof(csv_threads) / sizeof(csv_threads[0]);
+    for (int k = 0; k < n_cases; k++) {
+        Capture cap;
+        int ok = read_csv_capture_threads(path, &cap, csv_threads[k]) == 1
+              && cap.n_samples == ref.n_samples && cap.time
+              && same_plane(cap.time, ref.time, ref.n_samples)
+              && same_plane(cap.ch[0], ref.ch[0], ref.n_samples)
+              && same_plane(cap.ch[1], ref.ch[1], ref.n_samples);
+        printf("CSV on %d threads%s: %d rows %s\n", csv_threads[k], csv_threads[k] ? "" : " (one per CPU)",
+               cap.n_samples, ok ? "ok" : "FAILED");
+        failed += !ok;
+        capture_free(&cap);
+    }
+
+    capture_free(&ref);
+    unlink(path);
+    return failed;
+}
+
+typedef struct {
+    int n_channels;
+    int n_samples;
+    int with_time;
+    CMLSampleType type;
+} CMLCase;
+
+static const CMLCase cml_cases[] = {
+    { 2, 8192, 0, CML_FLOAT64 },
+    { 2, 8141, 1, CML_FLOAT64 },
+    { 1, 1, 0, CML_FLOAT64 },
+    { 3, 1000, 1, CML_FLOAT32 },
+    { 2, 7, 0, CML_FLOAT32 },
+    { CAPTURE_MAX_CHANNELS, 65, 1, CML_FLOAT64 },
+};
+
+static int check_cml_case(const char *path, const CMLCase *c) {
+    static const char *const units[CAPTURE_MAX_CHANNELS] = { "V", "mV", "A", "uT", "V", "V", "V", "V" };
+    Capture cap, back;
+    CMLHeader header;
+    memset(&back, 0, sizeof(back));
+    if (capture_init(&cap, c->n_channels, c->n_samples, c->with_time) != 0)
+        return 0;
+    cap.fs = 64000.0 / 3.0;
+    cap.t0 = -1.0 / 7.0;
+    srand(c->n_samples);
+    for (int i = 0; i < c->n_samples; i++) {
+        if (cap.time)
+            cap.time[i] = cap.t0 + i / cap.fs + 1e-9 * (rand() / (double)RAND_MAX);
+        for (int ch = 0; ch < c->n_channels; ch++)
+            cap.ch[ch][i] = (rand() / (double)RAND_MAX - 0.5) * 1e-3;
+    }
+
+    int ok = write_cml_capture(path, &cap, c->type, units) == 0
+          && read_cml_capture(path, &back, &header) == 0
+          && back.n_channels == cap.n_channels && back.n_samples == cap.n_samples
+          && back.fs == cap.fs && back.t0 == cap.t0 && header.sample_type == (uint32_t)c->type
+          && !back.time == !cap.time && (!cap.time || same_plane(back.time, cap.time, cap.n_samples));
+    for (int ch = 0; ok && ch < c->n_channels; ch++) {
+        ok = strcmp(header.units[ch], units[ch]) == 0;
+        if (c->type == CML_FLOAT64) {
+            ok = ok && same_plane(back.ch[ch], cap.ch[ch], cap.n_samples);
+        } else {
+            for (int i = 0; ok && i < c->n_samples; i++)
+                ok = back.ch[ch][i] == (double)(float)cap.ch[ch][i];
+        }
+    }
+
+    capture_free(&back);
+    capture_free(&cap);
+    unlink(path);
+    return ok;
+}
+
+static int check_cml(const char *dir) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/check.cml", dir);
+    int failed = 0;
+    int n_cases = sizeof(cml_cases) / sizeof(cml_cases[0]);
+    for (int k = 0; k < n_cases; k++) {
+        const CMLCase *c = &cml_cases[k];
+        int ok = check_cml_case(path, c);
+        printf(".cml %s %d channels x %5d%s: %s\n", c->type == CML_FLOAT64 ? "float64" : "float32",
+               c->n_channels, c->n_samples, c->with_time ? " with time" : "", ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed;
+}
+
+int main(void) {
+    char dir[] = "/tmp/io_check_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    int failed = check_si();
+    failed += check_csv(dir);
+    failed += check_cml(dir);
+    rmdir(dir);
+
+    arena_free(scratch_arena());
+    printf("%s\n", failed ? "I/O check failed." : "I/O check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
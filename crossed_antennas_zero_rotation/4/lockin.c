@@ -0,0 +1,116 @@
+#include "includes.h"
+
+// Dual-channel lock-in amplifier.
+// Both loops see the same carrier, so one quadrature reference serves
+// them: each sample is multiplied by 2 exp(-j 2 pi f_ref t) and the
+// product smoothed by a cascade of one-pole low-passes, leaving each
+// channel's carrier as a slowly varying phasor. The reference is a unit
+// phasor rotated sample by sample and re-anchored from a 64-bit phase
+// accumulator every LOCKIN_NCO_BLOCK samples, like the DDC's NCO. Per
+// sample and channel this is two multiplies for the mixer and two
+// multiply-adds per section, with no buffers. Every interval samples the
+// phasors are read out as the amplitude ratio and phase difference of the
+// channels and the bearing, the major axis of the XY ellipse they trace.
+
+#define LOCKIN_NCO_BLOCK 256
+#define LOCKIN_SETTLE_TAU 7.0           // time constants per section, about 60 dB
+
+int lockin_init(LockIn *li, const LockInConfig *cfg) {
+    memset(li, 0, sizeof(*li));
+    if (!cfg || cfg->fs <= 0.0 || cfg->f_ref <= 0.0 || cfg->f_ref >= cfg->fs / 2.0
+        || cfg->bandwidth <= 0.0 || cfg->bandwidth >= cfg->f_ref
+        || cfg->order < 1 || cfg->order > LOCKIN_MAX_ORDER
+        || cfg->update_hz <= 0.0 || cfg->update_hz > cfg->fs) {
+        fprintf(stderr, "Invalid lock-in parameters.\n");
+        return -1;
+    }
+
+    li->cfg = *cfg;
+    li->step = (uint64_t)ldexp(cfg->f_ref / cfg->fs, 64);
+    // Each section's corner so the cascade is down 3 dB at the bandwidth
+    double fc = cfg->bandwidth / sqrt(pow(2.0, 1.0 / cfg->order) - 1.0);
+    li->alpha = 1.0 - exp(-2.0 * M_PI * fc / cfg->fs);
+    li->interval = cfg->fs / cfg->update_hz;
+    li->settle = (long long)ceil(LOCKIN_SETTLE_TAU * cfg->order / li->alpha);
+    lockin_reset(li);
+    return 0;
+}
+
+void lockin_reset(LockIn *li) {
+    li->phase = 0;
+    memset(li->z, 0, sizeof(li->z));
+    li->countdown = li->interval;
+    li->n = 0;
+}
+
+static void lockin_emit(const LockIn *li, double t, LockInOutput *o) {
+    int last = li->cfg.order - 1;
+    double complex z0 = li->z[0][last][0] + I * li->z[0][last][1];
+    double complex z1 = li->z[1][last][0] + I * li->z[1][last][1];
+    double a0 = cabs(z0), a1 = cabs(z1);
+    double complex cross = z1 * conj(z0);
+
+    o->t = t;
+    o->z[0] = z0;
+    o->z[1] = z1;
+    o->ratio_db = a0 > 0.0 ? 20.0 * log10(a1 / a0) : 0.0;
+    o->phase_deg = carg(cross) * 180.0 / M_PI;
+    o->bearing_deg = 0.5 * atan2(2.0 * creal(cross), a0 * a0 - a1 * a1) * 180.0 / M_PI;
+    o->settled = li->n >= li->settle;
+}
+
+// n samples of both channels, with their timestamps or NULL for n / fs
+// since the reset. Readings go to out, which takes up to max_out of them
+// (n / interval + 1 is always enough); returns how many were written.
+int lockin_process(LockIn *li, const double *ch0, const double *ch1, const double *time, int n,
+                   LockInOutput *out, int max_out) {
+    if (!li || !ch0 || !ch1 || n < 0 || (!out && max_out > 0)) {
+        fprintf(stderr, "Invalid arguments for lockin_process.\n");
+        return -1;
+    }
+
+    int order = li->cfg.order;
+    double alpha = li->alpha;
+    double step = 2.0 * M_PI * ldexp((double)li->step, -64);
+    double inc_re = cos(step), inc_im = -sin(step);
+    int n_out = 0;
+
+    for (int i0 = 0; i0 < n; i0 += LOCKIN_NCO_BLOCK) {
+        int len = n - i0 < LOCKIN_NCO_BLOCK ? n - i0 : LOCKIN_NCO_BLOCK;
+        double ph = 2.0 * M_PI * ldexp((double)li->phase, -64);
+        double ref_re = 2.0 * cos(ph), ref_im = -2.0 * sin(ph);
+
+        for (int i = i0; i < i0 + len; i++) {
+            double x[2] = { ch0[i], ch1[i] };
+            for (int c = 0; c < 2; c++) {
+                double re = x[c] * ref_re, im = x[c] * ref_im;
+                for (int k = 0; k < order; k++) {
+                    double *z = li->z[c][k];
+                    z[0] += alpha * (re - z[0]);
+                    z[1] += alpha * (im - z[1]);
+                    re = z[0];
+                    im = z[1];
+                }
+            }
+            double r = ref_re * inc_re - ref_im * inc_im;
+            ref_im = ref_re * inc_im + ref_im * inc_re;
+            ref_re = r;
+            li->n++;
+
+            li->countdown -= 1.0;
+            if (li->countdown <= 0.0) {
+                li->countdown += li->interval;
+                if (n_out < max_out)
+                    lockin_emit(li, time ? time[i] : (li->n - 1) / li->cfg.fs, &out[n_out++]);
+            }
+        }
+        li->phase += li->step * (uint64_t)len;
+    }
+    return n_out;
+}
+
+void lockin_print_output(const LockInOutput *o) {
+    printf("%.6lf s: bearing %7.2lf deg, ratio %7.2lf dB, phase %7.2lf deg, |CH 0| %lg V, |CH 1| %lg V%s\n",
+           o->t, o->bearing_deg, o->ratio_db, o->phase_deg, cabs(o->z[0]), cabs(o->z[1]),
+           o->settled ? "" : " (settling)");
+}
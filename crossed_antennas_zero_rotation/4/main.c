@@ -1,40 +1,334 @@
 #include "includes.h"
 
+#define STREAM_DC_CUTOFF_HZ 10.0
+#define STREAM_REPORT_SAMPLES (1 << 20)
+
+// Bandpass around the 25.2 kHz carrier
+#define BAND_CENTER_HZ 25200.0
+#define BAND_LOW_HZ 25000.0
+#define BAND_HIGH_HZ 25400.0
+#define BAND_TRANSITION_HZ 250.0
+#define BAND_RIPPLE_DB 0.5
+#define BAND_ATTEN_DB 60.0
+
+// Baseband analysis rate for -d
+#define DDC_OUTPUT_HZ 640.0
+
+// Beacon report ahead of the analysis: the band's bins of a sliding DFT
+// against reference bins off the carrier. It only reports; the stages
+// after it run either way.
+#define BEACON_WINDOW 5120              // 12.5 Hz bins at 64 kHz
+#define BEACON_REF_BINS 8               // reference bins on each side of the band
+#define BEACON_REF_GAP_HZ 500.0         // between the band and its reference bins
+#define BEACON_MIN_DB 12.0              // strongest band bin over the mean reference bin
+
+// Adaptive null for -n, on the DDC output
+#define NULL_LAMBDA 0.99                // about 100 baseband samples of memory
+#define NULL_MU 0.05
+#define NULL_REPORT_S 0.1
+
+// Lock-in bearing stream for -l
+#define LOCKIN_BANDWIDTH_HZ 20.0
+#define LOCKIN_ORDER 2
+#define LOCKIN_UPDATE_HZ 100.0
+
+static void print_peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        printf("Peak RSS = %.1f MB\n", usage.ru_maxrss / 1024.0);
+}
+
+// Every bin of the band for a window of n samples at fs, then the
+// reference bins either side of it; returns the number of bins, *n_ref of
+// them reference
+static int beacon_bins(double fs, int n_window, double *freqs, int *n_ref) {
+    double df = fs / n_window;
+    int k0 = (int)ceil(BAND_LOW_HZ / df), k1 = (int)floor(BAND_HIGH_HZ / df);
+    int gap = (int)ceil(BEACON_REF_GAP_HZ / df);
+    int n = 0;
+    for (int k = k0; k <= k1 && n < SDFT_MAX_BINS - 2 * BEACON_REF_BINS; k++)
+        freqs[n++] = k * df;
+    for (int j = 1; j <= BEACON_REF_BINS; j++) {
+        freqs[n++] = (k0 - gap - j) * df;
+        freqs[n++] = (k1 + gap + j) * df;
+    }
+    *n_ref = 2 * BEACON_REF_BINS;
+    return n;
+}
+
+// Fewest taps meeting the band spec at fs
+static int design_band_filter(double fs, FIRFilter *filter) {
+    FIRSpec spec = { fs, BAND_LOW_HZ, BAND_HIGH_HZ, BAND_TRANSITION_HZ, BAND_RIPPLE_DB, BAND_ATTEN_DB };
+    if (design_fir_min(&spec, FIR_DESIGN_AUTO, MAX_FIR_TAPS, filter) != 0)
+        return -1;
+    fir_print_design(filter, &spec);
+    return 0;
+}
+
+// Block-by-block run at the nominal 64 kHz; plots show the last block
+static int run_streaming(const char *filename, char **rm) {
+    if (is_cml_file(filename)) {
+        fprintf(stderr, "Streaming reads CSV files; load .cml captures without -s.\n");
+        *rm = "Arguments\n";
+        return EXIT_FAILURE;
+    }
+
+    FIRFilter filter;
+    double fs = 64000.0;
+    if (design_band_filter(fs, &filter) != 0) {
+        fprintf(stderr, "Filter creation failed.\n");
+        *rm = "Bad IIR coeffs\n";
+        return EXIT_FAILURE;
+    }
+
+    StreamConfig cfg = { fs, STREAM_DC_CUTOFF_HZ, &filter, STREAM_BLOCK, STREAM_REPORT_SAMPLES };
+    StreamStats stats;
+    Capture tail = {0};
+    if (stream_process_csv(filename, &cfg, &stats, &tail) != 0) {
+        *rm = "Streaming failed\n";
+        return EXIT_FAILURE;
+    }
+
+    stream_stats_print(&stats);
+    Timebase timebase;
+    if (timebase_fit(&stats.timebase, &timebase) == 0)
+        timebase_print(&stats.timebase, &timebase);
+    plot_data_capture(&tail);
+    plot_fft_db_capture(&tail);
+    plot_xy_capture(&tail);
+    capture_free(&tail);
+    return 0;
+}
+
+// Bearing readings at LOCKIN_UPDATE_HZ while the file streams in, no plots
+static int run_lockin(const char *filename, char **rm) {
+    if (is_cml_file(filename)) {
+        fprintf(stderr, "Streaming reads CSV files; load .cml captures without -l.\n");
+        *rm = "Arguments\n";
+        return EXIT_FAILURE;
+    }
+
+    LockInConfig cfg = { 64000.0, BAND_CENTER_HZ, LOCKIN_BANDWIDTH_HZ, LOCKIN_ORDER, LOCKIN_UPDATE_HZ };
+    LockIn li;
+    if (lockin_init(&li, &cfg) != 0) {
+        *rm = "Bad lock-in settings\n";
+        return EXIT_FAILURE;
+    }
+    printf("Lock-in at %.1lf Hz, %.1lf Hz bandwidth, %.0lf readings/s\n",
+           cfg.f_ref, cfg.bandwidth, cfg.update_hz);
+
+    CSVStream cs;
+    Capture block = {0};
+    LockInOutput out[STREAM_BLOCK];
+    int rv = EXIT_FAILURE;
+    *rm = "Streaming failed\n";
+    if (csv_stream_open(&cs, filename) != 0)
+        return rv;
+    if (capture_init(&block, 2, STREAM_BLOCK, 1) != 0)
+        goto cleanup;
+
+    while (csv_stream_read(&cs, &block) > 0) {
+        int n_out = lockin_process(&li, block.ch[0], block.ch[1], block.time, block.n_samples,
+                                   out, STREAM_BLOCK);
+        for (int i = 0; i < n_out; i++)
+            lockin_print_output(&out[i]);
+    }
+    rv = 0;
+    *rm = "Success\n";
+
+cleanup:
+    capture_free(&block);
+    csv_stream_close(&cs, filename);
+    return rv;
+}
+
+// Electronic null while the file streams in: the DDC's baseband of both
+// loops through an RLS and an NLMS combiner, reported every NULL_REPORT_S.
+// The loops share a DC offset, which would be the strongest common-mode
+// signal the combiners see, so it is blocked as for -s; and they start
+// once the chain's start-up transient has passed.
+static int run_null_steer(const char *filename, char **rm) {
+    if (is_cml_file(filename)) {
+        fprintf(stderr, "Streaming reads CSV files; load .cml captures without -n.\n");
+        *rm = "Arguments\n";
+        return EXIT_FAILURE;
+    }
+
+    DDCConfig ddc_cfg = { 64000.0, BAND_CENTER_HZ, DDC_OUTPUT_HZ, BAND_HIGH_HZ - BAND_LOW_HZ,
+                          BAND_RIPPLE_DB, BAND_ATTEN_DB };
+    DDC ddc;
+    NullSteer ns[2];
+    StreamIIR dc[2];
+    *rm = "Bad null steering settings\n";
+    if (ddc_init(&ddc, &ddc_cfg, 2) != 0)
+        return EXIT_FAILURE;
+    ddc_print(&ddc);
+    if (null_steer_init(&ns[0], NULL_RLS, 0.0, NULL_LAMBDA) != 0
+        || null_steer_init(&ns[1], NULL_NLMS, NULL_MU, NULL_LAMBDA) != 0
+        || stream_iir_dc_blocker(&dc[0], ddc_cfg.fs, STREAM_DC_CUTOFF_HZ) != 0
+        || stream_iir_dc_blocker(&dc[1], ddc_cfg.fs, STREAM_DC_CUTOFF_HZ) != 0) {
+        ddc_free(&ddc);
+        return EXIT_FAILURE;
+    }
+
+    CSVStream cs;
+    Capture block = {0};
+    double complex iq[2][STREAM_BLOCK];
+    double complex *out[2] = { iq[0], iq[1] };
+    int report = (int)(NULL_REPORT_S * DDC_OUTPUT_HZ);
+    // The chain's impulse response spans twice its group delay
+    long long n_skip = (long long)ceil(2.0 * ddc.delay / ddc.decimation);
+    long long n_iq = 0;
+    int primed = 0;
+    int rv = EXIT_FAILURE;
+    *rm = "Streaming failed\n";
+    if (csv_stream_open(&cs, filename) != 0) {
+        ddc_free(&ddc);
+        return rv;
+    }
+    if (capture_init(&block, 2, STREAM_BLOCK, 1) != 0)
+        goto cleanup;
+
+    while (csv_stream_read(&cs, &block) > 0) {
+        for (int c = 0; c < 2; c++) {
+            if (!primed)
+                stream_iir_prime(&dc[c], block.ch[c][0]);
+            stream_iir_process(&dc[c], block.ch[c], block.n_samples);
+        }
+        primed = 1;
+        int n = ddc_process(&ddc, (const double *const *)block.ch, block.n_samples, out);
+        if (n < 0)
+            goto cleanup;
+        // In pieces ending on the report instants
+        for (int i = 0; i < n; ) {
+            int len = report - (int)(n_iq % report);
+            if (len > n - i)
+                len = n - i;
+            int skip = n_iq < n_skip ? (int)(n_skip - n_iq < len ? n_skip - n_iq : len) : 0;
+            for (int a = 0; a < 2; a++)
+                null_steer_process(&ns[a], iq[0] + i + skip, iq[1] + i + skip, len - skip);
+            i += len;
+            n_iq += len;
+            if (n_iq % report == 0) {
+                printf("%.2lf s:", n_iq / DDC_OUTPUT_HZ);
+                for (int a = 0; a < 2; a++) {
+                    NullEstimate est;
+                    if (null_steer_estimate(&ns[a], &est) == 0)
+                        printf("  %s bearing %7.2lf deg, depth %6.1lf dB, phase %6.2lf deg%s",
+                               null_algorithm_name(ns[a].alg), est.bearing_deg, est.depth_db,
+                               est.weight_phase_deg, est.settled ? "" : " (settling)");
+                }
+                printf("\n");
+            }
+        }
+    }
+    rv = 0;
+    *rm = "Success\n";
+
+cleanup:
+    capture_free(&block);
+    csv_stream_close(&cs, filename);
+    ddc_free(&ddc);
+    return rv;
+}
+
 int main(int argc, char **argv) {
     int rv = 0;
     char *rm = "Success\n";
+    int streaming = argc == 3 && strcmp(argv[1], "-s") == 0;
+    int downconvert = argc == 3 && strcmp(argv[1], "-d") == 0;
+    int lockin = argc == 3 && strcmp(argv[1], "-l") == 0;
+    int nulling = argc == 3 && strcmp(argv[1], "-n") == 0;
+    const char *path = argv[argc - 1];
 
-    DataSample data[MAX_SAMPLES];
-    int n_samples = 0;
+    Capture cap = {0};
+    CaptureSegment *segs = NULL;
+    int n_segs = 0;
 
     FIRFilter filter;
     double fs, accuracy_percent;
 
     close_existing_gnuplot_windows();
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <data_file.csv>\n", argv[0]);
+    if (argc != 2 && !streaming && !downconvert && !lockin && !nulling) {
+        fprintf(stderr, "Usage: %s [-s | -d | -l | -n] <data_file.csv>\n", argv[0]);
         rv =  EXIT_FAILURE;
         rm = "Arguments\n"; 
     }
 
-    if (!rv && !read_csv(argv[1], data, &n_samples)) {
+    // -s streams the file in constant memory instead of loading it
+    if (!rv && streaming) {
+        rv = run_streaming(path, &rm);
+        print_peak_rss();
+        printf("return value = %d, reason: %s\n", rv, rm);
+        return rv;
+    }
+
+    // -l prints the lock-in bearing stream instead
+    if (!rv && lockin) {
+        rv = run_lockin(path, &rm);
+        print_peak_rss();
+        printf("return value = %d, reason: %s\n", rv, rm);
+        return rv;
+    }
+
+    // -n prints the adaptive null instead
+    if (!rv && nulling) {
+        rv = run_null_steer(path, &rm);
+        print_peak_rss();
+        printf("return value = %d, reason: %s\n", rv, rm);
+        return rv;
+    }
+
+    if (!rv && is_cml_file(path)) {
+        if (read_cml_capture(path, &cap, NULL) != 0) {
+            rv = EXIT_FAILURE;
+            rm = "Wrong input\n";
+        }
+    }
+    else if (!rv && !read_csv_capture(path, &cap)) {
         fprintf(stderr, "Error reading CSV file.\n");
         rv = EXIT_FAILURE;
         rm = "Wrong input\n";
     }
 
-    if (!rv && n_samples == 0) {
+    if (!rv && cap.n_samples == 0) {
         fprintf(stderr, "No valid samples found.\n");
         rv = EXIT_FAILURE;
         rm = "No samples\n";
     }
 
     if(!rv) {
-      printf("Read %d samples successfully.\n", n_samples);
+      printf("Read %d samples successfully.\n", cap.n_samples);
+
+      // Keep only t0 and fs when the timestamps are on a clean grid
+      Timebase timebase;
+      if (capture_fit_timebase(&cap, &timebase, 1) != 0) {
+        fprintf(stderr, "No time base could be fitted to the timestamps.\n");
+        rv = EXIT_FAILURE;
+        rm = "No time base\n";
+      }
+    }
+
+    if (!rv) {
+      // Gaps and glitches split the capture; each segment is processed on its own
+      n_segs = capture_find_segments(&cap, &segs);
+      if (n_segs <= 0) {
+        fprintf(stderr, "No uniform segment of %d samples found.\n", SEGMENT_MIN_SAMPLES);
+        rv = EXIT_FAILURE;
+        rm = "Bad time base\n";
+      }
+    }
 
-      remove_dc(data, n_samples);
+    if(!rv) {
+      capture_print_segments(&cap, segs, n_segs);
+      for (int s = 0; s < n_segs; s++) {
+        Capture seg;
+        capture_segment_view(&cap, &segs[s], &seg);
+        remove_dc_capture(&seg);
+      }
+      capture_blank_gaps(&cap, segs, n_segs);
 
-      if(!calculate_sampling_rate(data, n_samples, &fs, &accuracy_percent)) {
+      if(!calculate_sampling_rate_capture(&cap, &fs, &accuracy_percent)) {
         fs = 64000.0;
         printf("Calculated Sampling Rate = %lf Hz, Accuracy = ±%lf%%\n", fs, accuracy_percent);
       }
@@ -45,28 +339,115 @@ int main(int argc, char **argv) {
       }
     }
 
-    if(!rv) { 
-      if (generate_fir_bandpass(fs, 25000.0, 25400.0, 1, MAX_FIR_TAPS, &filter) != 0) {
+    // Is the carrier there at all? The band's bins over the last window of
+    // the longest segment
+    if (!rv) {
+      int longest = capture_longest_segment(segs, n_segs);
+      Capture seg;
+      capture_segment_view(&cap, &segs[longest], &seg);
+      SDFTTracker beacon;
+      double f_beacon[SDFT_MAX_BINS];
+      int window = seg.n_samples < BEACON_WINDOW ? seg.n_samples : BEACON_WINDOW;
+      int n_ref, n_beacon = beacon_bins(fs, window, f_beacon, &n_ref);
+      if (seg.n_channels >= 2 && sdft_init(&beacon, fs, window, f_beacon, n_beacon, n_ref) == 0) {
+        // Only the last window reaches the bins, so only it is pushed
+        int from = seg.n_samples - window;
+        sdft_push(&beacon, seg.ch[0] + from, seg.ch[1] + from, window);
+        int peak[2] = { sdft_peak_bin(&beacon, 0), sdft_peak_bin(&beacon, 1) };
+        printf("Beacon %s: %.1lf dB over the noise at %.0lf Hz on CH 0, %.1lf dB at %.0lf Hz on CH 1 "
+               "of the last %d samples.\n", sdft_present(&beacon, BEACON_MIN_DB) ? "present" : "not detected",
+               sdft_bin_db(&beacon, 0, peak[0]), sdft_bin_hz(&beacon, peak[0]),
+               sdft_bin_db(&beacon, 1, peak[1]), sdft_bin_hz(&beacon, peak[1]), window);
+        sdft_free(&beacon);
+      }
+
+      // Noise floor and band power, averaged over the segment
+      WelchConfig welch = { seg.n_samples < WELCH_SEGMENT ? seg.n_samples : WELCH_SEGMENT, 0.5, WINDOW_HANN, 0 };
+      WelchPSD psd;
+      if (welch_psd(&seg, &welch, &psd) == 0) {
+        welch_print_summary(&psd, BAND_LOW_HZ, BAND_HIGH_HZ);
+        welch_psd_free(&psd);
+      }
+    }
+
+    // -d mixes the carrier band to baseband and analyses it at the low rate
+    if (!rv && downconvert) {
+      int longest = capture_longest_segment(segs, n_segs);
+      Capture seg;
+      capture_segment_view(&cap, &segs[longest], &seg);
+      DDCConfig ddc = { fs, BAND_CENTER_HZ, DDC_OUTPUT_HZ, BAND_HIGH_HZ - BAND_LOW_HZ, BAND_RIPPLE_DB, BAND_ATTEN_DB };
+      IQCapture iq;
+      if (capture_downconvert(&seg, &ddc, &iq) != 0) {
+        rv = EXIT_FAILURE;
+        rm = "Downconversion failed\n";
+      } else {
+        printf("Segment %d downconverted to %d IQ samples at %g Hz.\n", longest, iq.n_samples, iq.fs);
+        plot_iq_spectrum(&iq);
+        iq_capture_free(&iq);
+      }
+    }
+
+    if(!rv && !downconvert) { 
+      if (design_band_filter(fs, &filter) != 0) {
         fprintf(stderr, "Filter creation failed.\n");
         rv = EXIT_FAILURE;
         rm = "Bad IIR coeffs\n";
       }
     }
 
-    if(!rv) {
+    if(!rv && !downconvert) {
      //test for filter
-     //double scale = 0.1*find_scale(data, n_samples);
-     //generate_sinusoid(data,n_samples,scale, scale,-12500.0, fs);
-     //generate_filtered_noise(data, n_samples, fs, &filter);
-     //generate_sinusoid(data,n_samples,scale, scale,12500.0, fs);
-     //generate_sinusoid(data,n_samples,scale, scale,25200.0, fs);
+     //double scale = 0.1*find_scale_capture(&cap);
+     //generate_sinusoid_capture(&cap,scale, scale,-12500.0, fs);
+     //generate_filtered_noise_capture(&cap, fs, &filter);
+     //generate_sinusoid_capture(&cap,scale, scale,12500.0, fs);
+     //generate_sinusoid_capture(&cap,scale, scale,25200.0, fs);
 
-      filter_data(data, n_samples, &filter);
-      plot_data(data, n_samples);
-      plot_fft_db(data, n_samples);
-      plot_xy(data, n_samples);
+      // The null from the filtered segments, gaps left out. The filter's
+      // start-up and tail, half its length at each end of a segment, are
+      // left out too, as the streaming run never sees them.
+      XYCovariance xy;
+      xy_cov_reset(&xy);
+      int edge = filter.num_taps / 2;
+      for (int s = 0; s < n_segs; s++) {
+        Capture seg;
+        capture_segment_view(&cap, &segs[s], &seg);
+        if (filter_capture(&seg, &filter) != 0) {
+          rv = EXIT_FAILURE;
+          rm = "Filtering failed\n";
+          break;
+        }
+        if (seg.n_samples > 2 * edge)
+          xy_cov_update(&xy, seg.ch[0] + edge, seg.ch[1] + edge, seg.n_samples - 2 * edge);
+      }
+      XYEllipse ellipse;
+      if (!rv && xy_ellipse_fit(&xy, &ellipse) == 0)
+        xy_ellipse_print(&ellipse);
+
+      // Spectra need a uniform grid: use the longest segment
+      int longest = capture_longest_segment(segs, n_segs);
+      Capture seg;
+      capture_segment_view(&cap, &segs[longest], &seg);
+      if (n_segs > 1)
+        printf("Spectrum of segment %d (%d samples).\n", longest, seg.n_samples);
+
+      plot_data_capture(&cap);
+      WelchConfig welch = { seg.n_samples < WELCH_SEGMENT ? seg.n_samples : WELCH_SEGMENT, 0.5, WINDOW_HANN, 0 };
+      WelchPSD psd;
+      if (welch_psd(&seg, &welch, &psd) == 0) {
+        plot_welch_psd(&psd);
+        welch_psd_free(&psd);
+      }
+      plot_xy_capture(&cap);
     }
 
+    free(segs);
+    capture_free(&cap);
+    arena_free(scratch_arena());
+    window_cache_free();
+    fir_design_cache_free();
+    print_peak_rss();
+
     printf("return value = %d, reason: %s\n", rv, rm);
     return rv;
 }
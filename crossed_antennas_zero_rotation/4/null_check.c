@@ -0,0 +1,149 @@
+#include "includes.h"
+
+// null_check: the adaptive null steering against sources of known bearing.
+// Baseband phasors of one modulated source on the crossed loops, ch0 its
+// cosine and ch1 its sine of the bearing, with a little noise on each,
+// go through NLMS and RLS set up as main uses them. Once settled, each
+// must null the source at its bearing and deep, whichever loop is the
+// stronger; an estimate must not claim to have settled after a single
+// memory, and the same phasors pushed in odd-sized blocks must give the
+// same weight as in one go. Exits non-zero if any case fails.
+
+#define NULL_CHECK_LAMBDA 0.99          // as main
+#define NULL_CHECK_MU 0.05
+#define NULL_CHECK_SAMPLES 8000
+#define NULL_CHECK_NOISE 1e-3           // per channel, against a unit source
+#define NULL_CHECK_BEARING_TOL 0.5      // degrees
+#define NULL_CHECK_DEPTH_DB -40.0
+
+static const double null_bearings[] = { 0.0, 20.0, -45.0, 60.0, -80.0, 90.0 };
+static const int null_blocks[] = { 1, 7, 1000 };
+
+static int report(const char *what, double value, const char *unit, int ok) {
+    printf("%-38s %10.4g %-4s %s\n", what, value, unit, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+// Zero-mean Gaussian noise of rms sigma, Box-Muller on rand()
+static double check_noise(double sigma) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = rand() / (RAND_MAX + 1.0);
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double fold90(double deg) {
+    deg = fmod(deg + 90.0, 180.0);
+    if (deg < 0.0)
+        deg += 180.0;
+    return deg - 90.0;
+}
+
+// A unit source of random phase and slowly varying amplitude at bearing deg
+static void check_source(double complex *z0, double complex *z1, int n, double deg) {
+    double a = deg * M_PI / 180.0;
+    double sigma = NULL_CHECK_NOISE / sqrt(2.0);
+    srand(n + (int)deg);
+    for (int i = 0; i < n; i++) {
+        double complex s = (1.0 + 0.3 * sin(i * 0.01)) * cexp(I * 2.0 * M_PI * rand() / (RAND_MAX + 1.0));
+        z0[i] = s * cos(a) + check_noise(sigma) + I * check_noise(sigma);
+        z1[i] = s * sin(a) + check_noise(sigma) + I * check_noise(sigma);
+    }
+}
+
+static int init(NullSteer *ns, NullAlgorithm alg) {
+    return null_steer_init(ns, alg, alg == NULL_NLMS ? NULL_CHECK_MU : 0.0, NULL_CHECK_LAMBDA);
+}
+
+static int check_bearing(NullAlgorithm alg, double deg, const double complex *z0, const double complex *z1) {
+    NullSteer ns;
+    NullEstimate est;
+    if (init(&ns, alg) != 0)
+        return 1;
+    null_steer_process(&ns, z0, z1, NULL_CHECK_SAMPLES);
+    if (null_steer_estimate(&ns, &est) != 0)
+        return 1;
+
+    char what[64];
+    double err = fabs(fold90(est.bearing_deg - deg));
+    snprintf(what, sizeof(what), "%s bearing %+.0f deg, error", null_algorithm_name(alg), deg);
+    int failed = report(what, err, "deg", err < NULL_CHECK_BEARING_TOL && est.settled);
+    snprintf(what, sizeof(what), "%s bearing %+.0f deg, depth", null_algorithm_name(alg), deg);
+    failed += report(what, est.depth_db, "dB", est.depth_db < NULL_CHECK_DEPTH_DB);
+    return failed;
+}
+
+// One memory of the power estimates (or of the NLMS step) is too early
+static int check_settle(NullAlgorithm alg, const double complex *z0, const double complex *z1) {
+    NullSteer ns;
+    NullEstimate est;
+    if (init(&ns, alg) != 0)
+        return 1;
+    double memory = 1.0 / (1.0 - NULL_CHECK_LAMBDA);
+    if (alg == NULL_NLMS)
+        memory = fmax(memory, 1.0 / NULL_CHECK_MU);
+    int n = (int)ceil(memory);
+    null_steer_process(&ns, z0, z1, n);
+    int early = null_steer_estimate(&ns, &est) == 0 && est.settled;
+    null_steer_process(&ns, z0 + n, z1 + n, NULL_CHECK_SAMPLES - n);
+    int later = null_steer_estimate(&ns, &est) == 0 && est.settled;
+
+    char what[64];
+    snprintf(what, sizeof(what), "%s not settled after samples", null_algorithm_name(alg));
+    return report(what, n, "", !early && later);
+}
+
+// Bit for bit the same state in blocks as in one go
+static int check_blocks(NullAlgorithm alg, const double complex *z0, const double complex *z1) {
+    NullSteer ref, ns;
+    if (init(&ref, alg) != 0)
+        return 1;
+    null_steer_process(&ref, z0, z1, NULL_CHECK_SAMPLES);
+
+    int failed = 0;
+    int n_cases = sizeof(null_blocks) / sizeof(null_blocks[0]);
+    for (int k = 0; k < n_cases; k++) {
+        if (init(&ns, alg) != 0)
+            return failed + 1;
+        for (int i0 = 0; i0 < NULL_CHECK_SAMPLES; i0 += null_blocks[k]) {
+            int len = NULL_CHECK_SAMPLES - i0 < null_blocks[k] ? NULL_CHECK_SAMPLES - i0 : null_blocks[k];
+            null_steer_process(&ns, z0 + i0, z1 + i0, len);
+        }
+        int same = ns.ref == ref.ref && ns.n == ref.n
+                && memcmp(&ns.w, &ref.w, sizeof(ns.w)) == 0
+                && memcmp(&ns.out_power, &ref.out_power, sizeof(double)) == 0;
+        char what[64];
+        snprintf(what, sizeof(what), "%s in blocks of", null_algorithm_name(alg));
+        failed += report(what, null_blocks[k], "", same);
+    }
+    return failed;
+}
+
+int main(void) {
+    static const NullAlgorithm algs[] = { NULL_NLMS, NULL_RLS };
+    double complex *z0 = (double complex*)malloc(NULL_CHECK_SAMPLES * sizeof(double complex));
+    double complex *z1 = (double complex*)malloc(NULL_CHECK_SAMPLES * sizeof(double complex));
+    if (!z0 || !z1) {
+        free(z0);
+        free(z1);
+        fprintf(stderr, "Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int failed = 0;
+    int n_bearings = sizeof(null_bearings) / sizeof(null_bearings[0]);
+    for (int b = 0; b < n_bearings; b++) {
+        check_source(z0, z1, NULL_CHECK_SAMPLES, null_bearings[b]);
+        for (int a = 0; a < 2; a++)
+            failed += check_bearing(algs[a], null_bearings[b], z0, z1);
+    }
+
+    check_source(z0, z1, NULL_CHECK_SAMPLES, 30.0);
+    for (int a = 0; a < 2; a++) {
+        failed += check_settle(algs[a], z0, z1);
+        failed += check_blocks(algs[a], z0, z1);
+    }
+
+    free(z0);
+    free(z1);
+    printf("%s\n", failed ? "Null steering check failed." : "Null steering check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include "includes.h"
+
+// Electronic null steering of the crossed loops.
+// Rotating the loops until one channel goes quiet finds the null by hand.
+// Here the baseband phasors of both loops are combined as d + w u instead,
+// u the stronger channel and d the other, and the complex weight w adapts
+// sample by sample to minimize the combined output. At convergence the
+// virtual loop cos(a) ch0 + sin(a) ch1 with tan(a) given by the weight
+// nulls the source; the real part of the weight gives the angle, the
+// imaginary part whatever phase difference the loops have. With one weight
+// both NLMS and RLS are O(1) per sample: RLS reduces to dividing by the
+// exponentially weighted power of u. Should the weight grow past
+// NULL_SWAP_GAIN the null has turned towards u, and the channels swap
+// roles with w replaced by 1 / w, which leaves the null where it was.
+// An estimate counts as settled after NULL_SETTLE_TAU memories of the
+// slower of the power estimates and, for NLMS, the step.
+
+#define NULL_SWAP_GAIN 2.0
+#define NULL_NLMS_EPS 1e-3              // NLMS regularization, against the mean power of u
+#define NULL_SETTLE_TAU 3.0             // time constants, about 95 %
+
+static double fold90(double deg) {
+    deg = fmod(deg + 90.0, 180.0);
+    if (deg < 0.0)
+        deg += 180.0;
+    return deg - 90.0;
+}
+
+const char *null_algorithm_name(NullAlgorithm alg) {
+    return alg == NULL_RLS ? "RLS" : "NLMS";
+}
+
+// mu is the NLMS step (0 to 2), lambda the RLS forgetting factor and the
+// memory of the power estimates (0 to 1)
+int null_steer_init(NullSteer *ns, NullAlgorithm alg, double mu, double lambda) {
+    memset(ns, 0, sizeof(*ns));
+    if ((alg != NULL_NLMS && alg != NULL_RLS) || lambda <= 0.0 || lambda >= 1.0
+        || (alg == NULL_NLMS && (mu <= 0.0 || mu >= 2.0))) {
+        fprintf(stderr, "Invalid null steering parameters.\n");
+        return -1;
+    }
+    ns->alg = alg;
+    ns->mu = mu;
+    ns->lambda = lambda;
+    null_steer_reset(ns);
+    return 0;
+}
+
+void null_steer_reset(NullSteer *ns) {
+    ns->w = 0.0;
+    ns->ref = 1;
+    ns->power[0] = ns->power[1] = 0.0;
+    ns->out_power = 0.0;
+    ns->n = 0;
+}
+
+void null_steer_process(NullSteer *ns, const double complex *z0, const double complex *z1, int n) {
+    double lambda = ns->lambda;
+    for (int i = 0; i < n; i++) {
+        double complex z[2] = { z0[i], z1[i] };
+        double p0 = creal(z[0]) * creal(z[0]) + cimag(z[0]) * cimag(z[0]);
+        double p1 = creal(z[1]) * creal(z[1]) + cimag(z[1]) * cimag(z[1]);
+        ns->power[0] = lambda * ns->power[0] + p0;
+        ns->power[1] = lambda * ns->power[1] + p1;
+
+        double complex u = z[ns->ref], d = z[1 - ns->ref];
+        double complex e = d + ns->w * u;
+        ns->out_power = lambda * ns->out_power + creal(e) * creal(e) + cimag(e) * cimag(e);
+
+        double norm;
+        if (ns->alg == NULL_RLS) {
+            norm = ns->power[ns->ref];
+        } else {
+            double pu = ns->ref ? p1 : p0;
+            norm = (pu + NULL_NLMS_EPS * ns->power[ns->ref] * (1.0 - lambda)) / ns->mu;
+        }
+        if (norm > 0.0)
+            ns->w -= e * conj(u) / norm;
+
+        double g2 = creal(ns->w) * creal(ns->w) + cimag(ns->w) * cimag(ns->w);
+        if (g2 > NULL_SWAP_GAIN * NULL_SWAP_GAIN) {
+            ns->w = conj(ns->w) / g2;
+            ns->ref = 1 - ns->ref;
+            ns->out_power /= g2;
+        }
+        ns->n++;
+    }
+}
+
+int null_steer_estimate(const NullSteer *ns, NullEstimate *est) {
+    memset(est, 0, sizeof(*est));
+    double total = ns->power[0] + ns->power[1];
+    if (ns->n == 0 || total <= 0.0)
+        return -1;
+
+    // Output a z0 + b z1
+    double complex a = ns->ref ? 1.0 : ns->w;
+    double complex b = ns->ref ? ns->w : 1.0;
+    double norm = creal(a * conj(a) + b * conj(b));
+
+    est->null_deg = fold90(atan2(creal(b), creal(a)) * 180.0 / M_PI);
+    est->bearing_deg = fold90(est->null_deg - 90.0);
+    double depth = ns->out_power / (norm * total);
+    est->depth_db = depth > 0.0 ? 10.0 * log10(depth) : DB_FLOOR;
+    est->weight_phase_deg = creal(ns->w) != 0.0 || cimag(ns->w) != 0.0
+        ? fold90(carg(ns->w) * 180.0 / M_PI) : 0.0;
+    double memory = 1.0 / (1.0 - ns->lambda);
+    if (ns->alg == NULL_NLMS && 1.0 / ns->mu > memory)
+        memory = 1.0 / ns->mu;
+    est->settled = ns->n >= NULL_SETTLE_TAU * memory;
+    return 0;
+}
@@ -1,15 +1,125 @@
 #include "includes.h"
 
-// Parsing suffixes: 'm' (milli), 'u' (micro)
+// Decimal number with an optional SI suffix, parsed without libc.
+// Digits accumulate into a 64-bit mantissa and the suffix folds into the
+// decimal exponent, so "12.5m" is 125e-4. Mantissas up to 2^53 with
+// exponents within +-22 convert exactly with one multiply or divide by an
+// exact power of ten (correctly rounded); anything else goes to strtod.
+
+static const double si_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Mantissas longer than 19 digits; significant digits past the 19th are
+// dropped and only shift the exponent
+static const char *parse_long_mantissa(const char *p, const char *end,
+                                       unsigned long long *mant, int *exp10) {
+    int n_kept = 0, seen_point = 0;
+    *mant = 0;
+    *exp10 = 0;
+    for (; p < end; p++) {
+        if (*p == '.' && !seen_point) {
+            seen_point = 1;
+            continue;
+        }
+        if ((unsigned)(*p - '0') >= 10)
+            break;
+        if (n_kept < 19) {
+            *mant = *mant * 10 + (*p - '0');
+            n_kept += (*mant != 0);
+            *exp10 -= seen_point;
+        } else {
+            *exp10 += !seen_point;
+        }
+    }
+    return p;
+}
+
+// Parses [+-]digits[.digits][e[+-]digits][p|n|u|m|k|M|G] from [p, end).
+// Returns the first character after the number, NULL if there is none.
+const char *parse_si(const char *p, const char *end, double *value) {
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    const char *digits = p;
+    unsigned long long mant = 0;
+    int exp10 = 0;
+    while (p < end && (unsigned)(*p - '0') < 10)
+        mant = mant * 10 + (*p++ - '0');
+    int n_digits = (int)(p - digits);
+    if (p < end && *p == '.') {
+        const char *frac = ++p;
+        while (p < end && (unsigned)(*p - '0') < 10)
+            mant = mant * 10 + (*p++ - '0');
+        exp10 = -(int)(p - frac);
+        n_digits -= exp10;
+    }
+    if (n_digits == 0)
+        return NULL;
+    if (n_digits > 19)
+        p = parse_long_mantissa(digits, end, &mant, &exp10);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int exp_neg = 0, e = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_neg = (*q == '-');
+            q++;
+        }
+        if (q == end || (unsigned)(*q - '0') >= 10)
+            return NULL;
+        for (; q < end && (unsigned)(*q - '0') < 10; q++)
+            if (e < 100000)
+                e = e * 10 + (*q - '0');
+        exp10 += exp_neg ? -e : e;
+        p = q;
+    }
+
+    if (p < end) {
+        switch (*p) {
+            case 'p': exp10 -= 12; p++; break;
+            case 'n': exp10 -= 9; p++; break;
+            case 'u': exp10 -= 6; p++; break;
+            case 'm': exp10 -= 3; p++; break;
+            case 'k': exp10 += 3; p++; break;
+            case 'M': exp10 += 6; p++; break;
+            case 'G': exp10 += 9; p++; break;
+            default: break;
+        }
+    }
+
+    double v;
+    if (mant == 0) {
+        v = 0.0;
+    } else if (mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        v = exp10 < 0 ? (double)mant / si_pow10[-exp10] : (double)mant * si_pow10[exp10];
+    } else {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%llue%d", mant, exp10);
+        v = strtod(buf, NULL);
+    }
+
+    *value = neg ? -v : v;
+    return p;
+}
+
+// Parsing suffixes: 'm' (milli), 'u' (micro), also p, n, k, M, G.
+// The whole token must be one number, surrounding whitespace aside.
 int parse_suffix(char *str, double *value) {
+    const char *p = str;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    const char *end = p + strlen(p);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+
     double val;
-    char suffix[4] = "";
-    int res = sscanf(str, "%lf%3s", &val, suffix);
-    if (res < 1) return 0;
-    if (strcmp(suffix, "m") == 0) val *= 1e-3;
-    else if (strcmp(suffix, "u") == 0) val *= 1e-6;
-    else if (strcmp(suffix, "") != 0) return 0;
+    if (parse_si(p, end, &val) != end)
+        return 0;
     *value = val;
     return 1;
 }
-
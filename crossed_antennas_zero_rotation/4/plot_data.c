@@ -25,3 +25,30 @@ void plot_data(DataSample *data, int n_samples) {
     pclose(gp);
 }
 
+
+// One line per channel against the capture's time axis
+void plot_data_capture(const Capture *cap) {
+    FILE *gp = popen("gnuplot -persistent", "w");
+    if (!gp) {
+        perror("popen");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(gp, "set title 'Voltage Channels vs. Time'\n");
+    fprintf(gp, "set xlabel 'Time (s)'\n");
+    fprintf(gp, "set ylabel 'Voltage (V)'\n");
+    fprintf(gp, "plot ");
+    for (int c = 0; c < cap->n_channels; c++)
+        fprintf(gp, "%s'-' with lines title 'CH %d'", c ? ", " : "", c);
+    fprintf(gp, "\n");
+
+    for (int c = 0; c < cap->n_channels; c++) {
+        for (int i = 0; i < cap->n_samples; i++)
+            fprintf(gp, "%lf %lf\n", capture_time(cap, i), cap->ch[c][i]);
+        fprintf(gp, "e\n");
+    }
+
+    fflush(gp);
+    printf("Plot displayed in gnuplot window.\n");
+    pclose(gp);
+}
@@ -1,28 +1,34 @@
 #include "includes.h"
 
-void plot_fft(DataSample *data, int n_samples) {
+// Shared by the DataSample and Capture entry points, one of data/cap is set
+static void plot_fft_impl(const DataSample *data, const Capture *cap, int n_samples, double fs) {
     FILE *gp = popen("gnuplot -persistent", "w");
     if (!gp) {
         perror("popen");
         exit(EXIT_FAILURE);
     }
 
-    double fs = 1.0 / (data[1].time - data[0].time);
-
-    double complex fft_ch0[n_samples];
-    double complex fft_ch1[n_samples];
-
-    // Perform DFT calculation
-    for (int k = 0; k < n_samples; k++) {
-        fft_ch0[k] = 0;
-        fft_ch1[k] = 0;
-        for (int n = 0; n < n_samples; n++) {
-            double theta = -2.0 * M_PI * k * n / n_samples;
-            fft_ch0[k] += data[n].ch0 * cexp(I * theta);
-            fft_ch1[k] += data[n].ch1 * cexp(I * theta);
-        }
+    int n_bins = n_samples / 2 + 1;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *fft_ch0 = (double complex*)arena_alloc(arena, n_bins * sizeof(double complex));
+    double complex *fft_ch1 = (double complex*)arena_alloc(arena, n_bins * sizeof(double complex));
+    FFTPlan *plan = fft_plan_create(n_samples, 0);
+    if (!fft_ch0 || !fft_ch1 || !plan) {
+        fprintf(stderr, "FFT setup failed.\n");
+        arena_release(arena, mark);
+        fft_plan_destroy(plan);
+        pclose(gp);
+        return;
     }
 
+    // Both channels from a single complex transform
+    if (data)
+        fft_dual_real(plan, data, fft_ch0, fft_ch1);
+    else
+        fft_dual_real_planar(plan, cap->ch[0], cap->ch[1], fft_ch0, fft_ch1);
+    fft_plan_destroy(plan);
+
     fprintf(gp, "set title 'FFT Magnitude Spectrum'\n");
     fprintf(gp, "set xlabel 'Frequency (Hz)'\n");
     fprintf(gp, "set ylabel 'Magnitude'\n");
@@ -43,7 +49,36 @@ void plot_fft(DataSample *data, int n_samples) {
     }
     fprintf(gp, "e\n");
 
+    arena_release(arena, mark);
+
     fflush(gp);
     printf("FFT plotted in gnuplot window.\n");
     pclose(gp);
 }
+
+void plot_fft(DataSample *data, int n_samples) {
+    // Least-squares rate over every timestamp, not just the first step
+    TimebaseEstimator tb;
+    Timebase fit;
+    timebase_init(&tb);
+    timebase_push(&tb, &data[0].time, sizeof(DataSample) / sizeof(double), n_samples);
+    if (timebase_fit(&tb, &fit) != 0) {
+        fprintf(stderr, "Timestamps do not advance.\n");
+        return;
+    }
+    plot_fft_impl(data, NULL, n_samples, fit.fs);
+}
+
+// Spectra of channels 0 and 1 of a capture
+void plot_fft_capture(const Capture *cap) {
+    if (cap->n_channels < 2 || cap->n_samples < 2) {
+        fprintf(stderr, "Capture needs two channels and two samples to plot.\n");
+        return;
+    }
+
+    if (cap->fs <= 0.0) {
+        fprintf(stderr, "Capture has no sampling rate.\n");
+        return;
+    }
+    plot_fft_impl(NULL, cap, cap->n_samples, cap->fs);
+}
@@ -0,0 +1,59 @@
+#include "includes.h"
+
+// Two-sided spectrum of every channel of a baseband capture, on the
+// absolute frequency axis around the carrier
+void plot_iq_spectrum(const IQCapture *iq) {
+    if (iq->n_samples < 2 || iq->fs <= 0.0) {
+        fprintf(stderr, "Baseband capture too short to plot.\n");
+        return;
+    }
+
+    FILE *gp = popen("gnuplot -persistent", "w");
+    if (!gp) {
+        perror("popen");
+        return;
+    }
+
+    int n = iq->n_samples;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *spec = (double complex*)arena_alloc(arena, n * sizeof(double complex));
+    FFTPlan *plan = fft_plan_create(n, 0);
+    if (!spec || !plan) {
+        fprintf(stderr, "FFT setup failed.\n");
+        arena_release(arena, mark);
+        fft_plan_destroy(plan);
+        pclose(gp);
+        return;
+    }
+
+    fprintf(gp, "set title 'Baseband Spectrum (dB) around %g Hz with Floor %g dB'\n", iq->f_center, DB_FLOOR);
+    fprintf(gp, "set xlabel 'Frequency (Hz)'\n");
+    fprintf(gp, "set ylabel 'Magnitude (dB)'\n");
+    fprintf(gp, "plot");
+    for (int c = 0; c < iq->n_channels; c++)
+        fprintf(gp, "%s '-' with lines title 'CH %d'", c ? "," : "", c);
+    fprintf(gp, "\n");
+
+    for (int c = 0; c < iq->n_channels; c++) {
+        if (fft_execute(plan, iq->ch[c], spec) != 0)
+            break;
+        // Negative frequencies first
+        for (int i = 0; i < n; i++) {
+            int k = (i + (n + 1) / 2) % n;
+            int f = k < (n + 1) / 2 ? k : k - n;
+            double magnitude_db = 20 * log10(cabs(spec[k]) / n);
+            if (magnitude_db < DB_FLOOR)
+                magnitude_db = DB_FLOOR;
+            fprintf(gp, "%lf %lf\n", iq->f_center + iq->fs * f / n, magnitude_db);
+        }
+        fprintf(gp, "e\n");
+    }
+
+    fft_plan_destroy(plan);
+    arena_release(arena, mark);
+
+    fflush(gp);
+    printf("Baseband spectrum plotted in gnuplot window.\n");
+    pclose(gp);
+}
@@ -0,0 +1,32 @@
+#include "includes.h"
+
+// Welch power spectral density of each channel in dB V^2/Hz
+void plot_welch_psd(const WelchPSD *psd) {
+    FILE *gp = popen("gnuplot -persistent", "w");
+    if (!gp) {
+        perror("popen");
+        return;
+    }
+
+    fprintf(gp, "set title 'Welch PSD (dB V^2/Hz), %d segments, %s window, ENBW %.1f Hz'\n",
+            psd->n_segments, window_name(psd->window), psd->enbw_hz);
+    fprintf(gp, "set xlabel 'Frequency (Hz)'\n");
+    fprintf(gp, "set ylabel 'PSD (dB V^2/Hz)'\n");
+    fprintf(gp, "plot");
+    for (int c = 0; c < psd->n_channels; c++)
+        fprintf(gp, "%s '-' with lines title 'CH %d'", c ? "," : "", c);
+    fprintf(gp, "\n");
+
+    for (int c = 0; c < psd->n_channels; c++) {
+        for (int k = 0; k < psd->n_bins; k++) {
+            // Exact zeros (blanked input) would be -inf
+            double p = psd->psd[c][k] > 0.0 ? 10.0 * log10(psd->psd[c][k]) : -400.0;
+            fprintf(gp, "%lf %lf\n", k * psd->df, p);
+        }
+        fprintf(gp, "e\n");
+    }
+
+    fflush(gp);
+    printf("PSD plotted in gnuplot window.\n");
+    pclose(gp);
+}
@@ -27,3 +27,35 @@ void plot_xy(DataSample *data, int n_samples) {
     pclose(gp);
 }
 
+
+// Channel 0 against channel 1 of a capture
+void plot_xy_capture(const Capture *cap) {
+    if (cap->n_channels < 2) {
+        fprintf(stderr, "Capture needs two channels for an XY plot.\n");
+        return;
+    }
+
+    FILE *gp = popen("gnuplot -persistent", "w");
+    if (!gp) {
+        perror("popen");
+        return;
+    }
+
+    double scale = find_scale_capture(cap);
+
+    fprintf(gp, "set title 'Channel 0 vs. Channel 1'\n");
+    fprintf(gp, "set xlabel 'Voltage CH 0 (V)'\n");
+    fprintf(gp, "set ylabel 'Voltage CH 1 (V)'\n");
+    fprintf(gp, "set xrange [%lf:%lf]\n",-1.0*scale,scale);
+    fprintf(gp, "set yrange [%lf:%lf]\n",-1.0*scale,scale);
+    fprintf(gp, "set grid\n");
+    fprintf(gp, "plot '-' with linespoints title 'CH0 vs CH1'\n");
+
+    for (int i = 0; i < cap->n_samples; i++)
+        fprintf(gp, "%lf %lf\n", cap->ch[0][i], cap->ch[1][i]);
+    fprintf(gp, "e\n");
+
+    fflush(gp);
+    printf("XY plot displayed in gnuplot window.\n");
+    pclose(gp);
+}
@@ -1,20 +1,347 @@
 #include "includes.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define CSV_ROW_OK 1
+#define CSV_ROW_BLANK 0
+#define CSV_ROW_MALFORMED -1
+
+// Time, CH 0, CH 1 from the line starting at p. Extra columns are ignored.
+// Returns the start of the next line; *status says what the row was.
+static const char *scan_row(const char *p, const char *end, double v[3], int *status) {
+    const char *line = p;
+    const char *q = p;
+
+    while (q < end && (*q == ' ' || *q == '\t' || *q == '\r'))
+        q++;
+    if (q == end || *q == '\n') {
+        *status = CSV_ROW_BLANK;
+        return q == end ? end : q + 1;
+    }
+
+    for (int f = 0; f < 3 && q; f++) {
+        while (q < end && (*q == ' ' || *q == '\t'))
+            q++;
+        q = parse_si(q, end, &v[f]);
+        if (!q)
+            break;
+        while (q < end && (*q == ' ' || *q == '\t'))
+            q++;
+        if (f < 2)
+            q = (q < end && *q == ',') ? q + 1 : NULL;
+    }
+
+    if (q && q < end && *q == '\r')
+        q++;
+    if (q && (q == end || *q == '\n')) {
+        *status = CSV_ROW_OK;
+        return q == end ? end : q + 1;
+    }
+
+    *status = (q && *q == ',') ? CSV_ROW_OK : CSV_ROW_MALFORMED;
+    const char *nl = memchr(line, '\n', end - line);
+    return nl ? nl + 1 : end;
+}
+
+// One NUL-terminated line from fgets
+static int parse_row(const char *line, double *time, double *ch0, double *ch1) {
+    double v[3];
+    int status;
+    scan_row(line, line + strlen(line), v, &status);
+    if (status == CSV_ROW_OK) {
+        *time = v[0];
+        *ch0 = v[1];
+        *ch1 = v[2];
+    }
+    return status;
+}
+
+static void report_malformed(const char *filename, long long n_malformed, long long first_line) {
+    if (n_malformed > 0)
+        fprintf(stderr, "Warning: %lld malformed rows skipped in %s (first at line %lld).\n",
+                n_malformed, filename, first_line);
+}
 
 int read_csv(const char *filename, DataSample *data, int *n_samples) {
     FILE *file = fopen(filename, "r");
     if (!file) { perror("fopen"); return 0; }
     char line[LINE_SIZE];
     int idx = 0;
+    long long line_no = 1, n_malformed = 0, first_bad = 0;
     fgets(line, sizeof(line), file);  // Skip header
-    while (fgets(line, sizeof(line), file) && idx < MAX_SAMPLES) {
-        char *token, *rest = line;
-        if (!(token = strtok_r(rest, ",", &rest)) || !parse_suffix(token, &data[idx].time)) continue;
-        if (!(token = strtok_r(rest, ",", &rest)) || !parse_suffix(token, &data[idx].ch0)) continue;
-        if (!(token = strtok_r(rest, ",\n", &rest)) || !parse_suffix(token, &data[idx].ch1)) continue;
+    while (idx < MAX_SAMPLES && fgets(line, sizeof(line), file)) {
+        line_no++;
+        int status = parse_row(line, &data[idx].time, &data[idx].ch0, &data[idx].ch1);
+        if (status == CSV_ROW_MALFORMED && n_malformed++ == 0) first_bad = line_no;
+        if (status != CSV_ROW_OK) continue;
         idx++;
     }
+    // The DataSample array is fixed size, read_csv_capture has no limit
+    if (idx == MAX_SAMPLES && fgets(line, sizeof(line), file))
+        fprintf(stderr, "Warning: %s truncated at %d samples.\n", filename, MAX_SAMPLES);
     fclose(file);
+    report_malformed(filename, n_malformed, first_bad);
     *n_samples = idx;
     return 1;
 }
 
+
+// Parallel parse of a mapped file.
+// The buffer is cut into one chunk per thread at newline boundaries. A first
+// pass counts the lines of every chunk, which bounds its row count and gives
+// each chunk a slice of the capture starting at the sum of the bounds before
+// it. A second pass parses every chunk straight into its slice, and the slices
+// are then slid together in chunk order, so the result is the same as a
+// single-threaded parse whatever the thread count.
+
+#define CSV_MAX_THREADS 64
+#define CSV_PARALLEL_MIN_BYTES (4 << 20)  // smaller files are parsed on one thread
+
+typedef struct {
+    const char *begin, *end;            // whole lines only
+    Capture *cap;
+    long long n_lines;                  // pass 1
+    long long first_line;               // file line number of the chunk's first line
+    int first_row;                      // output slot of the first row
+    int n_rows;                         // pass 2
+    long long n_malformed;
+    long long first_bad;
+} CSVChunk;
+
+static void *csv_chunk_count(void *arg) {
+    CSVChunk *chunk = (CSVChunk*)arg;
+    const char *p = chunk->begin;
+    long long n = 0;
+    while (p < chunk->end) {
+        const char *nl = memchr(p, '\n', chunk->end - p);
+        n++;
+        p = nl ? nl + 1 : chunk->end;
+    }
+    chunk->n_lines = n;
+    return NULL;
+}
+
+static void *csv_chunk_parse(void *arg) {
+    CSVChunk *chunk = (CSVChunk*)arg;
+    double *time = chunk->cap->time + chunk->first_row;
+    double *ch0 = chunk->cap->ch[0] + chunk->first_row;
+    double *ch1 = chunk->cap->ch[1] + chunk->first_row;
+    const char *p = chunk->begin;
+    long long line_no = chunk->first_line;
+    int n = 0;
+    double v[3];
+
+    for (; p < chunk->end; line_no++) {
+        int status;
+        p = scan_row(p, chunk->end, v, &status);
+        if (status == CSV_ROW_MALFORMED && chunk->n_malformed++ == 0) chunk->first_bad = line_no;
+        if (status != CSV_ROW_OK) continue;
+        time[n] = v[0];
+        ch0[n] = v[1];
+        ch1[n] = v[2];
+        n++;
+    }
+    chunk->n_rows = n;
+    return NULL;
+}
+
+// fn on every chunk, chunk 0 on the calling thread. Chunks whose thread
+// cannot be started run here too.
+static void csv_run_chunks(void *(*fn)(void*), CSVChunk *chunks, int n_chunks) {
+    pthread_t tid[CSV_MAX_THREADS];
+    int started[CSV_MAX_THREADS] = {0};
+
+    for (int c = 1; c < n_chunks; c++)
+        started[c] = (pthread_create(&tid[c], NULL, fn, &chunks[c]) == 0);
+    fn(&chunks[0]);
+    for (int c = 1; c < n_chunks; c++) {
+        if (started[c])
+            pthread_join(tid[c], NULL);
+        else
+            fn(&chunks[c]);
+    }
+}
+
+// Default thread count: one per online CPU
+static int csv_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Parse a whole mapped file into cap, header line skipped
+static int read_csv_buffer(const char *filename, const char *p, const char *end, Capture *cap, int n_threads) {
+    const char *nl = memchr(p, '\n', end - p);
+    p = nl ? nl + 1 : end;  // Skip header
+
+    if (n_threads <= 0)
+        n_threads = csv_default_threads();
+    if (n_threads > CSV_MAX_THREADS)
+        n_threads = CSV_MAX_THREADS;
+    if (end - p < (long long)CSV_PARALLEL_MIN_BYTES * n_threads)
+        n_threads = (int)((end - p) / CSV_PARALLEL_MIN_BYTES) + 1;
+    if (n_threads > CSV_MAX_THREADS)
+        n_threads = CSV_MAX_THREADS;
+
+    // Cut after the first newline at or past each even split point
+    CSVChunk chunks[CSV_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char *begin = p;
+    for (int c = 0; c < n_threads; c++) {
+        const char *cut = end;
+        if (c < n_threads - 1) {
+            cut = p + (end - p) / n_threads * (c + 1);
+            if (cut < begin)
+                cut = begin;
+            nl = memchr(cut, '\n', end - cut);
+            cut = nl ? nl + 1 : end;
+        }
+        chunks[c].begin = begin;
+        chunks[c].end = cut;
+        chunks[c].cap = cap;
+        begin = cut;
+    }
+
+    csv_run_chunks(csv_chunk_count, chunks, n_threads);
+
+    long long total = 0;
+    for (int c = 0; c < n_threads; c++) {
+        chunks[c].first_row = (int)total;
+        chunks[c].first_line = total + 2;
+        total += chunks[c].n_lines;
+        if (total > INT_MAX) {
+            fprintf(stderr, "%s has more than %d rows.\n", filename, INT_MAX);
+            return 0;
+        }
+    }
+    if (capture_reserve(cap, (int)total) != 0)
+        return 0;
+
+    csv_run_chunks(csv_chunk_parse, chunks, n_threads);
+
+    // Close the gaps left by blank and malformed lines, in chunk order
+    long long n_malformed = 0, first_bad = 0;
+    int n = 0;
+    for (int c = 0; c < n_threads; c++) {
+        if (chunks[c].first_row != n) {
+            size_t bytes = (size_t)chunks[c].n_rows * sizeof(double);
+            memmove(cap->time + n, cap->time + chunks[c].first_row, bytes);
+            memmove(cap->ch[0] + n, cap->ch[0] + chunks[c].first_row, bytes);
+            memmove(cap->ch[1] + n, cap->ch[1] + chunks[c].first_row, bytes);
+        }
+        n += chunks[c].n_rows;
+        if (chunks[c].n_malformed && !n_malformed)
+            first_bad = chunks[c].first_bad;
+        n_malformed += chunks[c].n_malformed;
+    }
+    cap->n_samples = n;
+
+    report_malformed(filename, n_malformed, first_bad);
+    return 1;
+}
+
+// Memory-mapped ingest; 0 with cap untouched if the file cannot be mapped
+static int read_csv_mmap(const char *filename, Capture *cap, int n_threads, int *ok) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    char *map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    *ok = read_csv_buffer(filename, map, map + st.st_size, cap, n_threads);
+    munmap(map, st.st_size);
+    return 1;
+}
+
+// Read the three-column scope export into a two-channel capture with
+// explicit timestamps, on one thread per CPU.
+int read_csv_capture(const char *filename, Capture *cap) {
+    return read_csv_capture_threads(filename, cap, 0);
+}
+
+// Regular files are memory-mapped and parsed on n_threads threads (0 for
+// one per CPU); anything else is read line by line into a growing capture.
+int read_csv_capture_threads(const char *filename, Capture *cap, int n_threads) {
+    if (capture_init(cap, 2, 0, 1) != 0) return 0;
+
+    int ok = 0;
+    if (!read_csv_mmap(filename, cap, n_threads, &ok)) {
+        FILE *file = fopen(filename, "r");
+        if (!file) { perror("fopen"); capture_free(cap); return 0; }
+        char line[LINE_SIZE];
+        double t, v[2];
+        long long line_no = 1, n_malformed = 0, first_bad = 0;
+        ok = 1;
+        fgets(line, sizeof(line), file);  // Skip header
+        while (fgets(line, sizeof(line), file)) {
+            line_no++;
+            int status = parse_row(line, &t, &v[0], &v[1]);
+            if (status == CSV_ROW_MALFORMED && n_malformed++ == 0) first_bad = line_no;
+            if (status != CSV_ROW_OK) continue;
+            if (capture_append(cap, t, v) != 0) { ok = 0; break; }
+        }
+        fclose(file);
+        report_malformed(filename, n_malformed, first_bad);
+    }
+    if (!ok) { capture_free(cap); return 0; }
+
+    // Least-squares time base; the timestamps stay until capture_fit_timebase
+    TimebaseEstimator tb;
+    Timebase fit;
+    timebase_init(&tb);
+    timebase_push(&tb, cap->time, 1, cap->n_samples);
+    if (timebase_fit(&tb, &fit) == 0) {
+        cap->t0 = fit.t0;
+        cap->fs = fit.fs;
+    }
+    return 1;
+}
+
+
+// Open a CSV for block-wise reading, header skipped
+int csv_stream_open(CSVStream *cs, const char *filename) {
+    memset(cs, 0, sizeof(*cs));
+    cs->file = fopen(filename, "r");
+    if (!cs->file) { perror("fopen"); return -1; }
+    char line[LINE_SIZE];
+    fgets(line, sizeof(line), cs->file);  // Skip header
+    cs->lines = 1;
+    return 0;
+}
+
+// Fill block with up to block->capacity samples; returns the number read,
+// 0 at end of file
+int csv_stream_read(CSVStream *cs, Capture *block) {
+    char line[LINE_SIZE];
+    int idx = 0;
+    while (idx < block->capacity && fgets(line, sizeof(line), cs->file)) {
+        cs->lines++;
+        int status = parse_row(line, &block->time[idx], &block->ch[0][idx], &block->ch[1][idx]);
+        if (status == CSV_ROW_MALFORMED && cs->malformed++ == 0) cs->first_malformed = cs->lines;
+        if (status != CSV_ROW_OK) continue;
+        idx++;
+    }
+    block->n_samples = idx;
+    cs->rows += idx;
+    return idx;
+}
+
+// Reports any malformed rows seen
+void csv_stream_close(CSVStream *cs, const char *filename) {
+    if (cs->file)
+        fclose(cs->file);
+    cs->file = NULL;
+    report_malformed(filename, cs->malformed, cs->first_malformed);
+}
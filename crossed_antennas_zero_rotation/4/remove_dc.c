@@ -17,3 +17,20 @@ void remove_dc(DataSample *signal, int N) {
     }
 }
 
+
+// Remove DC offset from every channel of a capture
+void remove_dc_capture(Capture *cap) {
+    int N = cap->n_samples;
+    if (N <= 0)
+        return;
+
+    for (int c = 0; c < cap->n_channels; c++) {
+        double *x = cap->ch[c];
+        double mean = 0.0;
+        for (int i = 0; i < N; i++)
+            mean += x[i];
+        mean /= N;
+        for (int i = 0; i < N; i++)
+            x[i] -= mean;
+    }
+}
@@ -0,0 +1,191 @@
+#include "includes.h"
+
+// Sample rate changes by up / down with a polyphase FIR.
+// Conceptually the input is stuffed with up - 1 zeros per sample, lowpassed
+// by the prototype at fs * up and every down-th sample kept. Only the kept
+// outputs are computed, and only from the taps that meet real inputs: an
+// output at position t (in 1 / up input samples) uses branch t mod up of the
+// prototype, every up-th tap, against the inputs up to t / up. up == 1 is a
+// plain decimator and down == 1 a plain interpolator. The prototype is any
+// odd-length linear-phase lowpass, usually from resampler_design; the
+// branches are scaled by up so the passband gain stays 1. Each resampler
+// carries its input history and output position across calls, so a signal
+// pushed through in blocks of any size gives the same output as in one go.
+
+#define RESAMPLE_BLOCK 4096
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Reduce up / down to lowest terms; -1 if out of range or no change
+static int resample_ratio(int *up, int *down) {
+    if (*up < 1 || *down < 1 || *up > RESAMPLE_MAX_FACTOR || *down > RESAMPLE_MAX_FACTOR) {
+        fprintf(stderr, "Resampling factors must be 1 to %d.\n", RESAMPLE_MAX_FACTOR);
+        return -1;
+    }
+    int g = gcd(*up, *down);
+    *up /= g;
+    *down /= g;
+    if (*up == *down) {
+        fprintf(stderr, "Resampling ratio is 1.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Shortest prototype that keeps 0..f_pass flat and rejects everything that
+// would alias or image onto it: the stopband starts f_pass below the lower
+// of the input and output rates
+int resampler_design(double fs, int up, int down, double f_pass, double ripple_db, double atten_db,
+                     FIRFilter *proto) {
+    if (resample_ratio(&up, &down) != 0)
+        return -1;
+    double f_min = up < down ? fs * up / down : fs;
+    if (fs <= 0.0 || f_pass <= 0.0 || f_pass >= f_min / 2.0) {
+        fprintf(stderr, "Resampler passband must be below %lf Hz.\n", f_min / 2.0);
+        return -1;
+    }
+
+    FIRSpec spec = { fs * up, 0.0, f_pass, f_min - 2.0 * f_pass, ripple_db, atten_db };
+    return design_fir_min(&spec, FIR_DESIGN_AUTO, MAX_FIR_TAPS, proto);
+}
+
+int resampler_init(Resampler *r, int up, int down, const FIRFilter *proto) {
+    memset(r, 0, sizeof(*r));
+    if (!proto || proto->num_taps < 1 || proto->num_taps > MAX_FIR_TAPS) {
+        fprintf(stderr, "Invalid resampler prototype.\n");
+        return -1;
+    }
+    if (resample_ratio(&up, &down) != 0)
+        return -1;
+
+    int K = (proto->num_taps + up - 1) / up;
+    r->up = up;
+    r->down = down;
+    r->n_taps = proto->num_taps;
+    r->phase_len = K;
+    r->delay = (proto->num_taps - 1) / 2.0 / up;
+    r->branch = (double*)calloc((size_t)up * K, sizeof(double));
+    r->hist = (double*)calloc(K, sizeof(double));
+    if (!r->branch || !r->hist) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        resampler_free(r);
+        return -1;
+    }
+
+    // Branch p holds taps p, p + up, ... back to front, to run forward
+    // over the inputs ending at the newest one
+    for (int p = 0; p < up; p++)
+        for (int j = 0; j < K && p + j * up < proto->num_taps; j++)
+            r->branch[p * K + K - 1 - j] = up * proto->taps[p + j * up];
+    return 0;
+}
+
+void resampler_free(Resampler *r) {
+    free(r->branch);
+    free(r->hist);
+    memset(r, 0, sizeof(*r));
+}
+
+void resampler_reset(Resampler *r) {
+    memset(r->hist, 0, r->phase_len * sizeof(double));
+    r->next = 0;
+}
+
+// Exact number of outputs the next n inputs produce
+int resampler_max_output(const Resampler *r, int n) {
+    long long span = (long long)n * r->up - r->next;
+    return span > 0 ? (int)((span + r->down - 1) / r->down) : 0;
+}
+
+static double resample_dot(const double *h, const double *x, int n) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        s0 += h[k] * x[k];
+        s1 += h[k + 1] * x[k + 1];
+        s2 += h[k + 2] * x[k + 2];
+        s3 += h[k + 3] * x[k + 3];
+    }
+    for (; k < n; k++)
+        s0 += h[k] * x[k];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// n inputs into y, which needs resampler_max_output(r, n) samples; returns
+// the number written
+int resampler_process(Resampler *r, const double *x, int n, double *y) {
+    if (!r || !r->branch || (!x && n > 0) || !y || n < 0) {
+        fprintf(stderr, "Invalid arguments for resampler_process.\n");
+        return -1;
+    }
+
+    int K = r->phase_len, hist = K - 1;
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double *win = (double*)arena_alloc(arena, (RESAMPLE_BLOCK + hist) * sizeof(double));
+    if (!win) {
+        arena_release(arena, mark);
+        return -1;
+    }
+
+    // win is the history then the block; position t is input t / up
+    int n_out = 0;
+    for (int i0 = 0; i0 < n; i0 += RESAMPLE_BLOCK) {
+        int len = n - i0 < RESAMPLE_BLOCK ? n - i0 : RESAMPLE_BLOCK;
+        memcpy(win, r->hist, hist * sizeof(double));
+        memcpy(win + hist, x + i0, len * sizeof(double));
+
+        int end = len * r->up;
+        int t = r->next;
+        for (; t < end; t += r->down) {
+            int i = t / r->up;
+            y[n_out++] = resample_dot(r->branch + (t - i * r->up) * K, win + i, K);
+        }
+        r->next = t - end;
+        memcpy(r->hist, win + len, hist * sizeof(double));
+    }
+
+    arena_release(arena, mark);
+    return n_out;
+}
+
+// Every channel of a uniformly sampled capture to fs * up / down. The time
+// axis is implicit on output, with t0 moved back by the filter delay.
+int capture_resample(const Capture *in, int up, int down, const FIRFilter *proto, Capture *out) {
+    if (!in || !out || in->fs <= 0.0) {
+        fprintf(stderr, "Resampling needs a capture with a known rate.\n");
+        return -1;
+    }
+
+    Resampler r;
+    if (resampler_init(&r, up, down, proto) != 0)
+        return -1;
+    if (capture_init(out, in->n_channels, resampler_max_output(&r, in->n_samples), 0) != 0) {
+        resampler_free(&r);
+        return -1;
+    }
+
+    int n = 0;
+    for (int c = 0; c < in->n_channels && n >= 0; c++) {
+        resampler_reset(&r);
+        n = resampler_process(&r, in->ch[c], in->n_samples, out->ch[c]);
+    }
+    if (n < 0) {
+        capture_free(out);
+        resampler_free(&r);
+        return -1;
+    }
+
+    out->n_samples = n;
+    out->fs = in->fs * r.up / r.down;
+    out->t0 = in->t0 - r.delay / in->fs;
+    resampler_free(&r);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include "includes.h"
+
+// Sliding DFT tracking of a few bins.
+// A spectrum line only needs its own bin, and the DFT of the last n
+// samples at bin k follows from the previous one in O(1):
+//     S(t) = (S(t - 1) + x(t) - x(t - n)) exp(+j 2 pi k / n)
+// so K bins cost K complex multiply-adds per sample instead of a full FFT
+// per frame. The recurrence is marginally stable and the rounding of the
+// twiddle accumulates, so every SDFT_ANCHOR_WINDOWS windows the bins are
+// recomputed directly from the ring of inputs, which costs one more
+// multiply-add per bin and sample on average.
+// The last few bins can be set aside off the carrier: their mean power is
+// the local noise in one bin, which the carrier bins are measured against.
+// The window's total power would not do, since whatever else is on the
+// input swamps a weak carrier.
+
+#define SDFT_ANCHOR_WINDOWS 8
+
+static void sdft_anchor(SDFTTracker *tr) {
+    int n = tr->n;
+    for (int c = 0; c < 2; c++) {
+        const double *ring = tr->ring[c];
+
+        // S = sum over the window, oldest first, of x(m) exp(-j 2 pi k m / n)
+        for (int b = 0; b < tr->n_bins; b++) {
+            double re = 0.0, im = 0.0;
+            int idx = 0;
+            for (int m = 0; m < n; m++) {
+                double x = ring[(tr->pos + m) % n];
+                re += x * tr->table[2 * idx];
+                im -= x * tr->table[2 * idx + 1];
+                idx += tr->bin[b];
+                if (idx >= n)
+                    idx -= n;
+            }
+            tr->s[c][b][0] = re;
+            tr->s[c][b][1] = im;
+        }
+    }
+    tr->anchor_left = SDFT_ANCHOR_WINDOWS * n;
+}
+
+// Bins nearest to freqs over a window of n samples at fs; the last n_ref
+// of them are the noise reference
+int sdft_init(SDFTTracker *tr, double fs, int n, const double *freqs, int n_bins, int n_ref) {
+    memset(tr, 0, sizeof(*tr));
+    if (fs <= 0.0 || n < 2 || !freqs || n_bins < 1 || n_bins > SDFT_MAX_BINS || n_ref < 0 || n_ref >= n_bins) {
+        fprintf(stderr, "Invalid sliding DFT parameters.\n");
+        return -1;
+    }
+
+    tr->n = n;
+    tr->n_bins = n_bins;
+    tr->n_ref = n_ref;
+    tr->fs = fs;
+    for (int b = 0; b < n_bins; b++) {
+        int k = (int)lround(freqs[b] * n / fs);
+        if (freqs[b] < 0.0 || k > n / 2) {
+            fprintf(stderr, "Bin at %lf Hz is above Nyquist.\n", freqs[b]);
+            return -1;
+        }
+        tr->bin[b] = k;
+        tr->twiddle[b][0] = cos(2.0 * M_PI * k / n);
+        tr->twiddle[b][1] = sin(2.0 * M_PI * k / n);
+    }
+
+    tr->ring[0] = (double*)calloc(n, sizeof(double));
+    tr->ring[1] = (double*)calloc(n, sizeof(double));
+    tr->table = (double*)malloc(2 * n * sizeof(double));
+    if (!tr->ring[0] || !tr->ring[1] || !tr->table) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        sdft_free(tr);
+        return -1;
+    }
+    for (int m = 0; m < n; m++) {
+        tr->table[2 * m] = cos(2.0 * M_PI * m / n);
+        tr->table[2 * m + 1] = sin(2.0 * M_PI * m / n);
+    }
+    sdft_reset(tr);
+    return 0;
+}
+
+void sdft_free(SDFTTracker *tr) {
+    free(tr->ring[0]);
+    free(tr->ring[1]);
+    free(tr->table);
+    memset(tr, 0, sizeof(*tr));
+}
+
+// Empty window: the bins start from zeros before the first sample
+void sdft_reset(SDFTTracker *tr) {
+    memset(tr->ring[0], 0, tr->n * sizeof(double));
+    memset(tr->ring[1], 0, tr->n * sizeof(double));
+    memset(tr->s, 0, sizeof(tr->s));
+    tr->pos = 0;
+    tr->anchor_left = SDFT_ANCHOR_WINDOWS * tr->n;
+    tr->n_in = 0;
+}
+
+void sdft_push(SDFTTracker *tr, const double *ch0, const double *ch1, int n) {
+    const double *x[2] = { ch0, ch1 };
+    int i = 0;
+    while (i < n) {
+        int run = n - i < tr->anchor_left ? n - i : tr->anchor_left;
+        int pos = tr->pos;
+        for (int c = 0; c < 2; c++) {
+            double *ring = tr->ring[c];
+            const double *in = x[c] + i;
+            pos = tr->pos;
+            for (int j = 0; j < run; j++) {
+                double d = in[j] - ring[pos];
+                ring[pos] = in[j];
+                if (++pos == tr->n)
+                    pos = 0;
+                for (int b = 0; b < tr->n_bins; b++) {
+                    double *s = tr->s[c][b];
+                    double re = s[0] + d, im = s[1];
+                    s[0] = re * tr->twiddle[b][0] - im * tr->twiddle[b][1];
+                    s[1] = re * tr->twiddle[b][1] + im * tr->twiddle[b][0];
+                }
+            }
+        }
+        tr->pos = pos;
+        tr->n_in += run;
+        i += run;
+        tr->anchor_left -= run;
+        if (tr->anchor_left == 0)
+            sdft_anchor(tr);
+    }
+}
+
+double sdft_bin_hz(const SDFTTracker *tr, int b) {
+    return tr->bin[b] * tr->fs / tr->n;
+}
+
+// Phasor of the tone in bin b: amplitude in V, phase at the oldest sample
+// of the window
+double complex sdft_bin(const SDFTTracker *tr, int ch, int b) {
+    double scale = (tr->bin[b] == 0 || 2 * tr->bin[b] == tr->n ? 1.0 : 2.0) / tr->n;
+    return scale * (tr->s[ch][b][0] + I * tr->s[ch][b][1]);
+}
+
+// Mean square of the tone in bin b, V^2
+static double sdft_power(const SDFTTracker *tr, int ch, int b) {
+    double p = (tr->s[ch][b][0] * tr->s[ch][b][0] + tr->s[ch][b][1] * tr->s[ch][b][1]) / ((double)tr->n * tr->n);
+    return tr->bin[b] == 0 || 2 * tr->bin[b] == tr->n ? p : 2.0 * p;    // the mirrored bin carries as much
+}
+
+// Mean power of the reference bins, V^2 in one bin; 0 without any
+double sdft_noise_power(const SDFTTracker *tr, int ch) {
+    double sum = 0.0;
+    for (int b = tr->n_bins - tr->n_ref; b < tr->n_bins; b++)
+        sum += sdft_power(tr, ch, b);
+    return tr->n_ref > 0 ? sum / tr->n_ref : 0.0;
+}
+
+// Power of bin b over the local noise, dB
+double sdft_bin_db(const SDFTTracker *tr, int ch, int b) {
+    double noise = sdft_noise_power(tr, ch), p = sdft_power(tr, ch, b);
+    if (noise <= 0.0 || p <= 0.0)
+        return DB_FLOOR;
+    double db = 10.0 * log10(p / noise);
+    return db < DB_FLOOR ? DB_FLOOR : db;
+}
+
+// Strongest of the bins that are not the reference
+int sdft_peak_bin(const SDFTTracker *tr, int ch) {
+    int peak = 0;
+    for (int b = 1; b < tr->n_bins - tr->n_ref; b++)
+        if (sdft_power(tr, ch, b) > sdft_power(tr, ch, peak))
+            peak = b;
+    return peak;
+}
+
+// A full window with a carrier bin at least min_db over the local noise
+// on either channel
+int sdft_present(const SDFTTracker *tr, double min_db) {
+    if (tr->n_in < tr->n || tr->n_ref == 0)
+        return 0;
+    return sdft_bin_db(tr, 0, sdft_peak_bin(tr, 0)) >= min_db || sdft_bin_db(tr, 1, sdft_peak_bin(tr, 1)) >= min_db;
+}
@@ -0,0 +1,141 @@
+#include "includes.h"
+
+// Uniform segments of a capture.
+// A capture with timing faults is split where the timestamps leave the
+// grid: a gap starts a new segment at the row after it, and a glitch row
+// (repeated or backwards timestamp) ends the segment and is left out. Each
+// segment is then processed as a signal of its own, so filters and spectra
+// never run across a discontinuity, and the rows outside every segment are
+// blanked. The splits are the timebase estimator's own events, so a lone
+// outlier stays in its segment and the streaming pipeline, which follows
+// the same events, splits a file exactly where this does.
+
+static int segment_add(CaptureSegment **segs, int *n_segs, int *capacity, int start, int end) {
+    if (end - start < SEGMENT_MIN_SAMPLES)
+        return 0;
+    if (*n_segs == *capacity) {
+        int grown = *capacity ? 2 * *capacity : 16;
+        CaptureSegment *s = (CaptureSegment*)realloc(*segs, grown * sizeof(CaptureSegment));
+        if (!s) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            return -1;
+        }
+        *segs = s;
+        *capacity = grown;
+    }
+    (*segs)[*n_segs].start = start;
+    (*segs)[*n_segs].n_samples = end - start;
+    (*n_segs)++;
+    return 0;
+}
+
+typedef struct {
+    CaptureSegment **segs;
+    int n_segs, capacity;
+    int start;                          // first row of the open segment
+    int failed;
+} SegmentSplit;
+
+static void segment_split(void *ctx, const TimebaseEvent *ev) {
+    SegmentSplit *sp = (SegmentSplit*)ctx;
+    if (ev->kind == TIMEBASE_OUTLIER || sp->failed)
+        return;
+    if (segment_add(sp->segs, &sp->n_segs, &sp->capacity, sp->start, (int)ev->row) != 0)
+        sp->failed = 1;
+    sp->start = (int)ev->row + (ev->kind == TIMEBASE_GLITCH);
+}
+
+// Segments of at least SEGMENT_MIN_SAMPLES rows, in order, into *segs
+// (caller frees). Returns their number, -1 on error. A capture without
+// explicit timestamps is one segment.
+int capture_find_segments(const Capture *cap, CaptureSegment **segs) {
+    *segs = NULL;
+    if (!cap || cap->n_samples < 0 || (cap->time && cap->fs <= 0.0)) {
+        fprintf(stderr, "Invalid arguments for capture_find_segments.\n");
+        return -1;
+    }
+
+    int n = cap->n_samples;
+    int n_segs = 0, capacity = 0;
+    if (!cap->time) {
+        if (segment_add(segs, &n_segs, &capacity, 0, n) != 0)
+            return -1;
+        return n_segs;
+    }
+
+    SegmentSplit split = { segs, 0, 0, 0, 0 };
+    TimebaseEstimator tb;
+    timebase_init(&tb);
+    tb.on_event = segment_split;
+    tb.ctx = &split;
+    timebase_push(&tb, cap->time, 1, n);
+    timebase_finish(&tb);
+    if (!split.failed && split.start < n
+        && segment_add(segs, &split.n_segs, &split.capacity, split.start, n) != 0)
+        split.failed = 1;
+    if (split.failed) {
+        free(*segs);
+        *segs = NULL;
+        return -1;
+    }
+    return split.n_segs;
+}
+
+// Capture sharing the segment's rows; it owns nothing and is not freed
+void capture_segment_view(const Capture *cap, const CaptureSegment *seg, Capture *view) {
+    memset(view, 0, sizeof(*view));
+    view->n_channels = cap->n_channels;
+    view->n_samples = seg->n_samples;
+    view->capacity = seg->n_samples;
+    view->fs = cap->fs;
+    if (cap->time) {
+        view->time = cap->time + seg->start;
+        view->t0 = view->time[0];
+    } else {
+        view->t0 = cap->t0 + seg->start / cap->fs;
+    }
+    for (int c = 0; c < cap->n_channels; c++)
+        view->ch[c] = cap->ch[c] + seg->start;
+}
+
+// Zero the channels on rows outside every segment
+void capture_blank_gaps(Capture *cap, const CaptureSegment *segs, int n_segs) {
+    int row = 0;
+    for (int s = 0; s <= n_segs; s++) {
+        int end = s < n_segs ? segs[s].start : cap->n_samples;
+        if (end > row) {
+            for (int c = 0; c < cap->n_channels; c++)
+                memset(cap->ch[c] + row, 0, (size_t)(end - row) * sizeof(double));
+        }
+        if (s < n_segs)
+            row = segs[s].start + segs[s].n_samples;
+    }
+}
+
+// Index of the longest segment, -1 if there are none
+int capture_longest_segment(const CaptureSegment *segs, int n_segs) {
+    int best = -1;
+    for (int s = 0; s < n_segs; s++)
+        if (best < 0 || segs[s].n_samples > segs[best].n_samples)
+            best = s;
+    return best;
+}
+
+void capture_print_segments(const Capture *cap, const CaptureSegment *segs, int n_segs) {
+    long long covered = 0;
+    for (int s = 0; s < n_segs; s++)
+        covered += segs[s].n_samples;
+    printf("%d uniform segment%s, %lld of %d rows (%lld blanked)\n",
+           n_segs, n_segs == 1 ? "" : "s", covered, cap->n_samples, cap->n_samples - covered);
+    if (n_segs <= 1)
+        return;
+
+    for (int s = 0; s < n_segs && s < SEGMENT_MAX_PRINT; s++) {
+        Capture view;
+        capture_segment_view(cap, &segs[s], &view);
+        printf("  segment %d: rows %d-%d, t = %.6lf s, %d samples\n",
+               s, segs[s].start, segs[s].start + segs[s].n_samples - 1, view.t0, segs[s].n_samples);
+    }
+    if (n_segs > SEGMENT_MAX_PRINT)
+        printf("  ...\n");
+}
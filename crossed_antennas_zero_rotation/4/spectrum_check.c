@@ -0,0 +1,225 @@
+#include "includes.h"
+
+// spectrum_check: the spectral estimates against what they should read.
+// The sliding DFT, pushed in uneven blocks up to just before its second
+// re-anchor, must hold the direct DFT of the last window at every bin.
+// With the beacon layout main uses, a tone over white noise must be found
+// present in its bin and noise alone must not, nor a window not yet full.
+// Welch's noise floor over white noise must be the noise's density, a
+// tone's band power its mean square, ch1 = 2 ch0 four times ch0's PSD in
+// every bin, and any thread count the same bits. Segments too short for
+// any step at the overlap asked must still slide one sample at a time.
+// Exits non-zero if any case fails.
+
+#define CHECK_FS 64000.0
+#define CHECK_CARRIER_HZ 25200.0
+
+#define SDFT_CHECK_WINDOW 5120
+#define SDFT_CHECK_TOL 1e-9
+#define SDFT_CHECK_MIN_DB 12.0
+
+static int report(const char *what, double value, const char *unit, int ok) {
+    printf("%-38s %10.4g %-4s %s\n", what, value, unit, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+// Zero-mean Gaussian noise of rms sigma, Box-Muller on rand()
+static double check_noise(double sigma) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = rand() / (RAND_MAX + 1.0);
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// The carrier's bins +-200 Hz, then 8 reference bins 500 Hz beyond each
+// edge, as main lays them out
+static int check_beacon_bins(int n, double *freqs, int *n_ref) {
+    double df = CHECK_FS / n;
+    int k0 = (int)ceil((CHECK_CARRIER_HZ - 200.0) / df), k1 = (int)floor((CHECK_CARRIER_HZ + 200.0) / df);
+    int gap = (int)ceil(500.0 / df), n_bins = 0;
+    for (int k = k0; k <= k1; k++)
+        freqs[n_bins++] = k * df;
+    for (int j = 1; j <= 8; j++) {
+        freqs[n_bins++] = (k0 - gap - j) * df;
+        freqs[n_bins++] = (k1 + gap + j) * df;
+    }
+    *n_ref = 16;
+    return n_bins;
+}
+
+// Direct DFT of the last window against every bin
+static int check_sdft_bins(void) {
+    // One re-anchor, then as many recurrence steps as there are before the
+    // next: the most rounding the bins ever carry
+    int n = SDFT_CHECK_WINDOW, total = 2 * 8 * SDFT_CHECK_WINDOW - 1;
+    double freqs[SDFT_MAX_BINS];
+    int n_ref, n_bins = check_beacon_bins(n, freqs, &n_ref);
+    freqs[n_bins - 1] = 0.0;            // DC and Nyquist have their own scale
+    freqs[n_bins - 2] = CHECK_FS / 2.0;
+
+    SDFTTracker tr;
+    double *x[2] = { (double*)malloc(total * sizeof(double)), (double*)malloc(total * sizeof(double)) };
+    if (!x[0] || !x[1] || sdft_init(&tr, CHECK_FS, n, freqs, n_bins, n_ref) != 0) {
+        free(x[0]);
+        free(x[1]);
+        return 1;
+    }
+    srand(n);
+    for (int i = 0; i < total; i++) {
+        x[0][i] = check_noise(1.0) + 0.5;
+        x[1][i] = check_noise(2.0) + cos(2.0 * M_PI * CHECK_CARRIER_HZ * i / CHECK_FS);
+    }
+    for (int i0 = 0, len = 1; i0 < total; i0 += len, len = len * 3 + 1) {
+        if (len > total - i0)
+            len = total - i0;
+        sdft_push(&tr, x[0] + i0, x[1] + i0, len);
+    }
+
+    // sdft_bin is the phasor at the oldest sample: 2 / n (1 / n at DC and
+    // Nyquist) times the DFT of the window, oldest sample first
+    double err = 0.0, peak = 0.0;
+    for (int c = 0; c < 2; c++) {
+        const double *w = x[c] + total - n;
+        for (int b = 0; b < n_bins; b++) {
+            int k = (int)lround(freqs[b] * n / CHECK_FS);
+            double complex sum = 0.0;
+            for (int m = 0; m < n; m++)
+                sum += w[m] * cexp(-I * 2.0 * M_PI * (double)((long long)k * m % n) / n);
+            double complex want = (k == 0 || 2 * k == n ? 1.0 : 2.0) / n * sum;
+            err = fmax(err, cabs(sdft_bin(&tr, c, b) - want));
+            peak = fmax(peak, cabs(want));
+        }
+    }
+    err = peak > 0.0 ? err / peak : err;
+    sdft_free(&tr);
+    free(x[0]);
+    free(x[1]);
+    return report("SDFT bins against direct DFT", err, "", err < SDFT_CHECK_TOL);
+}
+
+// Tone at 25.2 kHz over white noise, noise alone, and a short window
+static int check_sdft_present(void) {
+    int n = SDFT_CHECK_WINDOW;
+    double freqs[SDFT_MAX_BINS];
+    int n_ref, n_bins = check_beacon_bins(n, freqs, &n_ref);
+    double *x[2] = { (double*)malloc(n * sizeof(double)), (double*)malloc(n * sizeof(double)) };
+    SDFTTracker tr;
+    if (!x[0] || !x[1] || sdft_init(&tr, CHECK_FS, n, freqs, n_bins, n_ref) != 0) {
+        free(x[0]);
+        free(x[1]);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int tone = 1; tone >= 0; tone--) {
+        srand(tone + 1);
+        for (int i = 0; i < n; i++) {
+            double s = tone ? 1e-3 * cos(2.0 * M_PI * CHECK_CARRIER_HZ * i / CHECK_FS) : 0.0;
+            x[0][i] = s + check_noise(1e-3);
+            x[1][i] = 0.3 * s + check_noise(1e-3);
+        }
+        sdft_reset(&tr);
+        sdft_push(&tr, x[0], x[1], n);
+        int peak = sdft_peak_bin(&tr, 0);
+        double db = sdft_bin_db(&tr, 0, peak);
+        if (tone) {
+            int ok = sdft_present(&tr, SDFT_CHECK_MIN_DB) && fabs(sdft_bin_hz(&tr, peak) - CHECK_CARRIER_HZ) < 1e-9;
+            failed += report("SDFT tone over noise", db, "dB", ok);
+        } else {
+            failed += report("SDFT noise alone", db, "dB", !sdft_present(&tr, SDFT_CHECK_MIN_DB));
+        }
+    }
+
+    // Not a full window yet, however strong the tone
+    for (int i = 0; i < n; i++)
+        x[0][i] = x[1][i] = cos(2.0 * M_PI * CHECK_CARRIER_HZ * i / CHECK_FS);
+    sdft_reset(&tr);
+    sdft_push(&tr, x[0], x[1], n - 1);
+    failed += report("SDFT window one sample short", sdft_bin_db(&tr, 0, sdft_peak_bin(&tr, 0)), "dB",
+                     !sdft_present(&tr, SDFT_CHECK_MIN_DB));
+
+    sdft_free(&tr);
+    free(x[0]);
+    free(x[1]);
+    return failed;
+}
+
+#define WELCH_CHECK_SAMPLES (1 << 18)
+#define WELCH_CHECK_DB_TOL 0.25
+#define WELCH_CHECK_RATIO_TOL 1e-9
+
+static const int welch_threads[] = { 1, 2, 3, 0 };
+
+static int check_welch(void) {
+    Capture cap;
+    if (capture_init(&cap, 2, WELCH_CHECK_SAMPLES, 0) != 0)
+        return 1;
+    cap.fs = CHECK_FS;
+
+    // White noise of 1 mV rms on ch0 and twice that on ch1, plus a 1 mV
+    // tone at the carrier on both
+    double sigma = 1e-3, a = 1e-3;
+    srand(WELCH_CHECK_SAMPLES);
+    for (int i = 0; i < cap.n_samples; i++) {
+        cap.ch[0][i] = check_noise(sigma) + a * cos(2.0 * M_PI * CHECK_CARRIER_HZ * i / CHECK_FS + 0.7);
+        cap.ch[1][i] = 2.0 * cap.ch[0][i];
+    }
+
+    int failed = 0;
+    WelchPSD ref, psd;
+    WelchConfig cfg = { WELCH_SEGMENT, 0.5, WINDOW_HANN, 1 };
+    if (welch_psd(&cap, &cfg, &ref) != 0) {
+        capture_free(&cap);
+        return 1;
+    }
+
+    // The median is below the mean of a chi-square, but not by much after
+    // hundreds of averaged segments
+    double floor_db = 10.0 * log10(welch_noise_floor(&ref, 0) / (2.0 * sigma * sigma / CHECK_FS));
+    failed += report("Welch noise floor over density", floor_db, "dB", fabs(floor_db) < WELCH_CHECK_DB_TOL);
+
+    // The tone's a^2 / 2 and the noise in the bins summed
+    double f_low = CHECK_CARRIER_HZ - 200.0, f_high = CHECK_CARRIER_HZ + 200.0;
+    int n_band = (int)floor(f_high / ref.df) - (int)ceil(f_low / ref.df) + 1;
+    double want = a * a / 2.0 + 2.0 * sigma * sigma / CHECK_FS * n_band * ref.df;
+    double band_db = 10.0 * log10(welch_band_power(&ref, 0, f_low, f_high) / want);
+    failed += report("Welch band power over tone + noise", band_db, "dB", fabs(band_db) < WELCH_CHECK_DB_TOL);
+
+    double ratio_err = 0.0;
+    for (int k = 0; k < ref.n_bins; k++)
+        ratio_err = fmax(ratio_err, fabs(ref.psd[1][k] / (4.0 * ref.psd[0][k]) - 1.0));
+    failed += report("Welch CH 1 / CH 0 = 4 in every bin", ratio_err, "", ratio_err < WELCH_CHECK_RATIO_TOL);
+
+    int n_cases = sizeof(welch_threads) / sizeof(welch_threads[0]);
+    for (int t = 1; t < n_cases; t++) {
+        cfg.n_threads = welch_threads[t];
+        int same = welch_psd(&cap, &cfg, &psd) == 0 && psd.n_bins == ref.n_bins
+                && memcmp(psd.psd[0], ref.psd[0], ref.n_bins * sizeof(double)) == 0
+                && memcmp(psd.psd[1], ref.psd[1], ref.n_bins * sizeof(double)) == 0;
+        char what[64];
+        snprintf(what, sizeof(what), cfg.n_threads ? "Welch on %d threads, segments" : "Welch on all CPUs, segments",
+                 cfg.n_threads);
+        failed += report(what, psd.n_segments, "", same);
+        welch_psd_free(&psd);
+    }
+
+    // 8 samples at 95% overlap round to no step; every offset is a segment
+    WelchConfig tiny = { 8, 0.95, WINDOW_HANN, 0 };
+    cap.n_samples = 100;
+    int ok = welch_psd(&cap, &tiny, &psd) == 0 && psd.n_segments == cap.n_samples - tiny.segment + 1;
+    failed += report("Welch 8-sample segments at 95%", psd.n_segments, "", ok);
+    welch_psd_free(&psd);
+
+    welch_psd_free(&ref);
+    capture_free(&cap);
+    return failed;
+}
+
+int main(void) {
+    int failed = check_sdft_bins();
+    failed += check_sdft_present();
+    failed += check_welch();
+
+    arena_free(scratch_arena());
+    window_cache_free();
+    printf("%s\n", failed ? "Spectrum check failed." : "Spectrum check passed.");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
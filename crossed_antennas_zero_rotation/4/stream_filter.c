@@ -0,0 +1,186 @@
+#include "includes.h"
+
+// Stateful filters for streaming.
+// Each object keeps its delay line between calls, so a signal pushed through
+// in blocks of any size comes out the same as if it were filtered in one go.
+
+// IIR from b[0..order] and a[0..order], normalized so a[0] == 1
+int stream_iir_init(StreamIIR *iir, const double *b, const double *a, int order) {
+    if (!iir || !b || !a || order < 0 || order > IIR_MAX_ORDER || a[0] == 0.0) {
+        fprintf(stderr, "Invalid IIR parameters.\n");
+        return -1;
+    }
+
+    memset(iir, 0, sizeof(*iir));
+    iir->order = order;
+    for (int i = 0; i <= order; i++) {
+        iir->b[i] = b[i] / a[0];
+        iir->a[i] = a[i] / a[0];
+    }
+    return 0;
+}
+
+// One-pole DC blocker y[n] = x[n] - x[n-1] + r * y[n-1]
+int stream_iir_dc_blocker(StreamIIR *iir, double fs, double cutoff_hz) {
+    if (fs <= 0.0 || cutoff_hz <= 0.0 || cutoff_hz >= fs / 2.0) {
+        fprintf(stderr, "Invalid DC blocker parameters.\n");
+        return -1;
+    }
+
+    double r = exp(-2.0 * M_PI * cutoff_hz / fs);
+    double b[2] = { 1.0, -1.0 };
+    double a[2] = { 1.0, -r };
+    return stream_iir_init(iir, b, a, 1);
+}
+
+void stream_iir_reset(StreamIIR *iir) {
+    memset(iir->z, 0, sizeof(iir->z));
+}
+
+// Delay line at steady state for a constant input x0, so a signal starting
+// at x0 has no start-up transient
+void stream_iir_prime(StreamIIR *iir, double x0) {
+    int order = iir->order;
+    double sum_b = 0.0, sum_a = 0.0;
+    for (int k = 0; k <= order; k++) {
+        sum_b += iir->b[k];
+        sum_a += iir->a[k];
+    }
+    double y0 = sum_a != 0.0 ? x0 * sum_b / sum_a : 0.0;
+
+    for (int k = order; k >= 1; k--) {
+        double z = iir->b[k] * x0 - iir->a[k] * y0;
+        iir->z[k - 1] = k < order ? z + iir->z[k] : z;
+    }
+}
+
+// In place, transposed direct form II
+void stream_iir_process(StreamIIR *iir, double *x, int n) {
+    int order = iir->order;
+    const double *b = iir->b;
+    const double *a = iir->a;
+    double *z = iir->z;
+
+    if (order == 0) {
+        for (int i = 0; i < n; i++)
+            x[i] *= b[0];
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        double in = x[i];
+        double out = b[0] * in + z[0];
+        for (int k = 1; k < order; k++)
+            z[k - 1] = b[k] * in - a[k] * out + z[k];
+        z[order - 1] = b[order] * in - a[order] * out;
+        x[i] = out;
+    }
+}
+
+
+// The filter is borrowed and must outlive the stream
+int stream_fir_init(StreamFIR *fir, const FIRFilter *filter, int max_block) {
+    if (!fir || !filter || filter->num_taps <= 0 || max_block <= 0) {
+        fprintf(stderr, "Invalid streaming FIR parameters.\n");
+        return -1;
+    }
+
+    memset(fir, 0, sizeof(*fir));
+    fir->hist = (double*)calloc(filter->num_taps - 1 + max_block, sizeof(double));
+    if (!fir->hist) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return -1;
+    }
+    fir->filter = filter;
+    fir->symmetric = fir_is_symmetric(filter);
+    fir->max_block = max_block;
+    return 0;
+}
+
+void stream_fir_free(StreamFIR *fir) {
+    if (!fir)
+        return;
+    free(fir->hist);
+    memset(fir, 0, sizeof(*fir));
+}
+
+// Forget past input, as if the stream started again
+void stream_fir_reset(StreamFIR *fir) {
+    memset(fir->hist, 0, (fir->filter->num_taps - 1) * sizeof(double));
+}
+
+// Output k of the stream is output k - delay of filter_fir on the whole
+// signal; feeding delay zeros at the end flushes the tail
+int stream_fir_delay(const StreamFIR *fir) {
+    int n_taps = fir->filter->num_taps;
+    return n_taps - 1 - n_taps / 2;
+}
+
+// In place, any block length
+void stream_fir_process(StreamFIR *fir, double *x, int n) {
+    const double *taps = fir->filter->taps;
+    int n_taps = fir->filter->num_taps;
+    int n_hist = n_taps - 1;
+    double *hist = fir->hist;
+
+    while (n > 0) {
+        int n_out = n < fir->max_block ? n : fir->max_block;
+        memcpy(hist + n_hist, x, n_out * sizeof(double));
+
+        if (!fir->symmetric || fir_symmetric_window(hist, x, n_out, fir->filter, FIR_KERNEL_AUTO) != 0) {
+            for (int i = 0; i < n_out; i++) {
+                const double *w = hist + i;
+                double sum = 0.0;
+                for (int j = 0; j < n_taps; j++)
+                    sum += taps[j] * w[j];
+                x[i] = sum;
+            }
+        }
+
+        memmove(hist, hist + n_out, n_hist * sizeof(double));
+        x += n_out;
+        n -= n_out;
+    }
+}
+
+
+int stream_delay_init(StreamDelay *delay, int d) {
+    memset(delay, 0, sizeof(*delay));
+    if (d <= 0)
+        return 0;
+
+    delay->buf = (double*)calloc(d, sizeof(double));
+    if (!delay->buf) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return -1;
+    }
+    delay->d = d;
+    return 0;
+}
+
+void stream_delay_free(StreamDelay *delay) {
+    if (!delay)
+        return;
+    free(delay->buf);
+    memset(delay, 0, sizeof(*delay));
+}
+
+void stream_delay_reset(StreamDelay *delay) {
+    if (delay->d > 0)
+        memset(delay->buf, 0, delay->d * sizeof(double));
+    delay->pos = 0;
+}
+
+// In place; the first d outputs are zeros
+void stream_delay_process(StreamDelay *delay, double *x, int n) {
+    if (delay->d == 0)
+        return;
+
+    for (int i = 0; i < n; i++) {
+        double out = delay->buf[delay->pos];
+        delay->buf[delay->pos] = x[i];
+        x[i] = out;
+        if (++delay->pos == delay->d)
+            delay->pos = 0;
+    }
+}
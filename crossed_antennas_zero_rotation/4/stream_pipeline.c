@@ -0,0 +1,276 @@
+#include "includes.h"
+
+// Constant-memory processing of a CSV of any length.
+// Blocks of rows go through a DC blocker and the FIR bandpass, both keeping
+// their state across blocks, and the filtered samples feed the running
+// statistics as they come out. Timestamps are delayed by the FIR's group
+// delay so every output keeps the time of the input it is centred on, and
+// the FIR tail is flushed with zeros at the end, which makes the output the
+// same as filter_fir on the whole signal. Memory use depends only on the
+// block size and the number of taps.
+// A gap or glitch in the timestamps ends the segment: the FIR is flushed
+// there as at the end of the file, the filters restart, and the DC blocker
+// is primed with the first sample of the new segment. Glitch rows are
+// dropped, and outliers keep their row with the time the grid gives it.
+// The splits are the timebase estimator's events, as for a capture read
+// whole, so rows wait at the front of the block until the estimator has
+// settled them: at most its warm-up, then one row held off the grid.
+
+#define STREAM_HOLD (TIMEBASE_WARMUP + 1)   // rows not settled yet, at most
+
+typedef struct {
+    const StreamConfig *cfg;
+    StreamStats *stats;
+    Capture *tail;                      // newest outputs, one block's worth
+    long long next_report;
+    int skip;                           // outputs left that precede the first input
+} StreamSink;
+
+// Events settled but not yet acted on, in row order
+typedef struct {
+    TimebaseEvent *ev;
+    int n, capacity;
+} StreamEvents;
+
+static void stream_event(void *ctx, const TimebaseEvent *ev) {
+    StreamEvents *q = (StreamEvents*)ctx;
+    if (q->n < q->capacity)
+        q->ev[q->n++] = *ev;
+}
+
+// Filters applied to each segment
+typedef struct {
+    int use_dc;
+    StreamIIR dc[2];
+    const FIRFilter *filter;
+    StreamFIR fir[2];
+    int delay;                          // FIR group delay, in samples
+    StreamDelay tdelay;                 // time axis delayed to match
+    Capture flush;                      // zeros pushed through at segment ends
+} StreamChain;
+
+static void stream_emit(StreamSink *sink, const Capture *block) {
+    int from = sink->skip < block->n_samples ? sink->skip : block->n_samples;
+    sink->skip -= from;
+    int n = block->n_samples - from;
+    if (n <= 0)
+        return;
+
+    stream_stats_update(sink->stats, block->ch[0] + from, block->ch[1] + from, n);
+
+    // Slide the tail so it ends with the newest of these n samples
+    Capture *tail = sink->tail;
+    int fit = n < tail->capacity ? n : tail->capacity;
+    int keep = tail->capacity - fit;
+    if (keep > tail->n_samples)
+        keep = tail->n_samples;
+    int drop = tail->n_samples - keep;
+    double *dst[3] = { tail->time, tail->ch[0], tail->ch[1] };
+    double *src[3] = { block->time, block->ch[0], block->ch[1] };
+    for (int p = 0; p < 3; p++) {
+        memmove(dst[p], dst[p] + drop, keep * sizeof(double));
+        memcpy(dst[p] + keep, src[p] + from + n - fit, fit * sizeof(double));
+    }
+    tail->n_samples = keep + fit;
+
+    if (sink->cfg->report_every > 0 && sink->stats->xy.n >= sink->next_report) {
+        stream_stats_print(sink->stats);
+        while (sink->next_report <= sink->stats->xy.n)
+            sink->next_report += sink->cfg->report_every;
+    }
+}
+
+// Rows [from, from + n) of block through the chain and out
+static void stream_chain_run(StreamChain *chain, StreamSink *sink, Capture *block, int from, int n) {
+    if (n <= 0)
+        return;
+
+    Capture piece = *block;
+    piece.n_samples = n;
+    piece.time = block->time + from;
+    for (int c = 0; c < 2; c++) {
+        piece.ch[c] = block->ch[c] + from;
+        if (chain->use_dc)
+            stream_iir_process(&chain->dc[c], piece.ch[c], n);
+        if (chain->filter)
+            stream_fir_process(&chain->fir[c], piece.ch[c], n);
+    }
+    stream_delay_process(&chain->tdelay, piece.time, n);
+    stream_emit(sink, &piece);
+}
+
+// New segment starting with samples x0 of the two channels
+static void stream_chain_start(StreamChain *chain, StreamSink *sink, const double *x0) {
+    for (int c = 0; c < 2; c++) {
+        if (chain->use_dc)
+            stream_iir_prime(&chain->dc[c], x0[c]);
+        if (chain->filter)
+            stream_fir_reset(&chain->fir[c]);
+    }
+    stream_delay_reset(&chain->tdelay);
+    sink->skip = chain->delay;
+}
+
+// Flush the FIR with zeros, continuing the time axis from t_last at fs
+static void stream_chain_flush(StreamChain *chain, StreamSink *sink, double t_last, double fs) {
+    Capture *block = &chain->flush;
+    for (int done = 0; done < chain->delay; ) {
+        int n = chain->delay - done < block->capacity ? chain->delay - done : block->capacity;
+        for (int i = 0; i < n; i++) {
+            block->time[i] = t_last + (done + i + 1) / fs;
+            block->ch[0][i] = 0.0;
+            block->ch[1][i] = 0.0;
+        }
+        block->n_samples = n;
+        for (int c = 0; c < 2; c++)
+            stream_fir_process(&chain->fir[c], block->ch[c], n);
+        stream_delay_process(&chain->tdelay, block->time, n);
+        stream_emit(sink, block);
+        done += n;
+    }
+}
+
+static double stream_fs(const StreamStats *stats, const StreamConfig *cfg) {
+    Timebase fit;
+    return timebase_fit(&stats->timebase, &fit) == 0 ? fit.fs : cfg->fs;
+}
+
+// Run the file through the pipeline. stats receives the totals and tail the
+// last block of filtered output (caller frees it with capture_free).
+int stream_process_csv(const char *filename, const StreamConfig *cfg, StreamStats *stats, Capture *tail) {
+    if (!filename || !cfg || !stats || !tail || cfg->fs <= 0.0) {
+        fprintf(stderr, "Invalid streaming parameters.\n");
+        return -1;
+    }
+
+    int block_size = cfg->block_size > 0 ? cfg->block_size : STREAM_BLOCK;
+    int rv = -1;
+
+    CSVStream cs;
+    Capture block = {0};
+    StreamChain chain;
+    StreamSink sink = { cfg, stats, tail, cfg->report_every, 0 };
+    StreamEvents events = { NULL, 0, 0 };
+
+    memset(&chain, 0, sizeof(chain));
+    chain.use_dc = cfg->dc_cutoff_hz > 0.0;
+    chain.filter = cfg->filter;
+    memset(tail, 0, sizeof(*tail));
+    stream_stats_reset(stats);
+    if (csv_stream_open(&cs, filename) != 0)
+        return -1;
+
+    if (capture_init(&block, 2, block_size + STREAM_HOLD, 1) != 0 || capture_init(tail, 2, block_size, 1) != 0
+        || capture_init(&chain.flush, 2, block_size, 1) != 0)
+        goto cleanup;
+    tail->n_samples = 0;
+    tail->fs = cfg->fs;
+
+    for (int c = 0; c < 2; c++) {
+        if (chain.use_dc && stream_iir_dc_blocker(&chain.dc[c], cfg->fs, cfg->dc_cutoff_hz) != 0)
+            goto cleanup;
+        if (cfg->filter && stream_fir_init(&chain.fir[c], cfg->filter, block_size) != 0)
+            goto cleanup;
+    }
+
+    chain.delay = cfg->filter ? stream_fir_delay(&chain.fir[0]) : 0;
+    if (stream_delay_init(&chain.tdelay, chain.delay) != 0)
+        goto cleanup;
+
+    // Settled events drive the splits; the estimator reports them as it goes
+    events.capacity = block_size + STREAM_HOLD;
+    events.ev = (TimebaseEvent*)malloc(events.capacity * sizeof(TimebaseEvent));
+    if (!events.ev) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        goto cleanup;
+    }
+    stats->timebase.on_event = stream_event;
+    stats->timebase.ctx = &events;
+
+    int in_segment = 0;
+    long long n_segments = 0;
+    double t_last = 0.0;
+    long long row0 = 0;                 // row of block[0]
+    int n_held = 0;                     // rows at the front not settled before
+    for (;;) {
+        // New rows go in after the held ones
+        Capture in = block;
+        in.capacity = block_size;
+        in.time = block.time + n_held;
+        for (int c = 0; c < 2; c++)
+            in.ch[c] = block.ch[c] + n_held;
+        int got = csv_stream_read(&cs, &in);
+        if (got > 0)
+            timebase_push(&stats->timebase, in.time, 1, got);
+        else
+            timebase_finish(&stats->timebase);
+        int n = n_held + got;
+        int n_ready = (int)(timebase_settled(&stats->timebase) - row0);
+
+        int from = 0, e = 0;
+        for (int i = 0; i < n_ready; i++) {
+            const TimebaseEvent *ev = e < events.n && events.ev[e].row == row0 + i ? &events.ev[e++] : NULL;
+            int split = ev && ev->kind != TIMEBASE_OUTLIER;
+            if (ev && ev->kind == TIMEBASE_OUTLIER)
+                block.time[i] = t_last + 1.0 / stream_fs(stats, cfg);
+
+            // Segment ends before row i; a glitch row is dropped
+            if (split && in_segment) {
+                stream_chain_run(&chain, &sink, &block, from, i - from);
+                if (chain.filter)
+                    stream_chain_flush(&chain, &sink, t_last, stream_fs(stats, cfg));
+                in_segment = 0;
+            }
+            if (ev && ev->kind == TIMEBASE_GLITCH)
+                continue;
+
+            if (!in_segment) {
+                double x0[2] = { block.ch[0][i], block.ch[1][i] };
+                stream_chain_start(&chain, &sink, x0);
+                in_segment = 1;
+                n_segments++;
+                from = i;
+            }
+            t_last = block.time[i];
+        }
+        if (in_segment)
+            stream_chain_run(&chain, &sink, &block, from, n_ready - from);
+        events.n -= e;
+        memmove(events.ev, events.ev + e, events.n * sizeof(TimebaseEvent));
+
+        // Rows not settled yet wait at the front
+        n_held = n - n_ready;
+        double *plane[3] = { block.time, block.ch[0], block.ch[1] };
+        for (int p = 0; p < 3; p++)
+            memmove(plane[p], plane[p] + n_ready, n_held * sizeof(double));
+        row0 += n_ready;
+        if (got <= 0)
+            break;
+    }
+
+    if (cs.rows == 0) {
+        fprintf(stderr, "No valid samples found.\n");
+        goto cleanup;
+    }
+
+    if (in_segment && chain.filter)
+        stream_chain_flush(&chain, &sink, t_last, stream_fs(stats, cfg));
+
+    printf("Streamed %lld samples in blocks of %d, %lld segment%s.\n",
+           cs.rows, block_size, n_segments, n_segments == 1 ? "" : "s");
+    rv = 0;
+
+cleanup:
+    stats->timebase.on_event = NULL;
+    stats->timebase.ctx = NULL;
+    free(events.ev);
+    csv_stream_close(&cs, filename);
+    capture_free(&block);
+    capture_free(&chain.flush);
+    stream_fir_free(&chain.fir[0]);
+    stream_fir_free(&chain.fir[1]);
+    stream_delay_free(&chain.tdelay);
+    if (rv != 0)
+        capture_free(tail);
+    return rv;
+}
@@ -0,0 +1,45 @@
+#include "includes.h"
+
+// Running statistics for the streaming pipeline.
+// Means, variances and the channel cross term are merged block by block
+// into an XYCovariance, so they stay accurate over billions of samples and
+// give the XY ellipse at any point. The input timestamps go to a
+// timebase estimator, fed by the pipeline before filtering.
+
+void stream_stats_reset(StreamStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    timebase_init(&stats->timebase);
+}
+
+void stream_stats_update(StreamStats *stats, const double *ch0, const double *ch1, int n) {
+    xy_cov_update(&stats->xy, ch0, ch1, n);
+    for (int i = 0; i < n; i++) {
+        double a = fmax(fabs(ch0[i]), fabs(ch1[i]));
+        if (a > stats->peak)
+            stats->peak = a;
+    }
+}
+
+// One line summarizing everything seen so far, and the XY ellipse
+void stream_stats_print(const StreamStats *stats) {
+    const XYCovariance *xy = &stats->xy;
+    Timebase fit;
+    if (xy->n < 2 || timebase_fit(&stats->timebase, &fit) != 0) {
+        printf("%lld samples\n", xy->n);
+        return;
+    }
+
+    double rms0 = sqrt(xy->m2[0] / xy->n);
+    double rms1 = sqrt(xy->m2[1] / xy->n);
+    double denom = sqrt(xy->m2[0] * xy->m2[1]);
+    double corr = denom > 0.0 ? xy->c01 / denom : 0.0;
+
+    printf("t = %.6lf s, %lld samples, fs = %lf Hz (jitter %lg s rms, %lld gaps, %lld glitches), "
+           "RMS CH 0 = %lg V, RMS CH 1 = %lg V, peak = %lg V, corr = %.4lf\n",
+           stats->timebase.t_last, xy->n, fit.fs, fit.jitter_rms,
+           stats->timebase.n_gaps, stats->timebase.n_glitches, rms0, rms1, stats->peak, corr);
+
+    XYEllipse ellipse;
+    if (xy_ellipse_fit(xy, &ellipse) == 0)
+        xy_ellipse_print(&ellipse);
+}
@@ -0,0 +1,10 @@
+#!/bin/bash
+set -e
+make
+./fft_check
+./filtfilt_check
+./fir_check
+./io_check
+./baseband_check
+./spectrum_check
+./null_check
@@ -0,0 +1,280 @@
+#include "includes.h"
+
+// Streaming timebase estimation.
+// The nominal period is the median step of the first TIMEBASE_WARMUP steps.
+// After that every row is placed against the fitted line at the last row
+// on the grid: within half a period of the next sample it is normal. A row
+// elsewhere waits for the next one, since a single bad timestamp must not
+// move the grid: if the next row lies beyond it, it is a gap of k > 1
+// periods and is fitted at its true sample index k further on; if the next
+// row sits two samples on, it was a lone outlier and keeps the slot in
+// between, its timestamp left out of the fit; otherwise (repeated rows) it
+// is a glitch and the row is left out. The fit is a running least-squares
+// line of t against sample index, kept as Welford sums of the residual from
+// the nominal grid so the sums stay small however long the capture is.
+
+void timebase_init(TimebaseEstimator *tb) {
+    memset(tb, 0, sizeof(*tb));
+    tb->dt_min = INFINITY;
+    tb->dt_max = -INFINITY;
+}
+
+static void timebase_event(TimebaseEstimator *tb, long long row, TimebaseEventKind kind, long long missing) {
+    TimebaseEvent e = { row, kind, missing };
+    if (tb->n_events < TIMEBASE_MAX_EVENTS)
+        tb->events[tb->n_events++] = e;
+    if (tb->on_event)
+        tb->on_event(tb->ctx, &e);
+}
+
+static void timebase_add_point(TimebaseEstimator *tb, long long index, double t) {
+    double i = (double)index;
+    double r = t - tb->t_first - i * tb->dt_nominal;
+    double inv_n = 1.0 / (double)++tb->n_fit;
+    double di = i - tb->mean_i;
+    double dr = r - tb->mean_r;
+    tb->mean_i += di * inv_n;
+    tb->mean_r += dr * inv_n;
+    tb->s_ii += di * (i - tb->mean_i);
+    tb->s_ir += di * (r - tb->mean_r);
+    tb->s_rr += dr * (r - tb->mean_r);
+    tb->index = index;
+    tb->index_last = index;
+    tb->t_last = t;
+}
+
+// Sample periods a step spans: 1 for a normal step, k > 1 across a gap of
+// k - 1 samples, 0 for a glitch
+long long timebase_step_periods(double step, double period) {
+    double periods = step / period;
+    if (!(periods >= 1.0 - TIMEBASE_STEP_TOL))
+        return 0;
+    return llround(periods);
+}
+
+// Sample periods from the fitted line at the last row on the grid to t,
+// counted in the fitted period: across a long gap the nominal one, a
+// median of rounded steps, would miscount the missing samples
+static long long timebase_periods_to(const TimebaseEstimator *tb, double t) {
+    double slope = tb->s_ii > 0.0 ? tb->s_ir / tb->s_ii : 0.0;
+    double i = (double)tb->index;
+    double line = tb->t_first + i * tb->dt_nominal + tb->mean_r + slope * (i - tb->mean_i);
+    return timebase_step_periods(t - line, tb->dt_nominal + slope);
+}
+
+// Settle the row held off the grid, given that the next one is k periods on
+static long long timebase_resolve(TimebaseEstimator *tb, long long k) {
+    long long kp = timebase_periods_to(tb, tb->pending_t);
+    tb->pending = 0;
+    if (kp >= 2 && k > kp) {
+        tb->n_gaps++;
+        tb->n_missing += kp - 1;
+        timebase_event(tb, tb->pending_row, TIMEBASE_GAP, kp - 1);
+        timebase_add_point(tb, tb->index + kp, tb->pending_t);
+        return k - kp;
+    }
+    if (k == 2) {
+        tb->n_outliers++;
+        timebase_event(tb, tb->pending_row, TIMEBASE_OUTLIER, 0);
+        tb->index++;
+        return 1;
+    }
+    tb->n_glitches++;
+    timebase_event(tb, tb->pending_row, TIMEBASE_GLITCH, 0);
+    return k;
+}
+
+static void timebase_classify(TimebaseEstimator *tb, long long row, double t) {
+    if (tb->n_fit == 0) {
+        tb->t_first = t;
+        timebase_add_point(tb, 0, t);
+        return;
+    }
+
+    long long k = timebase_periods_to(tb, t);
+    if (tb->pending) {
+        k = timebase_resolve(tb, k);
+        // A confirmed gap moved the grid; look again from there
+        if (k != 1)
+            k = timebase_periods_to(tb, t);
+    }
+    if (k != 1) {
+        tb->pending = 1;
+        tb->pending_row = row;
+        tb->pending_t = t;
+        return;
+    }
+
+    // Step deviation only between neighbouring fitted rows
+    if (tb->index_last == tb->index) {
+        double step = t - tb->t_last;
+        double periods = step / tb->dt_nominal;
+        int bin = (int)floor((periods - 1.0 + TIMEBASE_STEP_TOL) / (2.0 * TIMEBASE_STEP_TOL) * TIMEBASE_HIST_BINS);
+        if (bin < 0) bin = 0;
+        if (bin >= TIMEBASE_HIST_BINS) bin = TIMEBASE_HIST_BINS - 1;
+        tb->hist[bin]++;
+        if (step < tb->dt_min) tb->dt_min = step;
+        if (step > tb->dt_max) tb->dt_max = step;
+    }
+
+    timebase_add_point(tb, tb->index + 1, t);
+}
+
+// The oldest count warm-up rows have no usable time: glitches
+static void timebase_drop_warmup(TimebaseEstimator *tb, int count) {
+    long long row = tb->n_rows - tb->n_warmup;
+    for (int w = 0; w < count; w++) {
+        tb->n_glitches++;
+        timebase_event(tb, row + w, TIMEBASE_GLITCH, 0);
+    }
+}
+
+// Fix the nominal period from the buffered rows and run them through
+static void timebase_settle(TimebaseEstimator *tb) {
+    double steps[TIMEBASE_WARMUP];
+    int n_steps = 0;
+    for (int k = 1; k < tb->n_warmup; k++) {
+        double step = tb->warmup[k] - tb->warmup[k - 1];
+        if (step > 0.0) {
+            int j = n_steps++;
+            for (; j > 0 && steps[j - 1] > step; j--)
+                steps[j] = steps[j - 1];
+            steps[j] = step;
+        }
+    }
+    if (n_steps == 0)
+        return;
+
+    tb->dt_nominal = steps[n_steps / 2];
+    long long row = tb->n_rows - tb->n_warmup;
+    for (int k = 0; k < tb->n_warmup; k++)
+        timebase_classify(tb, row + k, tb->warmup[k]);
+    tb->n_warmup = 0;
+}
+
+// n timestamps spaced stride doubles apart; rows continue across calls
+void timebase_push(TimebaseEstimator *tb, const double *time, size_t stride, int n) {
+    for (int k = 0; k < n; k++) {
+        double t = time[k * stride];
+        long long row = tb->n_rows++;
+        if (tb->dt_nominal > 0.0) {
+            timebase_classify(tb, row, t);
+            continue;
+        }
+        tb->warmup[tb->n_warmup++] = t;
+        if (tb->n_warmup == TIMEBASE_WARMUP + 1) {
+            timebase_settle(tb);
+            // No positive step yet: keep only the newest row and go on waiting
+            if (tb->dt_nominal <= 0.0) {
+                timebase_drop_warmup(tb, tb->n_warmup - 1);
+                tb->warmup[0] = t;
+                tb->n_warmup = 1;
+            }
+        }
+    }
+}
+
+// End of the timestamps: a row still held off the grid has nothing to
+// confirm it and is left out
+void timebase_finish(TimebaseEstimator *tb) {
+    if (tb->dt_nominal <= 0.0)
+        timebase_settle(tb);
+    timebase_drop_warmup(tb, tb->n_warmup);
+    tb->n_warmup = 0;
+    if (tb->pending)
+        timebase_resolve(tb, 0);
+}
+
+// Rows whose place on the grid is final; the newer ones may still turn out
+// to be gaps, glitches or outliers
+long long timebase_settled(const TimebaseEstimator *tb) {
+    return tb->n_rows - tb->n_warmup - tb->pending;
+}
+
+// Fit so far; -1 until two rows have been fitted
+int timebase_fit(const TimebaseEstimator *tb, Timebase *fit) {
+    TimebaseEstimator settled;
+    if (tb->dt_nominal <= 0.0) {
+        settled = *tb;
+        settled.on_event = NULL;
+        timebase_settle(&settled);
+        tb = &settled;
+    }
+    if (tb->n_fit < 2 || tb->s_ii <= 0.0)
+        return -1;
+
+    double slope = tb->s_ir / tb->s_ii;
+    double period = tb->dt_nominal + slope;
+    double sse = tb->s_rr - slope * tb->s_ir;
+
+    fit->fs = 1.0 / period;
+    fit->t0 = tb->t_first + tb->mean_r - slope * tb->mean_i;
+    fit->jitter_rms = sqrt(fmax(sse, 0.0) / tb->n_fit);
+    fit->accuracy_percent = 0.0;
+    if (tb->dt_max >= tb->dt_min)
+        fit->accuracy_percent = fmax(fabs(tb->dt_max - period), fabs(tb->dt_min - period)) / period * 100.0;
+    return 0;
+}
+
+void timebase_print(const TimebaseEstimator *tb, const Timebase *fit) {
+    printf("Timebase: fs = %lf Hz, t0 = %.9lg s, jitter = %lg s rms (%.4lf periods), %lld rows\n",
+           fit->fs, fit->t0, fit->jitter_rms, fit->jitter_rms * fit->fs, tb->n_rows);
+
+    if (tb->n_gaps || tb->n_glitches || tb->n_outliers) {
+        printf("Timebase: %lld gaps (%lld samples missing), %lld glitches, %lld outliers\n",
+               tb->n_gaps, tb->n_missing, tb->n_glitches, tb->n_outliers);
+        for (int e = 0; e < tb->n_events; e++) {
+            const TimebaseEvent *ev = &tb->events[e];
+            if (ev->kind == TIMEBASE_GAP)
+                printf("  row %lld: gap, %lld samples missing\n", ev->row, ev->missing);
+            else if (ev->kind == TIMEBASE_OUTLIER)
+                printf("  row %lld: outlier, timestamp ignored\n", ev->row);
+            else
+                printf("  row %lld: glitch, row dropped\n", ev->row);
+        }
+        if (tb->n_gaps + tb->n_glitches + tb->n_outliers > tb->n_events)
+            printf("  ...\n");
+    }
+
+    printf("Step deviation (periods):");
+    for (int b = 0; b < TIMEBASE_HIST_BINS; b++) {
+        if (!tb->hist[b])
+            continue;
+        double lo = -TIMEBASE_STEP_TOL + b * (2.0 * TIMEBASE_STEP_TOL / TIMEBASE_HIST_BINS);
+        printf(" [%+.2lf: %lld]", lo, tb->hist[b]);
+    }
+    printf("\n");
+}
+
+// Fit the capture's timestamps, print the fit and store it in fs and t0.
+// With drop_time and no gaps or glitches the timestamp plane is released,
+// since t0 + i / fs then reproduces it to within the jitter (and replaces
+// the timestamps of outliers).
+int capture_fit_timebase(Capture *cap, Timebase *fit, int drop_time) {
+    if (!cap->time) {
+        if (cap->fs <= 0.0)
+            return -1;
+        fit->fs = cap->fs;
+        fit->t0 = cap->t0;
+        fit->jitter_rms = 0.0;
+        fit->accuracy_percent = 0.0;
+        return 0;
+    }
+
+    TimebaseEstimator tb;
+    timebase_init(&tb);
+    timebase_push(&tb, cap->time, 1, cap->n_samples);
+    timebase_finish(&tb);
+    if (timebase_fit(&tb, fit) != 0)
+        return -1;
+    timebase_print(&tb, fit);
+
+    cap->fs = fit->fs;
+    cap->t0 = fit->t0;
+    if (drop_time && tb.n_gaps == 0 && tb.n_glitches == 0) {
+        if (!cap->map)
+            free(cap->time);
+        cap->time = NULL;
+    }
+    return 0;
+}
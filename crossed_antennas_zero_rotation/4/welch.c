@@ -0,0 +1,298 @@
+#include "includes.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Welch power spectral density.
+// One periodogram of the whole capture has the variance of a single
+// sample in every bin; averaging the periodograms of overlapping windowed
+// segments trades resolution for a noise floor that can actually be read.
+// Windows come from a cache shared by every caller, filled once per type
+// and length. Both channels go through one complex FFT per segment. The
+// segments are grouped in chunks whose size depends only on the number of
+// segments; threads sum whole chunks, and the chunk sums are added in
+// order at the end, so the result is bit for bit the same on any number of
+// threads.
+
+#define WELCH_MAX_THREADS 64
+#define WELCH_MAX_CHUNKS 256
+#define WELCH_MIN_CHUNK 8               // segments summed per chunk at least
+
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+static WindowTable *window_cache = NULL;
+
+const char *window_name(WindowType type) {
+    switch (type) {
+        case WINDOW_HANN: return "hann";
+        case WINDOW_HAMMING: return "hamming";
+        case WINDOW_BLACKMAN_HARRIS: return "blackman-harris";
+        default: return "rectangular";
+    }
+}
+
+// Periodic (DFT-even) form, as suits spectral analysis
+static double window_value(WindowType type, int i, int n) {
+    double x = 2.0 * M_PI * i / n;
+    switch (type) {
+        case WINDOW_HANN: return 0.5 - 0.5 * cos(x);
+        case WINDOW_HAMMING: return 0.54 - 0.46 * cos(x);
+        case WINDOW_BLACKMAN_HARRIS:
+            return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+        default: return 1.0;
+    }
+}
+
+// Tables live until window_cache_free
+const WindowTable *window_table(WindowType type, int n) {
+    if (n < 1)
+        return NULL;
+
+    pthread_mutex_lock(&window_lock);
+    WindowTable *t = window_cache;
+    while (t && (t->type != type || t->n != n))
+        t = t->next;
+    if (!t) {
+        t = (WindowTable*)calloc(1, sizeof(WindowTable));
+        double *w = (double*)malloc(n * sizeof(double));
+        if (!t || !w) {
+            free(t);
+            free(w);
+            pthread_mutex_unlock(&window_lock);
+            fprintf(stderr, "Memory allocation failed.\n");
+            return NULL;
+        }
+        t->type = type;
+        t->n = n;
+        t->w = w;
+        for (int i = 0; i < n; i++) {
+            w[i] = window_value(type, i, n);
+            t->sum += w[i];
+            t->sum2 += w[i] * w[i];
+        }
+        t->next = window_cache;
+        window_cache = t;
+    }
+    pthread_mutex_unlock(&window_lock);
+    return t;
+}
+
+void window_cache_free(void) {
+    pthread_mutex_lock(&window_lock);
+    while (window_cache) {
+        WindowTable *t = window_cache;
+        window_cache = t->next;
+        free(t->w);
+        free(t);
+    }
+    pthread_mutex_unlock(&window_lock);
+}
+
+// Chunks first to last of the segments, each summed into its own slot of
+// acc (n_bins per channel)
+typedef struct {
+    const double *x[2];
+    const WindowTable *win;
+    const FFTPlan *plan;
+    int step, n_segs, chunk_size;
+    int first, last;
+    int n_bins;
+    double *acc;
+    int ok;
+} WelchTask;
+
+static void *welch_worker(void *arg) {
+    WelchTask *t = (WelchTask*)arg;
+    int L = t->win->n, n_bins = t->n_bins;
+    const double *w = t->win->w;
+
+    Arena *arena = scratch_arena();
+    ArenaMark mark = arena_mark(arena);
+    double complex *buf = (double complex*)arena_alloc(arena, 2 * (size_t)L * sizeof(double complex));
+    double complex *spec = (double complex*)arena_alloc(arena, 2 * (size_t)n_bins * sizeof(double complex));
+    if (!buf || !spec) {
+        arena_release(arena, mark);
+        return NULL;
+    }
+    double complex *z = buf + L;
+
+    for (int c = t->first; c < t->last; c++) {
+        double *acc0 = t->acc + (size_t)c * 2 * n_bins;
+        double *acc1 = acc0 + n_bins;
+        memset(acc0, 0, 2 * n_bins * sizeof(double));
+        int s_end = (c + 1) * t->chunk_size < t->n_segs ? (c + 1) * t->chunk_size : t->n_segs;
+        for (int s = c * t->chunk_size; s < s_end; s++) {
+            const double *x0 = t->x[0] + (size_t)s * t->step;
+            if (t->x[1]) {
+                const double *x1 = t->x[1] + (size_t)s * t->step;
+                for (int i = 0; i < L; i++)
+                    buf[i] = w[i] * x0[i] + I * (w[i] * x1[i]);
+            } else {
+                for (int i = 0; i < L; i++)
+                    buf[i] = w[i] * x0[i];
+            }
+            if (fft_execute(t->plan, buf, z) != 0) {
+                arena_release(arena, mark);
+                return NULL;
+            }
+            fft_split_dual_real(z, L, spec, spec + n_bins);
+            for (int k = 0; k < n_bins; k++) {
+                acc0[k] += creal(spec[k]) * creal(spec[k]) + cimag(spec[k]) * cimag(spec[k]);
+                double complex v = spec[n_bins + k];
+                acc1[k] += creal(v) * creal(v) + cimag(v) * cimag(v);
+            }
+        }
+    }
+
+    arena_release(arena, mark);
+    t->ok = 1;
+    return NULL;
+}
+
+static void *welch_thread(void *arg) {
+    welch_worker(arg);
+    arena_thread_free();
+    return NULL;
+}
+
+void welch_psd_free(WelchPSD *psd) {
+    free(psd->psd[0]);
+    free(psd->psd[1]);
+    memset(psd, 0, sizeof(*psd));
+}
+
+// PSD of channels 0 and 1 (or just 0) of a uniformly sampled capture
+int welch_psd(const Capture *cap, const WelchConfig *cfg, WelchPSD *psd) {
+    memset(psd, 0, sizeof(*psd));
+    int L = cfg ? cfg->segment : 0;
+    if (!cap || !cfg || cap->n_channels < 1 || cap->fs <= 0.0 || L < 2
+        || cfg->overlap < 0.0 || cfg->overlap > 0.95 || cap->n_samples < L) {
+        fprintf(stderr, "Invalid Welch parameters.\n");
+        return -1;
+    }
+
+    // Short segments at high overlap round to no step at all
+    int step = L - (int)lround(cfg->overlap * L);
+    if (step < 1)
+        step = 1;
+    int n_segs = 1 + (cap->n_samples - L) / step;
+    int chunk_size = (n_segs + WELCH_MAX_CHUNKS - 1) / WELCH_MAX_CHUNKS;
+    if (chunk_size < WELCH_MIN_CHUNK)
+        chunk_size = WELCH_MIN_CHUNK;
+    int n_chunks = (n_segs + chunk_size - 1) / chunk_size;
+
+    int n_threads = cfg->n_threads;
+    if (n_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (n_threads > n_chunks)
+        n_threads = n_chunks;
+    if (n_threads > WELCH_MAX_THREADS)
+        n_threads = WELCH_MAX_THREADS;
+
+    int n_bins = L / 2 + 1;
+    int rv = -1;
+    const WindowTable *win = window_table(cfg->window, L);
+    FFTPlan *plan = fft_plan_create(L, 0);
+    double *acc = (double*)malloc((size_t)n_chunks * 2 * n_bins * sizeof(double));
+    WelchTask task[WELCH_MAX_THREADS];
+    pthread_t tid[WELCH_MAX_THREADS];
+    int started[WELCH_MAX_THREADS] = {0};
+    psd->n_channels = cap->n_channels < 2 ? 1 : 2;
+    for (int c = 0; c < psd->n_channels; c++)
+        psd->psd[c] = (double*)malloc(n_bins * sizeof(double));
+    if (!win || !plan || !acc || !psd->psd[0] || (psd->n_channels == 2 && !psd->psd[1])) {
+        fprintf(stderr, "Welch setup failed.\n");
+        goto cleanup;
+    }
+
+    // Contiguous runs of chunks, the first on this thread
+    for (int k = 0; k < n_threads; k++) {
+        task[k] = (WelchTask){ { cap->ch[0], psd->n_channels == 2 ? cap->ch[1] : NULL }, win, plan,
+                               step, n_segs, chunk_size,
+                               (int)((long long)n_chunks * k / n_threads),
+                               (int)((long long)n_chunks * (k + 1) / n_threads), n_bins, acc, 0 };
+    }
+    for (int k = 1; k < n_threads; k++)
+        started[k] = (pthread_create(&tid[k], NULL, welch_thread, &task[k]) == 0);
+    welch_worker(&task[0]);
+    for (int k = 1; k < n_threads; k++) {
+        if (started[k])
+            pthread_join(tid[k], NULL);
+        else
+            welch_worker(&task[k]);
+    }
+    for (int k = 0; k < n_threads; k++)
+        if (!task[k].ok)
+            goto cleanup;
+
+    // Chunk sums in order; one-sided, so every bin but DC and Nyquist doubles
+    double scale = 1.0 / ((double)n_segs * cap->fs * win->sum2);
+    for (int c = 0; c < psd->n_channels; c++) {
+        for (int k = 0; k < n_bins; k++) {
+            double sum = 0.0;
+            for (int j = 0; j < n_chunks; j++)
+                sum += acc[((size_t)j * 2 + c) * n_bins + k];
+            int edge = k == 0 || 2 * k == L;
+            psd->psd[c][k] = sum * scale * (edge ? 1.0 : 2.0);
+        }
+    }
+
+    psd->n_bins = n_bins;
+    psd->fs = cap->fs;
+    psd->df = cap->fs / L;
+    psd->n_segments = n_segs;
+    psd->enbw_hz = cap->fs * win->sum2 / (win->sum * win->sum);
+    psd->window = cfg->window;
+    rv = 0;
+
+cleanup:
+    fft_plan_destroy(plan);
+    free(acc);
+    if (rv != 0)
+        welch_psd_free(psd);
+    return rv;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Median bin, V^2/Hz: tones occupy few bins, so this is the noise
+double welch_noise_floor(const WelchPSD *psd, int ch) {
+    double *v = (double*)malloc(psd->n_bins * sizeof(double));
+    if (!v)
+        return 0.0;
+    memcpy(v, psd->psd[ch], psd->n_bins * sizeof(double));
+    qsort(v, psd->n_bins, sizeof(double), compare_doubles);
+    double median = v[psd->n_bins / 2];
+    free(v);
+    return median;
+}
+
+// Power in f_low..f_high, V^2; the window spreads a tone over a few bins,
+// which the sum collects
+double welch_band_power(const WelchPSD *psd, int ch, double f_low, double f_high) {
+    int k0 = (int)ceil(f_low / psd->df), k1 = (int)floor(f_high / psd->df);
+    if (k0 < 0)
+        k0 = 0;
+    if (k1 > psd->n_bins - 1)
+        k1 = psd->n_bins - 1;
+    double p = 0.0;
+    for (int k = k0; k <= k1; k++)
+        p += psd->psd[ch][k];
+    return p * psd->df;
+}
+
+void welch_print_summary(const WelchPSD *psd, double f_low, double f_high) {
+    printf("Welch PSD: %d segments of %d samples, %s window, %.1lf Hz bins (ENBW %.1lf Hz)\n",
+           psd->n_segments, 2 * (psd->n_bins - 1), window_name(psd->window), psd->df, psd->enbw_hz);
+    double band[2];
+    for (int c = 0; c < psd->n_channels; c++) {
+        band[c] = welch_band_power(psd, c, f_low, f_high);
+        printf("  CH %d: noise floor %.1lf dB V^2/Hz, %.0lf-%.0lf Hz power %.1lf dB V^2\n",
+               c, 10.0 * log10(welch_noise_floor(psd, c)), f_low, f_high, 10.0 * log10(band[c]));
+    }
+    if (psd->n_channels == 2 && band[0] > 0.0 && band[1] > 0.0)
+        printf("  Band power CH 1 / CH 0: %.1lf dB\n", 10.0 * log10(band[1] / band[0]));
+}
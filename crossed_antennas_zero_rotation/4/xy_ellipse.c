@@ -0,0 +1,96 @@
+#include "includes.h"
+
+// Null bearing from the XY figure without plotting it.
+// With the carrier on both loops the ch0/ch1 figure is an ellipse whose
+// major axis points along the bearing and whose minor axis is what is left
+// in the null. Both follow from the 2x2 covariance of the channels, which
+// is accumulated in one pass: each block is reduced to its mean and
+// deviations and merged into the running totals (Chan et al.), so any
+// number of samples costs O(1) memory and blocks, segments or threads can
+// be combined in any order. The fit is the eigen-decomposition of the
+// covariance: the eigenvalues are the mean squares along the two axes.
+
+#define XY_BLOCK 1024
+
+void xy_cov_reset(XYCovariance *cov) {
+    memset(cov, 0, sizeof(*cov));
+}
+
+void xy_cov_merge(XYCovariance *cov, const XYCovariance *other) {
+    if (other->n == 0)
+        return;
+    if (cov->n == 0) {
+        *cov = *other;
+        return;
+    }
+
+    double na = (double)cov->n, nb = (double)other->n, n = na + nb;
+    double d0 = other->mean[0] - cov->mean[0];
+    double d1 = other->mean[1] - cov->mean[1];
+    double w = na * nb / n;
+    cov->mean[0] += d0 * nb / n;
+    cov->mean[1] += d1 * nb / n;
+    cov->m2[0] += other->m2[0] + d0 * d0 * w;
+    cov->m2[1] += other->m2[1] + d1 * d1 * w;
+    cov->c01 += other->c01 + d0 * d1 * w;
+    cov->n += other->n;
+}
+
+// Two passes over each cache-sized block, then one merge per block
+void xy_cov_update(XYCovariance *cov, const double *ch0, const double *ch1, int n) {
+    for (int i0 = 0; i0 < n; i0 += XY_BLOCK) {
+        int len = n - i0 < XY_BLOCK ? n - i0 : XY_BLOCK;
+        const double *x = ch0 + i0, *y = ch1 + i0;
+
+        double sx = 0.0, sy = 0.0;
+        for (int i = 0; i < len; i++) {
+            sx += x[i];
+            sy += y[i];
+        }
+        XYCovariance blk = { len, { sx / len, sy / len }, { 0.0, 0.0 }, 0.0 };
+        for (int i = 0; i < len; i++) {
+            double dx = x[i] - blk.mean[0];
+            double dy = y[i] - blk.mean[1];
+            blk.m2[0] += dx * dx;
+            blk.m2[1] += dy * dy;
+            blk.c01 += dx * dy;
+        }
+        xy_cov_merge(cov, &blk);
+    }
+}
+
+int xy_ellipse_fit(const XYCovariance *cov, XYEllipse *fit) {
+    memset(fit, 0, sizeof(*fit));
+    if (cov->n < 2)
+        return -1;
+
+    double a = cov->m2[0] / cov->n;
+    double b = cov->m2[1] / cov->n;
+    double c = cov->c01 / cov->n;
+    double major = (a + b) / 2.0 + hypot((a - b) / 2.0, c);
+    if (major <= 0.0)
+        return -1;
+    // a*b - c*c still cancels on a deep null, so the minor axis can come out
+    // as rounding noise or below zero
+    double minor = (a * b - c * c) / major;
+    if (minor < 0.0)
+        minor = 0.0;
+
+    fit->bearing_deg = 0.5 * atan2(2.0 * c, a - b) * 180.0 / M_PI;
+    fit->major_rms = sqrt(major);
+    fit->minor_rms = sqrt(minor);
+    fit->axis_ratio = fit->minor_rms / fit->major_rms;
+    fit->null_depth_db = minor > 0.0 ? 20.0 * log10(fit->axis_ratio) : DB_FLOOR;
+    if (fit->null_depth_db < DB_FLOOR)
+        fit->null_depth_db = DB_FLOOR;
+    fit->ellipticity_deg = atan(fit->axis_ratio) * 180.0 / M_PI;
+    fit->corr = a > 0.0 && b > 0.0 ? c / sqrt(a * b) : 0.0;
+    return 0;
+}
+
+void xy_ellipse_print(const XYEllipse *fit) {
+    printf("XY ellipse: bearing %.2lf deg, null depth %.1lf dB (axes %lg / %lg V RMS), "
+           "ellipticity %.2lf deg, corr %.4lf\n",
+           fit->bearing_deg, fit->null_depth_db, fit->minor_rms, fit->major_rms,
+           fit->ellipticity_deg, fit->corr);
+}